@@ -21,27 +21,48 @@ and linked to. So, it would produce some errors if in here.
 
 // Types
 #include "snow/types/binpack.hh"
+#include "snow/types/bloom_filter.hh"
+#include "snow/types/concurrent_pool.hh"
+#include "snow/types/hash_map.hh"
 #include "snow/types/object_pool.hh"
+#include "snow/types/paged_pool.hh"
 #include "snow/types/range.hh"
 #include "snow/types/range_set.hh"
 #include "snow/types/slot_image.hh"
 #include "snow/types/slot_mask.hh"
+#include "snow/types/soa_pool.hh"
 #include "snow/types/triple_buffer.hh"
 #include "snow/types/types_2d.hh"
 
 // Data
 #include "snow/data/hash.hh"
+#include "snow/data/async_io.hh"
+#include "snow/data/buffer_stream.hh"
+#include "snow/data/buffer_writer.hh"
+#include "snow/data/chunker.hh"
+#include "snow/data/crc32c.hh"
+#include "snow/data/endian.hh"
+#include "snow/data/lz.hh"
+#include "snow/data/mapped_file.hh"
+#include "snow/data/record_log.hh"
+#include "snow/data/segment_list.hh"
 #if HAS_SHA256
 #include "snow/data/sha256.hh"
 #endif
 #include "snow/data/sparse.hh"
+#include "snow/data/tagged.hh"
+#include "snow/data/varint.hh"
 
 // Strings
 #include "snow/string/string.hh"
+#include "snow/string/string_ref.hh"
 #include "snow/string/compare.hh"
 #include "snow/string/split.hh"
 
 // Memory
+#include "snow/memory/accounting.hh"
+#include "snow/memory/arena.hh"
 #include "snow/memory/ref_counter.hh"
+#include "snow/memory/slab.hh"
 
 #endif /* end __SNOW_COMMON__SNOW_COMMON_HH__ include guard */
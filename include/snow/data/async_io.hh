@@ -0,0 +1,168 @@
+// async_io.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__ASYNC_IO_HH__
+#define __SNOW_COMMON__ASYNC_IO_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if !S_PLATFORM_WINDOWS
+
+namespace snow {
+
+
+/** Selects how async_io_t performs I/O. */
+enum async_io_backend_t : int
+{
+  /** io_uring where available, otherwise a thread pool. */
+  ASYNC_IO_DEFAULT,
+  /** io_uring (Linux 5.1+, requires HAS_IO_URING). */
+  ASYNC_IO_URING,
+  /** A pool of threads performing blocking pread/pwrite calls. */
+  ASYNC_IO_THREAD_POOL,
+};
+
+
+/** The outcome of an async_io_t request. */
+struct async_io_result_t
+{
+  /** The id returned when the request was made. */
+  uint64_t  id;
+  int       fd;
+  uint64_t  offset;
+  char     *buffer;
+  /** Number of bytes requested. */
+  size_t    length;
+  /**
+    Number of bytes transferred, or a negative errno value on failure. A read
+    transfers fewer than length bytes only if it reaches the end of the file.
+  */
+  ssize_t   result;
+  bool      is_write;
+  /** The context pointer passed with the request. */
+  void     *context;
+
+  inline bool ok() const { return result >= 0; }
+};
+
+
+typedef std::function<void(const async_io_result_t &)> async_io_callback_t;
+
+
+struct async_io_request_t;
+struct async_io_engine_t;
+
+
+/*==============================================================================
+
+  Asynchronous file reads and writes. Requests are queued by read() and
+  write() and handed to the kernel (or thread pool) in batches by submit(), so
+  many reads can be in flight without blocking the calling thread.
+
+  Completions are reaped by poll() (non-blocking) or wait() (blocking) on the
+  thread that owns the async_io_t. A request's callback, if it has one, is
+  invoked from there. Results of requests without a callback are queued for
+  next_completion(). event_fd() becomes readable when completions are ready,
+  so it can be added to an existing poll/epoll loop.
+
+  Short reads and writes are resubmitted until the request completes, fails,
+  or a read reaches the end of the file.
+
+  Buffers must stay valid until their request completes. An async_io_t is
+  not thread-safe. The destructor waits for all outstanding requests.
+
+==============================================================================*/
+struct S_EXPORT async_io_t
+{
+  /**
+    @param queue_depth  Maximum number of requests in flight at once. Further
+    requests wait in a backlog until earlier ones complete.
+    @param backend      Which backend to use. If io_uring is requested but
+    unavailable at runtime, the thread pool is used instead.
+    @param thread_count Number of threads for the thread pool backend.
+  */
+  async_io_t(unsigned queue_depth = 64,
+             async_io_backend_t backend = ASYNC_IO_DEFAULT,
+             unsigned thread_count = 4);
+  ~async_io_t();
+
+  async_io_t(const async_io_t &) = delete;
+  async_io_t &operator = (const async_io_t &) = delete;
+
+  /**
+    Queues a read of length bytes at offset in fd into buffer. The request
+    isn't started until the next submit(), poll(), or wait().
+    @return The request's id.
+  */
+  uint64_t read(int fd, uint64_t offset, void *buffer, size_t length,
+                async_io_callback_t callback = nullptr, void *context = nullptr);
+
+  /** Queues a read filling the stream's remaining bytes, from its current position to its end. */
+  uint64_t read(int fd, uint64_t offset, buffer_stream_t &stream,
+                async_io_callback_t callback = nullptr, void *context = nullptr);
+
+  /** Queues a write of length bytes from buffer to offset in fd. */
+  uint64_t write(int fd, uint64_t offset, const void *buffer, size_t length,
+                 async_io_callback_t callback = nullptr, void *context = nullptr);
+
+  /** Queues a write of the bytes written to the stream so far (base to current position). */
+  uint64_t write(int fd, uint64_t offset, const buffer_stream_t &stream,
+                 async_io_callback_t callback = nullptr, void *context = nullptr);
+
+  /** Starts all queued requests, up to the queue depth. */
+  void submit();
+
+  /**
+    Submits queued requests and reaps any finished ones without blocking.
+    @return The number of requests completed.
+  */
+  size_t poll();
+
+  /**
+    Submits queued requests and blocks until at least min_completions requests
+    complete, or until nothing is outstanding.
+    @return The number of requests completed.
+  */
+  size_t wait(size_t min_completions = 1);
+
+  /**
+    Pops the result of a completed request that had no callback. Returns false
+    if there are none. Call poll() or wait() to reap new completions.
+  */
+  bool next_completion(async_io_result_t &result);
+
+  /**
+    A descriptor that polls readable when completions may be ready to reap.
+    poll() and wait() clear it.
+  */
+  int event_fd() const;
+
+  /** Number of requests queued or in flight. */
+  inline size_t pending() const { return pending_; }
+
+  /** The backend in use. Never ASYNC_IO_DEFAULT. */
+  inline async_io_backend_t backend() const { return backend_; }
+
+private:
+  uint64_t enqueue(bool is_write, int fd, uint64_t offset, char *buffer, size_t length,
+                   async_io_callback_t &&callback, void *context);
+  size_t dispatch(std::vector<async_io_request_t *> &finished);
+
+  std::unique_ptr<async_io_engine_t> engine_;
+  async_io_backend_t backend_;
+  uint64_t next_id_;
+  size_t pending_;
+  std::deque<async_io_result_t> completions_;
+  std::vector<async_io_request_t *> finished_;
+};
+
+
+} // namespace snow
+
+#endif /* !S_PLATFORM_WINDOWS */
+
+#endif /* end __SNOW_COMMON__ASYNC_IO_HH__ include guard */
@@ -3,12 +3,67 @@
 #define __SNOW__BUFFER_STREAM_HH__
 
 #include <snow/config.hh>
+#include <snow/data/endian.hh>
+#include <snow/data/varint.hh>
+#include <snow/string/string_ref.hh>
+#include <cassert>
 #include <stdexcept>
+#include <type_traits>
 
 
 namespace snow {
 
 
+/*==============================================================================
+
+  Bounds policies for basic_buffer_stream_t. A policy decides whether reads,
+  seeks, and fixed-size writes test that they stay within the stream and what
+  happens when they don't:
+
+  - checked_bounds_t throws std::out_of_range. This is buffer_stream_t.
+  - unchecked_bounds_t performs no tests, so reading a field compiles to a
+    copy and a pointer increment. For trusted data whose size has already
+    been validated.
+  - assert_bounds_t asserts in debug builds and performs no tests when NDEBUG
+    is defined.
+
+  Bulk reads and writes of a given length (read(void *, size_t), write(const
+  void *, size_t), and strings) clamp to the remainder of the stream under
+  every policy.
+
+==============================================================================*/
+struct S_EXPORT checked_bounds_t
+{
+  static const bool enabled = true;
+  /** Throws std::out_of_range. */
+  static void fail(const char *what, ptrdiff_t offset);
+};
+
+
+struct unchecked_bounds_t
+{
+  static const bool enabled = false;
+  static inline void fail(const char *, ptrdiff_t) {}
+};
+
+
+struct assert_bounds_t
+{
+#ifdef NDEBUG
+  static const bool enabled = false;
+#else
+  static const bool enabled = true;
+#endif
+  static inline void fail(const char *what, ptrdiff_t offset)
+  {
+    (void)what;
+    (void)offset;
+    assert(!"buffer stream access out of range");
+  }
+};
+
+
+
 /**
   A class to read raw data from a block of memory. Includes methods to read
   null-terminated strings as well.
@@ -16,8 +71,12 @@ namespace snow {
   Read, seek, and so on are considered const operations as they don't modify the
   underlying buffer, allowing you to easily pass around a const reference to the
   buffer for reading, but not writing.
+
+  Bounds is one of the bounds policies above. Only those three are
+  instantiated by the library.
 */
-struct S_EXPORT buffer_stream_t
+template <typename Bounds>
+struct S_EXPORT basic_buffer_stream_t
 {
   /**
     Constant to indicate the bounds for a stream should be unchecked. Pass as
@@ -25,32 +84,104 @@ struct S_EXPORT buffer_stream_t
   */
   static const size_t unchecked = ~size_t(0);
 
-  buffer_stream_t() = delete;
+  basic_buffer_stream_t() = delete;
 
   /**
     Constructs a buffer stream starting at the given data pointer that spans
     length bytes.
   */
-  buffer_stream_t(void *data, size_t length);
+  basic_buffer_stream_t(void *data, size_t length);
+
+  /**
+    Constructs a stream over the same buffer and at the same position as a
+    stream with another bounds policy -- e.g., an unchecked stream over a
+    record whose length has already been checked.
+  */
+  template <typename OtherBounds>
+  explicit basic_buffer_stream_t(const basic_buffer_stream_t<OtherBounds> &other) :
+    base_(other.base_),
+    end_(other.end_),
+    offset_(other.offset_)
+  {
+    /* nop */
+  }
 
   /**
     Reads an object of type T from the stream. Recommended that specializations
     be written for non-POD/standard layout data.
 
-    The default implementation simply dereferences the current position in the
-    buffer as though it points to an object of type T.
+    The default implementation copies sizeof(T) bytes from the current position
+    in the buffer into suitably aligned storage and assigns that to the result,
+    so the stream position doesn't need to be aligned for T. The bytes are read
+    in host byte order -- use read_le or read_be for portable data.
+
+    Fails per the bounds policy if fewer than sizeof(T) bytes remain.
 
     @param result Where to store the result of the read.
   */
   template <typename T>
   S_HIDDEN size_t read(T &result) const
   {
-    const T *T_ptr = (const T *)offset_;
-    seek(tell() + sizeof(T));
-    result = *T_ptr;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    const char *src = offset_;
+    advance(sizeof(T));
+    std::memcpy(&storage, src, sizeof(T));
+    result = *reinterpret_cast<const T *>(&storage);
     return sizeof(T);
   }
 
+  /**
+    Reads an arithmetic or enum value stored in little or big endian order.
+    Fails per the bounds policy if fewer than sizeof(T) bytes remain.
+    @return sizeof(T).
+  */
+  template <typename T>
+  S_HIDDEN size_t read_order(T &result, byte_order_t order) const
+  {
+    const char *src = offset_;
+    advance(sizeof(T));
+    result = load_order<T>(src, order);
+    return sizeof(T);
+  }
+
+  template <typename T>
+  S_HIDDEN size_t read_le(T &result) const { return read_order(result, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN size_t read_be(T &result) const { return read_order(result, BIG_ENDIAN_ORDER); }
+
+  /**
+    Reads count objects of type T into data with a single copy, byte-swapping
+    each scalar if order isn't the host's (see load_array_order). Fails per
+    the bounds policy, reading nothing, if the stream is too short.
+    @return The number of bytes read.
+  */
+  template <typename T>
+  S_HIDDEN size_t read_array(T *data, size_t count, byte_order_t order = HOST_ORDER) const
+  {
+    if (Bounds::enabled && count > remainder() / sizeof(T)) {
+      Bounds::fail("Attempt to read array past end of stream", tell());
+      return 0;
+    }
+    const size_t length = count * sizeof(T);
+    load_array_order(data, offset_, count, order);
+    offset_ += length;
+    return length;
+  }
+
+  /**
+    Reads an unsigned LEB128 varint. Fails per the bounds policy if the stream
+    ends before the varint does or the varint is malformed.
+    @return The number of bytes read.
+  */
+  size_t read_varint(uint64_t &result) const;
+
+  /**
+    Reads a zigzag-encoded signed varint.
+    @see read_varint
+  */
+  size_t read_svarint(int64_t &result) const;
+
   /**
     Writes an object of type T to the stream. Recommended that specializations
     be written for non-POD/standard layout data (see string specialization).
@@ -68,6 +199,86 @@ struct S_EXPORT buffer_stream_t
     return write(&data, sizeof(data));
   }
 
+  /**
+    Writes an arithmetic or enum value in little or big endian order. Unlike
+    write(), nothing is written unless the whole value fits (if the bounds
+    policy checks at all).
+    @return sizeof(T), or 0 if there wasn't room for the value.
+  */
+  template <typename T>
+  S_HIDDEN size_t write_order(T data, byte_order_t order)
+  {
+    if (Bounds::enabled && remainder() < sizeof(T)) {
+      return 0;
+    }
+    store_order<T>(offset_, data, order);
+    offset_ += sizeof(T);
+    return sizeof(T);
+  }
+
+  template <typename T>
+  S_HIDDEN size_t write_le(T data) { return write_order(data, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN size_t write_be(T data) { return write_order(data, BIG_ENDIAN_ORDER); }
+
+  /**
+    Reads a null-terminated string as a view into the buffer, without copying
+    it, and advances past the null character. The view doesn't include the
+    null character and is only valid as long as the buffer is.
+
+    If the end of the stream is reached before a null character, the view
+    covers the remainder of the stream.
+
+    @return The number of bytes read, including the null character if found.
+  */
+  size_t read_string(string_ref_t &result) const;
+
+  /**
+    Reads up to count consecutive null-terminated strings as views into the
+    buffer (see read_string). Terminators are located a block at a time, so
+    this is much faster than calling read_string in a loop for tables of many
+    short strings.
+
+    @return The number of strings read. Less than count only if the end of the
+    stream was reached.
+  */
+  size_t read_strings(string_ref_t *results, size_t count) const;
+
+  /**
+    Writes count objects of type T with a single copy, byte-swapping each
+    scalar if order isn't the host's (see store_array_order). Nothing is
+    written unless the whole array fits (if the bounds policy checks at all).
+    @return The number of bytes written, or 0 if there wasn't room.
+  */
+  template <typename T>
+  S_HIDDEN size_t write_array(const T *data, size_t count, byte_order_t order = HOST_ORDER)
+  {
+    if (Bounds::enabled && count > remainder() / sizeof(T)) {
+      return 0;
+    }
+    const size_t length = count * sizeof(T);
+    store_array_order(offset_, data, count, order);
+    offset_ += length;
+    return length;
+  }
+
+  /**
+    Writes an unsigned LEB128 varint. Nothing is written unless the whole
+    varint fits.
+    @return The number of bytes written, or 0 if there wasn't room.
+  */
+  size_t write_varint(uint64_t value);
+
+  /**
+    Writes a zigzag-encoded signed varint.
+    @see write_varint
+  */
+  inline size_t write_svarint(int64_t value)
+  {
+    return write_varint(zigzag_encode(value));
+  }
+
   /**
     Returns whether or not there's more data in the buffer.
     @return False if at the end of the stream, true otherwise.
@@ -112,14 +323,22 @@ struct S_EXPORT buffer_stream_t
     Moves the buffer stream's current read/write position to the given offset
     relative to the start of the buffer.
 
-    If the new offset is out of range or at the end of the buffer, read and
-    write operations have undefined behavior.
+    Seeking out of range fails per the bounds policy. If the new offset is at
+    the end of the buffer, read and write operations have undefined behavior.
 
     @param  offset An offset relative to the start of the buffer. Must be
     within 0 and size().
     @return The buffer offset after seeking.
   */
-  ptrdiff_t seek(ptrdiff_t offset) const;
+  inline ptrdiff_t seek(ptrdiff_t offset) const
+  {
+    if (Bounds::enabled && (offset < 0 || offset > end_ - base_)) {
+      Bounds::fail("Attempt to seek to out of range offset", offset);
+      return tell();
+    }
+    offset_ = base_ + offset;
+    return tell();
+  }
 
   /**
     Writes length bytes from the provided data to the buffer stream.
@@ -165,7 +384,48 @@ struct S_EXPORT buffer_stream_t
   inline char *end() { return end_; }
   inline const char *end() const { return end_; }
 
+  /**
+    Writes a null-terminated string to the buffer. Returns the number of bytes
+    written, including the null character.
+
+    If the return is smaller than string.size() then the string will be
+    truncated to write some of the string and the null character. If only the
+    null character can be written, nothing will be written and the function
+    will return 0.
+
+    @param string The string to write to the stream.
+    @return The number of bytes writen to the stream, null character included.
+    May be less than the length of the string, though if nonzero, the string
+    written contains a null character.
+  */
+  size_t write(const string &string);
+
+  /**
+    Reads a null-terminated string from the buffer stream to the result string
+    and advances past it. Use read_string to avoid copying the string.
+
+    @param result The string to store the read string in.
+    @return The number of bytes read from the buffer, including any null
+    character if one was found. If the end of the stream was reached before
+    finding a null character, the remainder of the stream is stored in the
+    result string.
+  */
+  size_t read(string &result) const;
+
 private:
+  template <typename OtherBounds>
+  friend struct basic_buffer_stream_t;
+
+  // Advances past length bytes, checking bounds per the policy.
+  inline void advance(size_t length) const
+  {
+    if (Bounds::enabled && length > static_cast<size_t>(end_ - offset_)) {
+      Bounds::fail("Attempt to read past end of stream", tell());
+      return;
+    }
+    offset_ += length;
+  }
+
   // Base pointer. The start of the buffer.
   char *base_;
   // End pointer -- may point to invalid memory in unchecked buffers.
@@ -175,33 +435,17 @@ private:
 };
 
 
-/**
-  Writes a null-terminated string to the buffer. Returns the number of bytes
-  written, including the null character.
-
-  If the return is smaller than string.size() then the string will be truncated
-  to write some of the string and the null character. If only the null
-  character can be written, nothing will be written and the function will
-  return 0.
-
-  @param string The string to write to the stream.
-  @return The number of bytes writen to the stream, null character included.
-  May be less than the length of the string, though if nonzero, the string
-  written contains a null character.
-*/
-template <>
-S_EXPORT size_t buffer_stream_t::write(const string &string);
+extern template struct basic_buffer_stream_t<checked_bounds_t>;
+extern template struct basic_buffer_stream_t<unchecked_bounds_t>;
+extern template struct basic_buffer_stream_t<assert_bounds_t>;
 
-/**
-  Reads a string from the buffer stream to the result string.
 
-  @param result The string to store the read string in.
-  @return The number of bytes read from the buffer, including any null character
-  if one was found. If the end of the stream was reached before finding a null
-  character, the remainder of the stream is stored in the result string.
-*/
-template <>
-S_EXPORT size_t buffer_stream_t::read(string &result) const;
+/** The default, bounds-checked stream. */
+typedef basic_buffer_stream_t<checked_bounds_t> buffer_stream_t;
+/** A stream for trusted data that performs no bounds checks. */
+typedef basic_buffer_stream_t<unchecked_bounds_t> unchecked_buffer_stream_t;
+/** A stream that asserts its bounds in debug builds only. */
+typedef basic_buffer_stream_t<assert_bounds_t> debug_buffer_stream_t;
 
 
 } // namespace snow
@@ -0,0 +1,163 @@
+// buffer_writer.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__BUFFER_WRITER_HH__
+#define __SNOW_COMMON__BUFFER_WRITER_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <snow/data/endian.hh>
+#include <snow/data/varint.hh>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Growable output buffer. Unlike buffer_stream_t, writes never truncate: the
+  buffer's storage doubles as needed, so serializing into it doesn't require
+  sizing the buffer up front. Data is stored contiguously, so once written it
+  can be read back through a buffer_stream_t (see stream()).
+
+  Use write_le/write_be and write_varint for data that must be portable across
+  platforms. write() copies host-order bytes like buffer_stream_t::write.
+
+==============================================================================*/
+struct S_EXPORT buffer_writer_t
+{
+  /** Constructs an empty writer, optionally reserving initial_capacity bytes. */
+  buffer_writer_t(size_t initial_capacity = 0);
+  buffer_writer_t(const buffer_writer_t &other);
+  buffer_writer_t(buffer_writer_t &&other);
+  ~buffer_writer_t();
+
+  buffer_writer_t &operator = (const buffer_writer_t &other);
+  buffer_writer_t &operator = (buffer_writer_t &&other);
+
+  /**
+    Appends length bytes to the buffer.
+    @return length.
+  */
+  size_t write(const void *data, size_t length);
+
+  /**
+    Appends a null-terminated string to the buffer, in the same format as
+    buffer_stream_t::write(const string &).
+    @return The number of bytes written, including the null character.
+  */
+  size_t write(const string &string);
+
+  /**
+    Appends the host-order bytes of an object of type T. T must be trivially
+    copyable.
+    @return sizeof(T).
+  */
+  template <typename T>
+  S_HIDDEN size_t write(const T &data)
+  {
+    return write(&data, sizeof(data));
+  }
+
+  /** Appends an arithmetic or enum value in the given byte order. */
+  template <typename T>
+  S_HIDDEN size_t write_order(T data, byte_order_t order)
+  {
+    store_order<T>(append(sizeof(T)), data, order);
+    return sizeof(T);
+  }
+
+  template <typename T>
+  S_HIDDEN size_t write_le(T data) { return write_order(data, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN size_t write_be(T data) { return write_order(data, BIG_ENDIAN_ORDER); }
+
+  /**
+    Appends count objects of type T with a single copy, byte-swapping each
+    scalar if order isn't the host's (see store_array_order).
+    @return The number of bytes written.
+  */
+  template <typename T>
+  S_HIDDEN size_t write_array(const T *data, size_t count, byte_order_t order = HOST_ORDER)
+  {
+    if (count > SIZE_MAX / sizeof(T)) {
+      s_throw(std::length_error, "buffer_writer_t array size overflow");
+      return 0;
+    }
+    const size_t length = count * sizeof(T);
+    if (length) {
+      store_array_order(append(length), data, count, order);
+    }
+    return length;
+  }
+
+  /** Appends an unsigned LEB128 varint. Returns the number of bytes written. */
+  size_t write_varint(uint64_t value);
+
+  /** Appends a zigzag-encoded signed varint. */
+  inline size_t write_svarint(int64_t value)
+  {
+    return write_varint(zigzag_encode(value));
+  }
+
+  /**
+    Overwrites a previously written value at the given offset, e.g., to fill in
+    a length prefix once the length is known. Throws std::out_of_range if the
+    value would extend past size().
+  */
+  template <typename T>
+  S_HIDDEN void patch_order(size_t offset, T data, byte_order_t order)
+  {
+    check_patch(offset, sizeof(T));
+    store_order<T>(data_ + offset, data, order);
+  }
+
+  template <typename T>
+  S_HIDDEN void patch_le(size_t offset, T data) { patch_order(offset, data, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN void patch_be(size_t offset, T data) { patch_order(offset, data, BIG_ENDIAN_ORDER); }
+
+  /**
+    Grows the buffer by length bytes and returns a pointer to the new,
+    uninitialized bytes so they can be written in place. The pointer is
+    invalidated by the next write.
+  */
+  char *append(size_t length);
+
+  /** Ensures the buffer can hold at least capacity bytes without growing. */
+  void reserve(size_t capacity);
+  /** Discards the buffer's contents. Keeps its storage. */
+  inline void clear() { size_ = 0; }
+  /** Releases unused storage. */
+  void shrink_to_fit();
+
+  inline size_t size() const { return size_; }
+  inline size_t capacity() const { return capacity_; }
+  inline bool empty() const { return size_ == 0; }
+
+  inline char *data() { return data_; }
+  inline const char *data() const { return data_; }
+
+  /**
+    Returns a stream over the bytes written so far. The stream is invalidated
+    by any write that grows the buffer.
+  */
+  inline buffer_stream_t stream() { return buffer_stream_t(data_, size_); }
+
+  void swap(buffer_writer_t &other);
+
+private:
+  void check_patch(size_t offset, size_t length) const;
+
+  char *data_;
+  size_t size_;
+  size_t capacity_;
+};
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__BUFFER_WRITER_HH__ include guard */
@@ -0,0 +1,233 @@
+// chunker.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__CHUNKER_HH__
+#define __SNOW_COMMON__CHUNKER_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <cstdint>
+#include <cstring>
+
+
+/**
+  @file
+  @ingroup HashFunctions
+*/
+
+
+namespace snow {
+
+/**
+  @addtogroup HashFunction
+  @{
+*/
+
+
+/**
+  Digest identifying a chunk's contents, as produced by a chunker_t hash
+  function. Large enough for a SHA-256 digest; shorter digests leave the
+  remaining bytes zero.
+*/
+struct chunk_digest_t
+{
+  static const size_t SIZE = 32;
+
+  uint8_t bytes[SIZE];
+
+  inline bool operator == (const chunk_digest_t &other) const
+  {
+    return std::memcmp(bytes, other.bytes, SIZE) == 0;
+  }
+
+  inline bool operator != (const chunk_digest_t &other) const
+  {
+    return !(*this == other);
+  }
+
+  inline bool operator < (const chunk_digest_t &other) const
+  {
+    return std::memcmp(bytes, other.bytes, SIZE) < 0;
+  }
+};
+
+
+/**
+  A single content-defined chunk, as produced by snow::chunker_t.
+*/
+struct chunk_t
+{
+  /** The offset of the chunk relative to the start of the chunked data. */
+  size_t          offset;
+  /** The length of the chunk in bytes. */
+  size_t          length;
+  /**
+    The chunk's digest as produced by the chunker's hash function. All zero if
+    the chunker has no hash function.
+  */
+  chunk_digest_t  digest;
+};
+
+
+/**
+  Content-defined chunker using a gear rolling hash with normalized chunking
+  (i.e., FastCDC). Cuts a block of data into variable-size chunks whose
+  boundaries depend only on the bytes around them, so an insertion or deletion
+  in one part of the data only changes the chunks around the edit.
+
+  Boundaries are never placed before min_size bytes into a chunk and are
+  forced at max_size bytes. The average is rounded to a power of two. Below
+  the average, a boundary requires more hash bits to be zero; above it, fewer,
+  which keeps chunk sizes tightly grouped around the average.
+
+  Chunking is stateless with respect to the data, so a single chunker_t may be
+  shared between threads.
+
+  By default each chunk is identified by its SHA-256 digest, so chunks with
+  equal digests can be treated as equal for deduplication. Builds without
+  OpenSSL (HAS_SHA256 is 0) fall back to a 128-bit non-cryptographic hash
+  (MurmurHash3 x64_128): accidental collisions are still vanishingly rare,
+  but chunks crafted to collide are not, so compare contents before
+  deduplicating untrusted data in such builds.
+*/
+struct S_EXPORT chunker_t
+{
+  /** Hash function type used to hash chunks. Must fill in the whole digest. */
+  using hash_fn_t = void (*)(const char *data, size_t length, chunk_digest_t &digest);
+
+  /** Whether the default hash function is cryptographic (SHA-256). */
+  static const bool DEFAULT_HASH_IS_CRYPTOGRAPHIC = HAS_SHA256;
+
+  /** Default minimum chunk size. */
+  static const size_t DEFAULT_MIN_SIZE = 2048;
+  /** Default average chunk size. */
+  static const size_t DEFAULT_AVG_SIZE = 8192;
+  /** Default maximum chunk size. */
+  static const size_t DEFAULT_MAX_SIZE = 65536;
+
+  /**
+    Constructs a chunker with the given size bounds.
+
+    Throws std::invalid_argument if the sizes are not ordered min <= avg <= max
+    or if min_size is zero.
+
+    @param min_size  The minimum chunk size, except for the final chunk.
+    @param avg_size  The desired average chunk size. Rounded down to a power of
+    two.
+    @param max_size  The maximum chunk size.
+    @param hash      The hash function applied to each chunk. May be null, in
+    which case chunk digests are zero.
+  */
+  chunker_t(size_t min_size = DEFAULT_MIN_SIZE,
+            size_t avg_size = DEFAULT_AVG_SIZE,
+            size_t max_size = DEFAULT_MAX_SIZE,
+            hash_fn_t hash = &chunker_t::default_hash);
+
+  /**
+    Finds the length of the next chunk in the given data.
+
+    @param data   The data to search.
+    @param length The length of the data.
+    @return The length of the chunk starting at data. If length is smaller than
+    max_size() and no boundary is found, returns length.
+  */
+  size_t next_boundary(const char *data, size_t length) const;
+
+  /**
+    Cuts the given data into chunks, calling func with a const chunk_t & for
+    each one.
+
+    @param data   The data to chunk.
+    @param length The length of the data.
+    @param func   Called for each chunk in order.
+    @param final  Whether the data ends the input. If false, trailing data that
+    does not end at a boundary is not emitted and should be passed again with
+    the next block of input.
+    @return The number of bytes consumed by emitted chunks.
+  */
+  template <typename FN>
+  size_t each_chunk(const char *data, size_t length, FN &&func, bool final = true) const;
+
+  /**
+    Cuts the remainder of a buffer stream into chunks. The stream is advanced
+    past each emitted chunk. Chunk offsets are relative to the stream's base.
+    @see snow::chunker_t::each_chunk(const char *, size_t, FN &&, bool)
+  */
+  template <typename FN>
+  size_t each_chunk(const buffer_stream_t &stream, FN &&func, bool final = true) const;
+
+  inline size_t min_size() const { return min_size_; }
+  inline size_t avg_size() const { return avg_size_; }
+  inline size_t max_size() const { return max_size_; }
+  inline hash_fn_t hash_function() const { return hash_; }
+
+  /**
+    The default hash function: SHA-256 if HAS_SHA256, otherwise 128-bit
+    MurmurHash3.
+  */
+  static void default_hash(const char *data, size_t length, chunk_digest_t &digest);
+
+private:
+  inline chunk_digest_t hash_chunk(const char *data, size_t length) const
+  {
+    chunk_digest_t digest;
+    if (hash_) {
+      hash_(data, length, digest);
+    } else {
+      std::memset(digest.bytes, 0, chunk_digest_t::SIZE);
+    }
+    return digest;
+  }
+
+  size_t    min_size_;
+  size_t    avg_size_;
+  size_t    max_size_;
+  // Mask used before reaching avg_size_ (harder to match)
+  uint64_t  mask_small_;
+  // Mask used after reaching avg_size_ (easier to match)
+  uint64_t  mask_large_;
+  hash_fn_t hash_;
+};
+
+
+
+template <typename FN>
+size_t chunker_t::each_chunk(const char *data, size_t length, FN &&func, bool final) const
+{
+  size_t offset = 0;
+  while (offset < length) {
+    const size_t remaining = length - offset;
+    const size_t cut = next_boundary(data + offset, remaining);
+    if (cut == remaining && remaining < max_size_ && !final) {
+      break;
+    }
+    const chunk_t chunk = { offset, cut, hash_chunk(data + offset, cut) };
+    func(chunk);
+    offset += cut;
+  }
+  return offset;
+}
+
+
+
+template <typename FN>
+size_t chunker_t::each_chunk(const buffer_stream_t &stream, FN &&func, bool final) const
+{
+  const size_t base = static_cast<size_t>(stream.tell());
+  const size_t consumed = each_chunk(stream.pointer(), stream.remainder(),
+    [base, &func](const chunk_t &chunk) {
+      const chunk_t rebased = { chunk.offset + base, chunk.length, chunk.digest };
+      func(rebased);
+    }, final);
+  if (consumed) {
+    stream.skip(consumed);
+  }
+  return consumed;
+}
+
+
+/** @} */
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__CHUNKER_HH__ include guard */
@@ -0,0 +1,26 @@
+// crc32c.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__CRC32C_HH__
+#define __SNOW_COMMON__CRC32C_HH__
+
+#include <snow/config.hh>
+#include <cstdint>
+
+
+namespace snow {
+
+
+/*==============================================================================
+  crc32c
+
+    Computes the CRC-32C (Castagnoli) checksum of length bytes of data. To
+    checksum data in pieces, pass the result for the previous piece as crc.
+    Uses the SSE4.2 or ARMv8 CRC instructions when compiled with them, and a
+    slice-by-8 table otherwise.
+==============================================================================*/
+S_EXPORT uint32_t crc32c(const void *data, size_t length, uint32_t crc = 0);
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__CRC32C_HH__ include guard */
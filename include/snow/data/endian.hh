@@ -0,0 +1,209 @@
+// endian.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__ENDIAN_HH__
+#define __SNOW_COMMON__ENDIAN_HH__
+
+#include <snow/config.hh>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+
+namespace snow {
+
+
+/** Whether the host is little endian. */
+#define S_LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+/** Whether the host is big endian. */
+#define S_BIG_ENDIAN    (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+
+
+/** Byte order of serialized data. */
+enum byte_order_t : int
+{
+  LITTLE_ENDIAN_ORDER = 0,
+  BIG_ENDIAN_ORDER    = 1,
+#if S_BIG_ENDIAN
+  HOST_ORDER          = BIG_ENDIAN_ORDER,
+#else
+  HOST_ORDER          = LITTLE_ENDIAN_ORDER,
+#endif
+};
+
+
+/*==============================================================================
+  byte_swap
+
+    Reverses the bytes of an integer or floating point value. Floats are
+    swapped through an integer of the same size, never as a float, so no
+    signalling NaN is ever loaded.
+==============================================================================*/
+inline uint8_t  byte_swap(uint8_t value)  { return value; }
+inline uint16_t byte_swap(uint16_t value) { return __builtin_bswap16(value); }
+inline uint32_t byte_swap(uint32_t value) { return __builtin_bswap32(value); }
+inline uint64_t byte_swap(uint64_t value) { return __builtin_bswap64(value); }
+
+
+/**
+  Unsigned integer type with the same size as T, used to byte-swap T.
+*/
+template <size_t SIZE> struct swap_uint_t;
+template <> struct swap_uint_t<1> { using type = uint8_t; };
+template <> struct swap_uint_t<2> { using type = uint16_t; };
+template <> struct swap_uint_t<4> { using type = uint32_t; };
+template <> struct swap_uint_t<8> { using type = uint64_t; };
+
+
+/*==============================================================================
+  load / store
+
+    Reads or writes a value of arithmetic (or enum) type T at a possibly
+    unaligned address in the given byte order.
+==============================================================================*/
+template <typename T>
+inline T load_order(const void *src, byte_order_t order)
+{
+  static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                "load_order requires an arithmetic or enum type");
+  using uint_t = typename swap_uint_t<sizeof(T)>::type;
+  uint_t bits;
+  std::memcpy(&bits, src, sizeof(bits));
+  if (order != HOST_ORDER) {
+    bits = byte_swap(bits);
+  }
+  T result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+
+template <typename T>
+inline void store_order(void *dst, T value, byte_order_t order)
+{
+  static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                "store_order requires an arithmetic or enum type");
+  using uint_t = typename swap_uint_t<sizeof(T)>::type;
+  uint_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if (order != HOST_ORDER) {
+    bits = byte_swap(bits);
+  }
+  std::memcpy(dst, &bits, sizeof(bits));
+}
+
+
+template <typename T>
+inline T load_le(const void *src) { return load_order<T>(src, LITTLE_ENDIAN_ORDER); }
+
+template <typename T>
+inline T load_be(const void *src) { return load_order<T>(src, BIG_ENDIAN_ORDER); }
+
+template <typename T>
+inline void store_le(void *dst, T value) { store_order<T>(dst, value, LITTLE_ENDIAN_ORDER); }
+
+template <typename T>
+inline void store_be(void *dst, T value) { store_order<T>(dst, value, BIG_ENDIAN_ORDER); }
+
+
+
+/**
+  The scalar type whose bytes are swapped when an array of T is stored in a
+  foreign byte order. For arithmetic and enum types, this is T. For aggregates
+  of a single scalar type that declare a value_type (vec3_t<float>, mat4_t,
+  std::array, etc.), it's that value_type. Otherwise, it's void and T can only
+  be stored in host order. width is the size of the scalar type, or zero.
+
+  Specialize this for other aggregates of a single scalar type.
+*/
+template <typename T, typename = void>
+struct byte_order_scalar_t
+{
+  using type = void;
+  static const size_t width = 0;
+};
+
+template <typename T>
+struct byte_order_scalar_t<T, typename std::enable_if<
+  std::is_arithmetic<T>::value || std::is_enum<T>::value
+  >::type>
+{
+  using type = T;
+  static const size_t width = sizeof(T);
+};
+
+template <typename T>
+struct byte_order_scalar_t<T, typename std::enable_if<
+  std::is_class<T>::value &&
+  std::is_arithmetic<typename T::value_type>::value &&
+  sizeof(T) % sizeof(typename T::value_type) == 0
+  >::type>
+{
+  using type = typename T::value_type;
+  static const size_t width = sizeof(type);
+};
+
+
+
+/*==============================================================================
+  byte_swap_array
+
+    Copies count scalars of width bytes each (1, 2, 4, or 8) from src to dst,
+    reversing the bytes of each. src and dst may be the same pointer, but must
+    not otherwise overlap. Vectorized with SSE2 or NEON where available.
+==============================================================================*/
+S_EXPORT void byte_swap_array(void *dst, const void *src, size_t count, size_t width);
+
+
+
+/*==============================================================================
+  load_array_order / store_array_order
+
+    Copies count objects of type T to or from a possibly unaligned buffer in
+    the given byte order. In host order, this is a single memcpy. T must be
+    trivially copyable. Copying a T without a byte_order_scalar_t in a foreign
+    byte order throws std::invalid_argument.
+==============================================================================*/
+template <typename T>
+inline void store_array_order(void *dst, const T *src, size_t count, byte_order_t order)
+{
+  const size_t width = byte_order_scalar_t<T>::width;
+  static_assert(std::is_trivially_copyable<T>::value,
+                "store_array_order requires a trivially copyable type");
+  if (count == 0) {
+    return;
+  } else if (order == HOST_ORDER || width == 1) {
+    std::memcpy(dst, src, count * sizeof(T));
+  } else {
+    if (width == 0) {
+      s_throw(std::invalid_argument, "store_array_order: type has no byte_order_scalar_t");
+      return;
+    }
+    byte_swap_array(dst, src, count * (sizeof(T) / width), width);
+  }
+}
+
+
+template <typename T>
+inline void load_array_order(T *dst, const void *src, size_t count, byte_order_t order)
+{
+  const size_t width = byte_order_scalar_t<T>::width;
+  static_assert(std::is_trivially_copyable<T>::value,
+                "load_array_order requires a trivially copyable type");
+  if (count == 0) {
+    return;
+  } else if (order == HOST_ORDER || width == 1) {
+    std::memcpy(dst, src, count * sizeof(T));
+  } else {
+    if (width == 0) {
+      s_throw(std::invalid_argument, "load_array_order: type has no byte_order_scalar_t");
+      return;
+    }
+    byte_swap_array(dst, src, count * (sizeof(T) / width), width);
+  }
+}
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__ENDIAN_HH__ include guard */
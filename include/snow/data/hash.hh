@@ -68,6 +68,129 @@ S_EXPORT uint64_t hash64(const char *str, const size_t length,
                 uint64_t seed = DEFAULT_HASH_SEED_64);
 
 
+
+/** Single xor-shift step of snow::hash_mix64. */
+constexpr uint64_t hash_mix64_step(uint64_t value)
+{
+  return value ^ (value >> 33);
+}
+
+/**
+  Mixes the bits of a 64-bit integer so that every input bit affects every
+  output bit (the MurmurHash3 finalizer). Cheap enough to hash integers and
+  pointers directly, and useful to finish off a weaker hash.
+*/
+constexpr uint64_t hash_mix64(uint64_t value)
+{
+  return hash_mix64_step(hash_mix64_step(hash_mix64_step(value)
+    * 0xFF51AFD7ED558CCDULL) * 0xC4CEB9FE1A85EC53ULL);
+}
+
+
+
+/**
+  Returns the rotation applied to the hash state after mixing in a character.
+  Always in the range [0, 15]. Shared by hash32 and hash64.
+*/
+constexpr uint32_t hash_char_shift(uint32_t ch)
+{
+  return (((ch & 0x9) | ((ch & 0x10) >> 2) | ((ch & 0x40) >> 5)) ^
+    ((ch & 0xA) >> 5)) | ((ch & 0x2) << 2) | ((ch & 0x4) >> 1);
+}
+
+/** Rotates a 32-bit value left by shift bits, where shift < 32. */
+constexpr uint32_t hash_rotl32(uint32_t value, uint32_t shift)
+{
+  return shift ? ((value << shift) | (value >> (32 - shift))) : value;
+}
+
+/** Rotates a 64-bit value left by shift bits, where shift < 64. */
+constexpr uint64_t hash_rotl64(uint64_t value, uint64_t shift)
+{
+  return shift ? ((value << shift) | (value >> (64 - shift))) : value;
+}
+
+/**
+  Mixes a single character into a snow::hash32 state. The character must be
+  converted from char as-is (i.e., sign-extended where char is signed) to match
+  snow::hash32.
+  @param hash  The current hash state.
+  @param ch    The character at index.
+  @param index The character's index in the input.
+*/
+constexpr uint32_t hash32_step(uint32_t hash, uint32_t ch, uint32_t index)
+{
+  return hash_rotl32(hash * 439U + ch * 23U + (index + 257U), hash_char_shift(ch));
+}
+
+/**
+  Mixes a single character into a snow::hash64 state.
+  @see snow::hash32_step
+*/
+constexpr uint64_t hash64_step(uint64_t hash, uint64_t ch, uint64_t index)
+{
+  return hash_rotl64(hash * 5741U + ch * 23U + (index + 257U), hash_char_shift(uint32_t(ch)));
+}
+
+/**
+  Compile-time equivalent of snow::hash32(const char *, const size_t, uint32_t).
+  Produces the same hash as the runtime function for the same input.
+
+  Evaluated recursively, one level per character, so inputs longer than the
+  compiler's constexpr depth limit (512 by default in GCC and Clang) can't be
+  hashed at compile time.
+
+  @param index Index of the next character to hash. Used for recursion.
+*/
+constexpr uint32_t const_hash32(const char *str, const size_t length,
+                                uint32_t seed = DEFAULT_HASH_SEED_32,
+                                const size_t index = 0)
+{
+  return index < length
+    ? const_hash32(str, length,
+        hash32_step(seed, static_cast<uint32_t>(str[index]), static_cast<uint32_t>(index)),
+        index + 1)
+    : seed;
+}
+
+/**
+  Compile-time equivalent of snow::hash64(const char *, const size_t, uint64_t).
+  @see snow::const_hash32
+*/
+constexpr uint64_t const_hash64(const char *str, const size_t length,
+                                uint64_t seed = DEFAULT_HASH_SEED_64,
+                                const size_t index = 0)
+{
+  return index < length
+    ? const_hash64(str, length,
+        hash64_step(seed, static_cast<uint64_t>(str[index]), index),
+        index + 1)
+    : seed;
+}
+
+
+/**
+  Hash string literals. For example, `"position"_h32` is a compile-time
+  constant equal to `hash32("position")` and may be used as a case label.
+  Pull in with `using namespace snow::hash_literals;`.
+*/
+inline namespace literals {
+inline namespace hash_literals {
+
+constexpr uint32_t operator "" _h32(const char *str, size_t length)
+{
+  return const_hash32(str, length);
+}
+
+constexpr uint64_t operator "" _h64(const char *str, size_t length)
+{
+  return const_hash64(str, length);
+}
+
+} // namespace hash_literals
+} // namespace literals
+
+
 /** @} */
 
 
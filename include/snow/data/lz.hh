@@ -0,0 +1,273 @@
+// lz.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__LZ_HH__
+#define __SNOW_COMMON__LZ_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <snow/data/buffer_writer.hh>
+#include <snow/data/endian.hh>
+#include <snow/data/varint.hh>
+#include <functional>
+#include <vector>
+
+
+namespace snow {
+
+
+/** Returned by lz_decompress for malformed input. */
+const size_t LZ_ERROR = ~size_t(0);
+
+/** Smallest and largest block sizes allowed in a frame. */
+const size_t LZ_MIN_BLOCK_SIZE = 4096;
+const size_t LZ_MAX_BLOCK_SIZE = 4 * 1024 * 1024;
+const size_t LZ_DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+
+/*==============================================================================
+  lz_compress_bound
+
+    Returns the most bytes lz_compress can produce for length bytes of input.
+==============================================================================*/
+constexpr size_t lz_compress_bound(size_t length)
+{
+  return length + length / 255 + 16;
+}
+
+
+
+/*==============================================================================
+  lz_compress
+
+    Compresses a block of data with a fast LZ77 codec (LZ4's block format:
+    greedy hash-chain-free matching, 64KB window, byte-aligned tokens). Returns
+    the compressed size, or zero if it wouldn't fit in capacity bytes -- a
+    capacity of lz_compress_bound(length) always suffices.
+==============================================================================*/
+S_EXPORT size_t lz_compress(const void *src, size_t length, void *dst, size_t capacity);
+
+
+
+/*==============================================================================
+  lz_decompress
+
+    Decompresses a block produced by lz_compress into dst. Safe to use on
+    untrusted input: never reads or writes out of bounds. Returns the
+    decompressed size, or LZ_ERROR if the input is malformed or doesn't fit in
+    capacity bytes.
+==============================================================================*/
+S_EXPORT size_t lz_decompress(const void *src, size_t length, void *dst, size_t capacity);
+
+
+
+/*==============================================================================
+
+  Frame format
+
+  A frame is a header followed by independently compressed blocks, so blocks
+  can be decompressed in any order or in parallel (see lz_frame_blocks).
+
+    header:  u32 magic 'SLZF', u8 version (1), u8 log2(block size), u16 zero
+    block:   u32 packed size (bit 31 set if stored uncompressed),
+             u32 raw size, packed bytes
+    end:     u32 zero
+
+  All integers are little endian.
+
+==============================================================================*/
+
+/** Describes one block of a frame. */
+struct lz_block_t
+{
+  /** Offset of the block's packed bytes from the start of the frame. */
+  size_t  offset;
+  size_t  packed_size;
+  /** Offset of the block's data in the decompressed output. */
+  size_t  raw_offset;
+  size_t  raw_size;
+  bool    stored;
+};
+
+
+/**
+  Reads the block table of a frame without decompressing anything. Returns
+  false if the frame is malformed or truncated.
+*/
+S_EXPORT bool lz_frame_blocks(const buffer_stream_t &frame, std::vector<lz_block_t> &blocks,
+                              size_t *raw_size = nullptr);
+
+/**
+  Decompresses a single block of a frame to dst, which must have room for
+  block.raw_size bytes. Returns false if the block is malformed.
+*/
+S_EXPORT bool lz_decompress_block(const char *frame, const lz_block_t &block, char *dst);
+
+/** Compresses length bytes into a complete frame appended to out. */
+S_EXPORT size_t lz_compress_frame(const void *src, size_t length, buffer_writer_t &out,
+                                  size_t block_size = LZ_DEFAULT_BLOCK_SIZE);
+
+/**
+  Decompresses a complete frame, appending the result to out. Throws
+  std::runtime_error if the frame is malformed.
+*/
+S_EXPORT size_t lz_decompress_frame(const buffer_stream_t &frame, buffer_writer_t &out);
+
+
+
+/*==============================================================================
+
+  Streaming frame writer. Data written to it is buffered one block at a time;
+  each full block is compressed and handed to a sink (e.g., a file or socket
+  write) before the next is started, so neither the whole uncompressed nor the
+  whole compressed data ever needs to be held in memory.
+
+  finish() writes the last block and the end marker, and must be called to
+  complete the frame. The destructor doesn't call it, since the sink may throw
+  (or already have thrown); a writer destroyed without finishing leaves a
+  frame with no end marker, which readers reject as truncated.
+
+==============================================================================*/
+struct S_EXPORT lz_frame_writer_t
+{
+  /** Receives each compressed chunk of the frame in order. */
+  typedef std::function<void(const char *data, size_t length)> sink_t;
+
+  lz_frame_writer_t(sink_t sink, size_t block_size = LZ_DEFAULT_BLOCK_SIZE);
+  /** Constructs a writer that appends the frame to out. */
+  lz_frame_writer_t(buffer_writer_t &out, size_t block_size = LZ_DEFAULT_BLOCK_SIZE);
+
+  lz_frame_writer_t(const lz_frame_writer_t &) = delete;
+  lz_frame_writer_t &operator = (const lz_frame_writer_t &) = delete;
+
+  /** Writes length bytes of uncompressed data. @return length. */
+  size_t write(const void *data, size_t length);
+
+  /** Writes the host-order bytes of a trivially copyable T. */
+  template <typename T>
+  S_HIDDEN size_t write(const T &data)
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "lz_frame_writer_t::write requires a trivially copyable type");
+    return write(static_cast<const void *>(&data), sizeof(data));
+  }
+
+  template <typename T>
+  S_HIDDEN size_t write_order(T data, byte_order_t order)
+  {
+    char bytes[sizeof(T)];
+    store_order<T>(bytes, data, order);
+    return write(static_cast<const void *>(bytes), sizeof(bytes));
+  }
+
+  template <typename T>
+  S_HIDDEN size_t write_le(T data) { return write_order(data, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN size_t write_be(T data) { return write_order(data, BIG_ENDIAN_ORDER); }
+
+  inline size_t write_varint(uint64_t value)
+  {
+    char encoded[VARINT_MAX_BYTES];
+    return write(static_cast<const void *>(encoded), encode_varint(value, encoded));
+  }
+
+  inline size_t write_svarint(int64_t value) { return write_varint(zigzag_encode(value)); }
+
+  /** Writes the last block and end marker. Further writes are errors. */
+  void finish();
+
+  /** Total uncompressed bytes written. */
+  inline uint64_t raw_size() const { return raw_size_; }
+  /** Total frame bytes passed to the sink so far. */
+  inline uint64_t packed_size() const { return packed_size_; }
+
+private:
+  void write_header();
+  void flush_block();
+  void emit(const char *data, size_t length);
+
+  sink_t            sink_;
+  size_t            block_size_;
+  unsigned          block_log2_;
+  std::vector<char> block_;
+  size_t            block_used_;
+  std::vector<char> packed_;
+  uint64_t          raw_size_;
+  uint64_t          packed_size_;
+  bool              finished_;
+};
+
+
+
+/*==============================================================================
+
+  Streaming frame reader over a frame in memory (e.g., a mapped file).
+  Decompresses one block at a time into an internal buffer, so only a single
+  block is ever held uncompressed.
+
+  Reads past the end of the frame throw std::out_of_range. A malformed frame
+  throws std::runtime_error. Like buffer_stream_t, reading is const.
+
+==============================================================================*/
+struct S_EXPORT lz_frame_reader_t
+{
+  /**
+    Constructs a reader over the frame at the stream's current position. The
+    reader keeps its own copy of the stream, so the stream passed in isn't
+    advanced. Throws std::runtime_error if the frame header is invalid.
+  */
+  lz_frame_reader_t(const buffer_stream_t &frame);
+
+  /** Reads length bytes into data (or skips them if data is null). */
+  size_t read(void *data, size_t length) const;
+
+  inline size_t skip(size_t length) const { return read(nullptr, length); }
+
+  template <typename T>
+  S_HIDDEN size_t read(T &result) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "lz_frame_reader_t::read requires a trivially copyable type");
+    return read(static_cast<void *>(&result), sizeof(T));
+  }
+
+  template <typename T>
+  S_HIDDEN size_t read_order(T &result, byte_order_t order) const
+  {
+    char bytes[sizeof(T)];
+    read(static_cast<void *>(bytes), sizeof(bytes));
+    result = load_order<T>(bytes, order);
+    return sizeof(T);
+  }
+
+  template <typename T>
+  S_HIDDEN size_t read_le(T &result) const { return read_order(result, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN size_t read_be(T &result) const { return read_order(result, BIG_ENDIAN_ORDER); }
+
+  size_t read_varint(uint64_t &result) const;
+  size_t read_svarint(int64_t &result) const;
+
+  /** Whether any uncompressed data remains. May decompress the next block. */
+  bool more() const;
+
+  /** Uncompressed bytes read so far. */
+  inline uint64_t tell() const { return consumed_ + block_pos_; }
+
+private:
+  bool next_block() const;
+
+  buffer_stream_t           frame_;
+  size_t                    block_size_;
+  mutable std::vector<char> block_;
+  mutable size_t            block_pos_;
+  mutable size_t            block_len_;
+  mutable uint64_t          consumed_;
+  mutable bool              at_end_;
+};
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__LZ_HH__ include guard */
@@ -0,0 +1,141 @@
+// mapped_file.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__MAPPED_FILE_HH__
+#define __SNOW_COMMON__MAPPED_FILE_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+
+#if !S_PLATFORM_WINDOWS
+
+namespace snow {
+
+
+enum mapped_file_mode_t : unsigned
+{
+  /** Maps an existing file read-only. */
+  MAP_FILE_READ     = 0,
+  /** Maps an existing file for reading and writing. Writes go to the file. */
+  MAP_FILE_WRITE    = 1 << 0,
+  /** With MAP_FILE_WRITE, creates the file if it doesn't exist. */
+  MAP_FILE_CREATE   = 1 << 1,
+  /** With MAP_FILE_WRITE, truncates the file to zero bytes when opened. */
+  MAP_FILE_TRUNCATE = 1 << 2,
+  /**
+    Requests huge pages for the mapping (see MAP_ADVISE_HUGEPAGE) whenever it
+    is mapped or remapped. Ignored where unsupported.
+  */
+  MAP_FILE_HUGEPAGE = 1 << 3,
+};
+
+
+/** Access pattern hints for mapped_file_t::advise. */
+enum mapped_file_advice_t : int
+{
+  MAP_ADVISE_NORMAL,
+  /** Pages will be read in order -- read ahead aggressively. */
+  MAP_ADVISE_SEQUENTIAL,
+  /** Pages will be read in no particular order -- don't read ahead. */
+  MAP_ADVISE_RANDOM,
+  /** Pages will be needed soon -- start reading them in. */
+  MAP_ADVISE_WILLNEED,
+  /** Pages won't be needed soon -- they may be dropped from memory. */
+  MAP_ADVISE_DONTNEED,
+  /**
+    Back the mapping with transparent huge pages where the kernel and
+    filesystem support it. Reduces TLB misses for large, hot mappings.
+  */
+  MAP_ADVISE_HUGEPAGE,
+};
+
+
+/*==============================================================================
+
+  A file mapped into memory. Reading through the mapping avoids copying the
+  file into a heap buffer, pages are loaded on demand, and read-only mappings
+  are shared through the page cache with other processes mapping the same
+  file.
+
+  Writable mappings are shared, so writes reach the file (flush() forces them
+  to disk). Writers can change the file's size with resize(), which remaps the
+  file and so invalidates pointers and streams previously obtained from it.
+
+  POSIX only.
+
+==============================================================================*/
+struct S_EXPORT mapped_file_t
+{
+  /** Constructs a closed file. */
+  mapped_file_t();
+  mapped_file_t(mapped_file_t &&other);
+  mapped_file_t &operator = (mapped_file_t &&other);
+  ~mapped_file_t();
+
+  mapped_file_t(const mapped_file_t &) = delete;
+  mapped_file_t &operator = (const mapped_file_t &) = delete;
+
+  /**
+    Opens and maps the file at path, closing any file already open. Returns
+    false and sets errno on failure.
+    @param mode A combination of mapped_file_mode_t flags.
+  */
+  bool open(const string &path, unsigned mode = MAP_FILE_READ);
+
+  /** Unmaps and closes the file. Does not flush writes. */
+  void close();
+
+  inline bool is_open() const { return fd_ != -1; }
+  inline bool writable() const { return (mode_ & MAP_FILE_WRITE) != 0; }
+
+  /** Size of the file in bytes. */
+  inline size_t size() const { return size_; }
+
+  /** Pointer to the mapped file, or null if the file is empty or closed. */
+  inline char *data() { return data_; }
+  inline const char *data() const { return data_; }
+
+  /**
+    Returns a stream over the whole file. For read-only files, only the
+    stream's read operations may be used.
+  */
+  buffer_stream_t stream();
+  const buffer_stream_t stream() const;
+
+  /**
+    Changes the size of a writable file and remaps it. New bytes read as zero.
+    Invalidates pointers into the previous mapping. Returns false and sets
+    errno on failure, leaving the mapping unchanged.
+  */
+  bool resize(size_t new_size);
+
+  /**
+    Writes modified pages in [offset, offset + length) back to the file. If
+    async is true, only schedules the writes. Returns false and sets errno on
+    failure.
+  */
+  bool flush(bool async = false, size_t offset = 0, size_t length = SIZE_MAX);
+
+  /**
+    Gives the kernel an access pattern hint for [offset, offset + length).
+    offset is rounded down to a page boundary. Hints unsupported by the
+    platform return false with errno set to EINVAL.
+  */
+  bool advise(mapped_file_advice_t advice, size_t offset = 0, size_t length = SIZE_MAX);
+
+private:
+  bool map(size_t length);
+  void unmap();
+  bool page_range(size_t &offset, size_t &length) const;
+
+  int         fd_;
+  unsigned    mode_;
+  char       *data_;
+  size_t      size_;
+};
+
+
+} // namespace snow
+
+#endif /* !S_PLATFORM_WINDOWS */
+
+#endif /* end __SNOW_COMMON__MAPPED_FILE_HH__ include guard */
@@ -0,0 +1,220 @@
+// record_log.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__RECORD_LOG_HH__
+#define __SNOW_COMMON__RECORD_LOG_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_writer.hh>
+#include <snow/data/mapped_file.hh>
+#include <snow/string/string_ref.hh>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#if !S_PLATFORM_WINDOWS
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Record log format
+
+  A log is a directory of segment files named by the sequence number of their
+  first record as 16 hex digits followed by ".wal" (e.g., 000000000000002a.wal).
+  Each segment is a 16-byte header followed by frames:
+
+    header:  u32 magic 'SWAL', u16 version (1), u16 zero, u64 first sequence
+    frame:   u32 length, u32 crc32c(length bytes + payload), payload
+
+  All integers are little endian. A frame whose length or checksum is wrong,
+  or that runs past the end of its segment, ends the segment: it's the torn
+  tail of a write that never completed.
+
+==============================================================================*/
+
+/** Default size at which record_log_t starts a new segment. */
+const size_t RECORD_LOG_SEGMENT_SIZE = 64 * 1024 * 1024;
+/** Default number of buffered bytes at which appends are written out. */
+const size_t RECORD_LOG_BATCH_SIZE = 1024 * 1024;
+/** Largest payload a single record may have. */
+const size_t RECORD_LOG_MAX_RECORD = 0x7FFFFFFF;
+
+
+
+/*==============================================================================
+
+  An append-only log of records, for persisting event streams and the like.
+
+  append() copies a record into an in-memory batch and returns its sequence
+  number; it doesn't touch the file until the batch reaches batch_size bytes.
+  commit() makes every record up to a sequence number durable. Commits group:
+  while one thread is writing and syncing a batch, others append to the next
+  batch and wait, and the next thread to commit writes and syncs all of their
+  records with a single write and fdatasync. Disk throughput, not
+  per-record syscalls, bounds the log.
+
+  Once the current segment reaches segment_size, the next batch starts a new
+  segment, so a segment can exceed segment_size by up to one batch.
+
+  Opening an existing log recovers it: a torn frame at the end of the last
+  segment (from a crash mid-write) is truncated away and appending resumes
+  after the last intact record.
+
+  append() and commit() may be called from any thread. If a write or sync
+  fails, the log stops accepting records and failed() returns true, since
+  the state of the file is no longer known.
+
+  POSIX only.
+
+==============================================================================*/
+struct S_EXPORT record_log_t
+{
+  record_log_t();
+  /** Commits outstanding records and closes the log. */
+  ~record_log_t();
+
+  record_log_t(const record_log_t &) = delete;
+  record_log_t &operator = (const record_log_t &) = delete;
+
+  /**
+    Opens or creates the log in directory, which must exist. Returns false and
+    sets errno on failure.
+    @param sync If false, commit() writes records to the file but doesn't
+    fdatasync them -- they survive a process crash but not a system crash.
+  */
+  bool open(const string &directory,
+            size_t segment_size = RECORD_LOG_SEGMENT_SIZE,
+            size_t batch_size = RECORD_LOG_BATCH_SIZE,
+            bool sync = true);
+
+  /** Commits all records and closes the log. Returns false if the commit fails. */
+  bool close();
+
+  inline bool is_open() const { return open_; }
+
+  /**
+    Appends a record. Throws std::length_error if length exceeds
+    RECORD_LOG_MAX_RECORD and std::runtime_error if the log has failed.
+    @return The record's sequence number.
+  */
+  uint64_t append(const void *data, size_t length);
+
+  inline uint64_t append(const string_ref_t &record)
+  {
+    return append(record.data(), record.size());
+  }
+
+  inline uint64_t append(const buffer_writer_t &record)
+  {
+    return append(record.data(), record.size());
+  }
+
+  /**
+    Blocks until the record with sequence number seq and every record before
+    it is durable. Returns false, with errno set, if the log has failed.
+  */
+  bool commit(uint64_t seq);
+
+  /** Commits every record appended so far. */
+  bool commit();
+
+  /** Sequence number the next appended record will get. */
+  uint64_t next_seq() const;
+
+  /** Number of records known to be durable (or written, if sync is off). */
+  uint64_t committed() const;
+
+  bool failed() const;
+
+private:
+  bool write_batch(std::unique_lock<std::mutex> &lock, bool sync);
+  bool rotate(uint64_t first_seq);
+  int open_segment(uint64_t first_seq);
+
+  string                    directory_;
+  size_t                    segment_size_;
+  size_t                    batch_size_;
+  bool                      sync_;
+
+  mutable std::mutex        lock_;
+  std::condition_variable   cond_;
+  // Records appended but not yet handed to a writer.
+  buffer_writer_t           pending_;
+  uint64_t                  pending_first_;
+  uint64_t                  next_seq_;
+  // Records written to the file / made durable.
+  uint64_t                  written_;
+  uint64_t                  durable_;
+  bool                      open_;
+  bool                      writing_;
+  bool                      failed_;
+  int                       error_;
+
+  // Only touched by the thread holding writing_ (or with no other threads).
+  int                       fd_;
+  size_t                    segment_bytes_;
+  buffer_writer_t           batch_;
+};
+
+
+
+/*==============================================================================
+
+  Reads the records of a log in order through memory-mapped segments, without
+  copying them. Corrupt or torn frames end their segment; if a later segment
+  exists, reading continues there and damaged() becomes true.
+
+  A reader sees the segments and sizes present when each segment is mapped,
+  so it can read a log that is still being written to, up to that point. Not
+  thread-safe.
+
+  POSIX only.
+
+==============================================================================*/
+struct S_EXPORT record_log_reader_t
+{
+  record_log_reader_t();
+
+  record_log_reader_t(const record_log_reader_t &) = delete;
+  record_log_reader_t &operator = (const record_log_reader_t &) = delete;
+
+  /**
+    Opens the log in directory and positions the reader at the first record
+    with a sequence number of at least from_seq. Returns false and sets errno
+    if the directory can't be read.
+  */
+  bool open(const string &directory, uint64_t from_seq = 0);
+
+  void close();
+
+  /**
+    Reads the next record. The record points into the mapped segment and is
+    valid until the reader moves to another segment or is closed. Returns
+    false at the end of the log.
+    @param seq If not null, receives the record's sequence number.
+  */
+  bool next(string_ref_t &record, uint64_t *seq = nullptr);
+
+  /** Whether any corrupt data was skipped. */
+  inline bool damaged() const { return damaged_; }
+
+private:
+  bool open_segment(size_t index);
+
+  string                    directory_;
+  std::vector<uint64_t>     segments_;
+  size_t                    segment_index_;
+  mapped_file_t             file_;
+  size_t                    offset_;
+  uint64_t                  seq_;
+  uint64_t                  from_seq_;
+  bool                      damaged_;
+};
+
+
+} // namespace snow
+
+#endif /* !S_PLATFORM_WINDOWS */
+
+#endif /* end __SNOW_COMMON__RECORD_LOG_HH__ include guard */
@@ -0,0 +1,240 @@
+// segment_list.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__SEGMENT_LIST_HH__
+#define __SNOW_COMMON__SEGMENT_LIST_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <snow/data/buffer_writer.hh>
+#include <snow/data/endian.hh>
+#include <snow/data/varint.hh>
+#include <snow/string/string_ref.hh>
+#include <memory>
+#include <vector>
+
+#if !S_PLATFORM_WINDOWS
+#include <sys/types.h>
+#include <sys/uio.h>
+#endif
+
+
+namespace snow {
+
+
+#if S_PLATFORM_WINDOWS
+/** Mirrors POSIX struct iovec where it isn't available. */
+struct iovec
+{
+  void   *iov_base;
+  size_t  iov_len;
+};
+#endif
+
+
+/*==============================================================================
+
+  List of non-contiguous memory regions (headers, payload views, trailers)
+  that make up a single message. Regions are referenced, not copied, so they
+  must outlive the list or at least the flush -- use append_copy for small
+  temporaries such as length prefixes built on the stack.
+
+  The list is stored as an array of iovecs so it can be flushed with a single
+  writev (see write_to) instead of coalescing the message into one buffer.
+
+==============================================================================*/
+struct S_EXPORT segment_list_t
+{
+  segment_list_t();
+  segment_list_t(segment_list_t &&other) = default;
+  segment_list_t &operator = (segment_list_t &&other) = default;
+
+  segment_list_t(const segment_list_t &) = delete;
+  segment_list_t &operator = (const segment_list_t &) = delete;
+
+  /** Appends a reference to length bytes at data. Empty regions are ignored. */
+  void append(const void *data, size_t length);
+  /** Appends a reference to the bytes of a string. */
+  inline void append(const string_ref_t &str) { append(str.data(), str.size()); }
+  /** Appends a reference to the bytes written to a writer so far. */
+  inline void append(const buffer_writer_t &writer) { append(writer.data(), writer.size()); }
+  /**
+    Appends a reference to the bytes of a stream between its base and current
+    position -- i.e., the bytes written to it so far.
+  */
+  inline void append(const buffer_stream_t &stream)
+  {
+    append(stream.base(), static_cast<size_t>(stream.tell()));
+  }
+
+  /**
+    Copies length bytes into storage owned by the list and appends them.
+    Adjacent copies are merged into a single segment where possible.
+  */
+  void append_copy(const void *data, size_t length);
+
+  /** Copies an arithmetic value into the list in the given byte order. */
+  template <typename T>
+  S_HIDDEN void append_order(T value, byte_order_t order)
+  {
+    char bytes[sizeof(T)];
+    store_order<T>(bytes, value, order);
+    append_copy(bytes, sizeof(bytes));
+  }
+
+  template <typename T>
+  S_HIDDEN void append_le(T value) { append_order(value, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN void append_be(T value) { append_order(value, BIG_ENDIAN_ORDER); }
+
+  /** Copies an unsigned LEB128 varint into the list. */
+  void append_varint(uint64_t value);
+
+  /**
+    Drops length bytes from the front of the list, e.g., after a partial
+    write. Consuming more than size() bytes empties the list.
+  */
+  void consume(size_t length);
+
+  /** Empties the list and releases copied data. */
+  void clear();
+
+  /** Total number of bytes in the list. */
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+
+  inline size_t segment_count() const { return segments_.size() - first_; }
+  inline const struct iovec *segments() const { return segments_.data() + first_; }
+
+  /**
+    Copies the whole list into a contiguous buffer of at least size() bytes.
+    Returns the number of bytes copied.
+  */
+  size_t gather(void *out) const;
+
+#if !S_PLATFORM_WINDOWS
+  /**
+    Writes as much of the list as possible to fd using writev, in batches of
+    at most IOV_MAX segments, retrying on EINTR and partial writes. Bytes
+    written are consumed from the list, so on a non-blocking descriptor this
+    may be called again once the descriptor is writable to continue.
+
+    @return The number of bytes written, or -1 if an error (including EAGAIN)
+    occurred before anything could be written, in which case errno is set.
+  */
+  ssize_t write_to(int fd);
+#endif
+
+private:
+  static const size_t COPY_BLOCK_SIZE = 4096;
+
+  std::vector<struct iovec> segments_;
+  // Index of the first unconsumed segment.
+  size_t first_;
+  size_t size_;
+  // Storage for append_copy.
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *block_ptr_;
+  size_t block_remaining_;
+};
+
+
+
+/*==============================================================================
+
+  Reads from a sequence of iovec segments as though they were one stream.
+  Reads that straddle a segment boundary are copied into the destination
+  piecewise. Use contiguous() to get a direct pointer when the bytes
+  requested lie in a single segment.
+
+  Like buffer_stream_t, reading is const and reads past the end throw
+  std::out_of_range. The segments must outlive the reader.
+
+==============================================================================*/
+struct S_EXPORT segment_reader_t
+{
+  segment_reader_t(const struct iovec *segments, size_t count);
+  segment_reader_t(const segment_list_t &list);
+
+  /**
+    Reads length bytes into data (or skips them if data is null). Throws
+    std::out_of_range, reading nothing, if fewer than length bytes remain.
+    @return length.
+  */
+  size_t read(void *data, size_t length) const;
+
+  inline size_t skip(size_t length) const { return read(nullptr, length); }
+
+  /** Reads the host-order bytes of a trivially copyable T. */
+  template <typename T>
+  S_HIDDEN size_t read(T &result) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "segment_reader_t::read requires a trivially copyable type");
+    return read(static_cast<void *>(&result), sizeof(T));
+  }
+
+  template <typename T>
+  S_HIDDEN size_t read_order(T &result, byte_order_t order) const
+  {
+    char bytes[sizeof(T)];
+    read(static_cast<void *>(bytes), sizeof(bytes));
+    result = load_order<T>(bytes, order);
+    return sizeof(T);
+  }
+
+  template <typename T>
+  S_HIDDEN size_t read_le(T &result) const { return read_order(result, LITTLE_ENDIAN_ORDER); }
+
+  template <typename T>
+  S_HIDDEN size_t read_be(T &result) const { return read_order(result, BIG_ENDIAN_ORDER); }
+
+  /** Reads count objects of type T. @see load_array_order */
+  template <typename T>
+  S_HIDDEN size_t read_array(T *data, size_t count, byte_order_t order = HOST_ORDER) const
+  {
+    if (count > remainder() / sizeof(T)) {
+      s_throw(std::out_of_range, "Attempt to read %zu objects of size %zu past end of segments",
+        count, sizeof(T));
+      return 0;
+    }
+    read(static_cast<void *>(data), count * sizeof(T));
+    if (order != HOST_ORDER) {
+      load_array_order(data, data, count, order);
+    }
+    return count * sizeof(T);
+  }
+
+  /**
+    Reads an unsigned LEB128 varint, which may straddle segments. Throws
+    std::out_of_range if the varint is truncated or malformed.
+  */
+  size_t read_varint(uint64_t &result) const;
+  size_t read_svarint(int64_t &result) const;
+
+  /**
+    Returns a pointer to the next length bytes if they're contiguous in the
+    current segment and advances past them. Otherwise returns null and doesn't
+    advance.
+  */
+  const char *contiguous(size_t length) const;
+
+  inline size_t remainder() const { return remaining_; }
+  inline bool more() const { return remaining_ > 0; }
+  /** Bytes read so far. */
+  inline size_t tell() const { return total_ - remaining_; }
+
+private:
+  void advance_empty() const;
+
+  mutable const struct iovec *segment_;
+  const struct iovec *segment_end_;
+  mutable size_t offset_;
+  mutable size_t remaining_;
+  size_t total_;
+};
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__SEGMENT_LIST_HH__ include guard */
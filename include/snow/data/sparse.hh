@@ -4,6 +4,7 @@
 #define __SNOW_COMMON__SPARSE_HH__
 
 #include <snow/config.hh>
+#include <snow/memory/accounting.hh>
 
 #include <functional>
 #include <iostream>
@@ -188,6 +189,10 @@ private:
 
   options_t options_;
   state_t state_;
+#if USE_MEMORY_ACCOUNTING
+  // Capacity of state_.buffer.
+  memory_usage_t buffer_usage_ { MEMORY_SPARSE };
+#endif
 
 
   static const state_t DEFAULT_STATE;
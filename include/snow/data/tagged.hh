@@ -0,0 +1,309 @@
+// tagged.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__TAGGED_HH__
+#define __SNOW_COMMON__TAGGED_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <snow/data/buffer_writer.hh>
+#include <snow/data/endian.hh>
+#include <snow/string/string_ref.hh>
+#include <type_traits>
+#include <vector>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Tagged binary format
+
+  A compact, self-describing binary format for snapshots of runtime data. A
+  document is an 8-byte header followed by a single value:
+
+    header:    u32 magic 'STAG', u8 version (1), 3 bytes zero
+
+  Every value begins with a one-byte tag (tagged_tag_t) followed by its
+  payload. Integers are zigzag/plain varints, floats and the components of
+  native vector types are little endian, and strings, blobs, and map keys are
+  a varint length followed by that many bytes.
+
+  Arrays and maps are followed by a u32 size (the number of bytes after the
+  size field), a u32 count, their elements, and then an index:
+
+    array index:  count * u32 offset
+    map index:    count * (u32 key hash, u32 offset), sorted by hash
+
+  Offsets are relative to the count field. A map element is its key followed
+  by its value, and its offset points to the key. The index lets a reader go
+  directly to an array element or a map key without decoding anything before
+  it. All u32 fields are little endian.
+
+==============================================================================*/
+
+/** Wire tags. Native types have one tag per component width. */
+enum tagged_tag_t : uint8_t
+{
+  TAG_NIL,
+  TAG_FALSE,
+  TAG_TRUE,
+  TAG_INT,
+  TAG_UINT,
+  TAG_F32,
+  TAG_F64,
+  TAG_STRING,
+  TAG_BLOB,
+  TAG_VEC3_F32,
+  TAG_VEC3_F64,
+  TAG_QUAT_F32,
+  TAG_QUAT_F64,
+  TAG_MAT4_F32,
+  TAG_MAT4_F64,
+  TAG_ARRAY,
+  TAG_MAP,
+  TAG_COUNT
+};
+
+
+/** The type of a tagged_value_t, independent of its encoding. */
+enum tagged_type_t : int
+{
+  /** Not a value -- e.g., the result of looking up a missing key. */
+  TAGGED_INVALID,
+  TAGGED_NIL,
+  TAGGED_BOOL,
+  TAGGED_INT,
+  TAGGED_UINT,
+  TAGGED_FLOAT,
+  TAGGED_STRING,
+  TAGGED_BLOB,
+  TAGGED_VEC3,
+  TAGGED_QUAT,
+  TAGGED_MAT4,
+  TAGGED_ARRAY,
+  TAGGED_MAP,
+};
+
+
+
+/*==============================================================================
+
+  Writes a tagged document to a buffer_writer_t. Values are appended as they
+  are written; each array and map is closed by end_array() or end_map(), which
+  appends its index and patches its size.
+
+  Inside a map, every value must be preceded by a call to key(). Writing a
+  value in the wrong place, or more than one value at the root, throws
+  std::logic_error.
+
+  vec3, quat, and mat4 values may be any type with a floating point
+  value_type that is exactly 3, 4, or 16 of them, such as vec3_t<float>,
+  quat_t<double>, or mat4_t<float>. Their components are stored at the
+  precision of value_type.
+
+==============================================================================*/
+struct S_EXPORT tagged_writer_t
+{
+  /** Appends a document header to out. out must outlive the writer. */
+  tagged_writer_t(buffer_writer_t &out);
+
+  tagged_writer_t(const tagged_writer_t &) = delete;
+  tagged_writer_t &operator = (const tagged_writer_t &) = delete;
+
+  void write_nil();
+  void write_bool(bool value);
+  void write_int(int64_t value);
+  void write_uint(uint64_t value);
+  void write_float(float value);
+  void write_double(double value);
+  void write_string(const string_ref_t &value);
+  void write_blob(const void *data, size_t length);
+
+  template <typename V>
+  S_HIDDEN void write_vec3(const V &value) { write_native<V, 3>(TAG_VEC3_F32, value); }
+
+  template <typename V>
+  S_HIDDEN void write_quat(const V &value) { write_native<V, 4>(TAG_QUAT_F32, value); }
+
+  template <typename V>
+  S_HIDDEN void write_mat4(const V &value) { write_native<V, 16>(TAG_MAT4_F32, value); }
+
+  void begin_array();
+  void end_array();
+  void begin_map();
+  void end_map();
+
+  /** Writes the key for the next value in the current map. */
+  void key(const string_ref_t &name);
+
+  /** Number of arrays and maps currently open. */
+  inline size_t depth() const { return frames_.size(); }
+
+private:
+  struct frame_t
+  {
+    /** Offset of the container's count field in the output. */
+    size_t    body;
+    /** Index of the container's first entry in index_. */
+    size_t    first;
+    bool      is_map;
+  };
+
+  struct index_entry_t
+  {
+    uint32_t  hash;
+    uint32_t  offset;
+  };
+
+  template <typename V, size_t N>
+  S_HIDDEN void write_native(tagged_tag_t f32_tag, const V &value)
+  {
+    using scalar_t = typename byte_order_scalar_t<V>::type;
+    static_assert(std::is_floating_point<scalar_t>::value &&
+                  (sizeof(scalar_t) == 4 || sizeof(scalar_t) == 8) &&
+                  sizeof(V) == N * sizeof(scalar_t),
+                  "tagged_writer_t requires a type made of N floats or doubles");
+    begin_value();
+    out_.write<uint8_t>(f32_tag + (sizeof(scalar_t) == 8 ? 1 : 0));
+    out_.write_array(&value, 1, LITTLE_ENDIAN_ORDER);
+  }
+
+  void begin_value();
+  void begin_container(tagged_tag_t tag);
+  void end_container(bool is_map);
+  uint32_t body_offset(const frame_t &frame) const;
+
+  buffer_writer_t            &out_;
+  std::vector<frame_t>        frames_;
+  std::vector<index_entry_t>  index_;
+  bool                        expect_value_;
+  bool                        root_written_;
+};
+
+
+
+/*==============================================================================
+
+  A zero-copy view of a value in a tagged document. Reading a value never
+  allocates or copies the document: strings and blobs are returned as
+  string_ref_t pointing into it, and array elements and map values are found
+  through the container's index. The document must outlive every view into
+  it.
+
+  Lookups that fail (an out-of-range index, a missing key) return an invalid
+  value, which is false when tested as a bool. Reading a value as the wrong
+  type throws std::invalid_argument. Reading a malformed document throws
+  std::runtime_error -- every read is bounds-checked, so documents from
+  untrusted sources are safe to read.
+
+==============================================================================*/
+struct S_EXPORT tagged_value_t
+{
+  /** Constructs an invalid value. */
+  tagged_value_t() = default;
+
+  tagged_type_t type() const;
+
+  inline bool valid() const { return data_ != nullptr; }
+  inline explicit operator bool () const { return valid(); }
+
+  inline bool is_nil() const { return type() == TAGGED_NIL; }
+  inline bool is_array() const { return type() == TAGGED_ARRAY; }
+  inline bool is_map() const { return type() == TAGGED_MAP; }
+
+  bool as_bool() const;
+  /** Reads an INT or a UINT. Throws std::out_of_range if it doesn't fit. */
+  int64_t as_int() const;
+  /** Reads a UINT or a non-negative INT. */
+  uint64_t as_uint() const;
+  /** Reads a FLOAT, INT, or UINT. */
+  double as_double() const;
+  inline float as_float() const { return static_cast<float>(as_double()); }
+  string_ref_t as_string() const;
+  string_ref_t as_blob() const;
+
+  template <typename V>
+  S_HIDDEN V as_vec3() const { return read_native<V, 3>(TAG_VEC3_F32); }
+
+  template <typename V>
+  S_HIDDEN V as_quat() const { return read_native<V, 4>(TAG_QUAT_F32); }
+
+  template <typename V>
+  S_HIDDEN V as_mat4() const { return read_native<V, 16>(TAG_MAT4_F32); }
+
+  /** Number of elements in an array or map. Zero for other values. */
+  size_t size() const;
+
+  /** Returns the element of an array at index. */
+  tagged_value_t at(size_t index) const;
+  inline tagged_value_t operator [] (size_t index) const { return at(index); }
+
+  /**
+    Returns the value for key in a map. If the key occurs more than once, the
+    first value written for it is returned.
+  */
+  tagged_value_t find(const string_ref_t &key) const;
+  inline tagged_value_t operator [] (const string_ref_t &key) const { return find(key); }
+  inline tagged_value_t operator [] (const char *key) const { return find(key); }
+
+  /**
+    Returns the key and value of the map entry at index. Entries are ordered
+    by key hash, not the order they were written.
+  */
+  string_ref_t key_at(size_t index) const;
+  tagged_value_t value_at(size_t index) const;
+
+private:
+  friend tagged_value_t tagged_root(const buffer_stream_t &document);
+
+  inline tagged_value_t(const char *data, const char *end) : data_(data), end_(end) {}
+
+  template <typename V, size_t N>
+  S_HIDDEN V read_native(tagged_tag_t f32_tag) const
+  {
+    using scalar_t = typename byte_order_scalar_t<V>::type;
+    static_assert(std::is_floating_point<scalar_t>::value && sizeof(V) == N * sizeof(scalar_t),
+                  "tagged_value_t requires a type made of N floating point values");
+    bool is_double = false;
+    const char *src = native_data(f32_tag, N, is_double);
+    scalar_t components[N];
+    if (is_double) {
+      double stored[N];
+      load_array_order(stored, src, N, LITTLE_ENDIAN_ORDER);
+      for (size_t index = 0; index < N; ++index) {
+        components[index] = static_cast<scalar_t>(stored[index]);
+      }
+    } else {
+      float stored[N];
+      load_array_order(stored, src, N, LITTLE_ENDIAN_ORDER);
+      for (size_t index = 0; index < N; ++index) {
+        components[index] = static_cast<scalar_t>(stored[index]);
+      }
+    }
+    V result;
+    std::memcpy(&result, components, sizeof(result));
+    return result;
+  }
+
+  const char *native_data(tagged_tag_t f32_tag, size_t components, bool &is_double) const;
+  const char *container(tagged_tag_t tag, uint32_t &count, const char *&index) const;
+  string_ref_t read_bytes(tagged_tag_t tag) const;
+  uint64_t read_varint_payload() const;
+
+  const char *data_ = nullptr;
+  const char *end_ = nullptr;
+};
+
+
+/**
+  Returns the root value of the tagged document at the stream's current
+  position, or an invalid value if the stream doesn't start with a document
+  header. The stream may be over a mapped file (see mapped_file_t::stream).
+*/
+S_EXPORT tagged_value_t tagged_root(const buffer_stream_t &document);
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__TAGGED_HH__ include guard */
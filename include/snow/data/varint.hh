@@ -0,0 +1,102 @@
+// varint.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__VARINT_HH__
+#define __SNOW_COMMON__VARINT_HH__
+
+#include <snow/config.hh>
+#include <cstdint>
+
+
+namespace snow {
+
+
+/** Maximum number of bytes in an encoded 64-bit varint. */
+const size_t VARINT_MAX_BYTES = 10;
+
+
+/*==============================================================================
+  zigzag_encode / zigzag_decode
+
+    Maps signed integers onto unsigned ones so that values near zero (of
+    either sign) stay small: 0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...
+==============================================================================*/
+constexpr uint64_t zigzag_encode(int64_t value)
+{
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+
+constexpr int64_t zigzag_decode(uint64_t value)
+{
+  return static_cast<int64_t>((value >> 1) ^ (~(value & 0x1) + 1));
+}
+
+
+
+/*==============================================================================
+  varint_size
+
+    Returns the number of bytes needed to encode value as a varint.
+==============================================================================*/
+inline size_t varint_size(uint64_t value)
+{
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+
+
+/*==============================================================================
+  encode_varint
+
+    Writes value as an unsigned LEB128 varint (7 bits per byte, least
+    significant group first, high bit set on all but the last byte). out must
+    have room for VARINT_MAX_BYTES bytes. Returns the number of bytes written.
+==============================================================================*/
+inline size_t encode_varint(uint64_t value, char *out)
+{
+  size_t index = 0;
+  while (value >= 0x80) {
+    out[index++] = static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out[index++] = static_cast<char>(value);
+  return index;
+}
+
+
+
+/*==============================================================================
+  decode_varint
+
+    Reads an unsigned LEB128 varint from [in, end). Returns the number of bytes
+    read, or zero if the input is truncated or the varint is longer than
+    VARINT_MAX_BYTES or overflows 64 bits.
+==============================================================================*/
+inline size_t decode_varint(const char *in, const char *end, uint64_t &result)
+{
+  uint64_t value = 0;
+  unsigned shift = 0;
+  for (size_t index = 0; index < VARINT_MAX_BYTES && in + index < end; ++index) {
+    const uint64_t byte = static_cast<uint8_t>(in[index]);
+    if (shift == 63 && byte > 1) {
+      return 0;
+    }
+    value |= (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      result = value;
+      return index + 1;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__VARINT_HH__ include guard */
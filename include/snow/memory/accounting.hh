@@ -0,0 +1,193 @@
+// accounting.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__ACCOUNTING_HH__
+#define __SNOW_COMMON__ACCOUNTING_HH__
+
+#include <snow/config.hh>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Memory accounting
+
+  Opt-in accounting of heap memory by category, enabled by building with
+  USE_MEMORY_ACCOUNTING (premake4 --memory-accounting). Code that allocates
+  reports allocations and frees against a category with s_memory_allocated,
+  s_memory_freed, and s_memory_resized, or by keeping a memory_usage_t
+  up to date with the size of a container's storage. For each category, the
+  live bytes, peak live bytes, and number of live allocations are kept.
+
+  Allocation call sites are sampled: roughly one sample is taken per
+  sample interval of allocated bytes (see memory_set_sample_interval), so
+  the cost of capturing a stack trace is paid rarely and large allocations
+  are more likely to be sampled than small ones. Each sample is weighted so
+  a site's estimated_bytes is an unbiased estimate of the bytes allocated
+  there. Sites are aggregated by category, source location, and stack.
+
+  memory_snapshot returns the current state of every category and sampled
+  site.
+
+  When USE_MEMORY_ACCOUNTING is 0, the macros expand to nothing,
+  memory_usage_t is not compiled into any type, and memory_snapshot
+  returns an empty snapshot.
+
+  string_t buffers, object_pool_t storage, Sparse parser buffers, binpack_t
+  nodes, arena_t chunks, and slab allocator regions are accounted under
+  their own categories. Other categories may be registered with
+  memory_register_category.
+
+==============================================================================*/
+
+enum memory_category_t : unsigned
+{
+  MEMORY_OTHER = 0,
+  MEMORY_STRING,
+  MEMORY_OBJECT_POOL,
+  MEMORY_SPARSE,
+  MEMORY_BINPACK,
+  MEMORY_ARENA,
+  MEMORY_SLAB,
+
+  MEMORY_FIRST_USER_CATEGORY,
+  MEMORY_MAX_CATEGORIES = 64
+};
+
+
+struct memory_category_stats_t
+{
+  memory_category_t category;
+  const char       *name;
+  size_t            live_bytes;
+  size_t            peak_bytes;
+  /** Number of live allocations. */
+  size_t            live_count;
+  /** Total allocations and bytes allocated since the process started. */
+  uint64_t          total_count;
+  uint64_t          total_bytes;
+};
+
+
+struct memory_site_t
+{
+  memory_category_t   category;
+  /** Source location of the accounting hook that was sampled. */
+  const char         *file;
+  int                 line;
+  /** Return addresses of the stack when sampled, innermost first. May be empty. */
+  std::vector<void *> frames;
+  size_t              samples;
+  /** Estimated bytes allocated at the site since the process started. */
+  uint64_t            estimated_bytes;
+};
+
+
+struct memory_snapshot_t
+{
+  /** Registered categories, ordered by category. */
+  std::vector<memory_category_stats_t> categories;
+  /** Sampled sites, ordered by estimated_bytes, largest first. */
+  std::vector<memory_site_t>           sites;
+};
+
+
+/**
+  Registers a category for user allocations and returns it. Throws
+  std::length_error if all MEMORY_MAX_CATEGORIES categories are in use. name
+  must outlive any snapshot.
+*/
+S_EXPORT memory_category_t memory_register_category(const char *name);
+
+/**
+  Sets the mean number of bytes allocated between samples, across all
+  categories. Zero disables sampling. Defaults to 512KB.
+*/
+S_EXPORT void memory_set_sample_interval(size_t bytes);
+
+/** Returns a snapshot of all categories and sampled sites. */
+S_EXPORT memory_snapshot_t memory_snapshot();
+
+/** Resets each category's peak to its current live bytes. */
+S_EXPORT void memory_reset_peaks();
+
+
+
+#if USE_MEMORY_ACCOUNTING
+
+S_EXPORT void memory_account_allocate(memory_category_t category, size_t size, const char *file, int line);
+S_EXPORT void memory_account_free(memory_category_t category, size_t size);
+S_EXPORT void memory_account_resize(memory_category_t category, size_t old_size, size_t new_size, const char *file, int line);
+
+
+/*==============================================================================
+
+  Accounts for storage whose size is recomputed rather than tracked
+  allocation by allocation, such as a container's capacity. update() accounts
+  the change since the last update, and the destructor accounts the last size
+  as freed. A copy starts at zero, so the object it's a member of can update
+  it with its own storage.
+
+==============================================================================*/
+struct memory_usage_t
+{
+  explicit memory_usage_t(memory_category_t category) :
+    category_(category),
+    bytes_(0)
+  {
+    /* nop */
+  }
+
+  memory_usage_t(const memory_usage_t &other) :
+    category_(other.category_),
+    bytes_(0)
+  {
+    /* nop */
+  }
+
+  memory_usage_t &operator = (const memory_usage_t &)
+  {
+    return *this;
+  }
+
+  ~memory_usage_t()
+  {
+    update(0, nullptr, 0);
+  }
+
+  inline void update(size_t bytes, const char *file, int line)
+  {
+    if (bytes != bytes_) {
+      memory_account_resize(category_, bytes_, bytes, file, line);
+      bytes_ = bytes;
+    }
+  }
+
+private:
+  memory_category_t category_;
+  size_t            bytes_;
+};
+
+
+#define s_memory_allocated(CATEGORY, SIZE) ::snow::memory_account_allocate((CATEGORY), (SIZE), __FILE__, __LINE__)
+#define s_memory_freed(CATEGORY, SIZE) ::snow::memory_account_free((CATEGORY), (SIZE))
+#define s_memory_resized(CATEGORY, OLD_SIZE, NEW_SIZE) ::snow::memory_account_resize((CATEGORY), (OLD_SIZE), (NEW_SIZE), __FILE__, __LINE__)
+#define s_memory_usage_update(USAGE, SIZE) (USAGE).update((SIZE), __FILE__, __LINE__)
+
+#else
+
+#define s_memory_allocated(CATEGORY, SIZE)
+#define s_memory_freed(CATEGORY, SIZE)
+#define s_memory_resized(CATEGORY, OLD_SIZE, NEW_SIZE)
+#define s_memory_usage_update(USAGE, SIZE)
+
+#endif
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__ACCOUNTING_HH__ include guard */
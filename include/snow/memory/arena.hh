@@ -0,0 +1,267 @@
+// arena.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__ARENA_HH__
+#define __SNOW_COMMON__ARENA_HH__
+
+#include <snow/config.hh>
+#include <snow/string/string_ref.hh>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  A bump allocator over a list of chunks. Allocating moves a pointer forward
+  through the current chunk and only calls malloc when a chunk runs out, so
+  it's suited to large numbers of short-lived allocations that are all freed
+  together.
+
+  Memory is never freed individually. mark() records the current position and
+  rewind() frees everything allocated after a mark; reset() frees everything.
+  Both keep the arena's chunks for reuse, so an arena that is reset every
+  frame stops calling malloc once it has grown to its working size.
+
+  Destructors of objects created with make() are never called.
+
+  Not thread-safe.
+
+==============================================================================*/
+struct S_EXPORT arena_t
+{
+  static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+  static const size_t DEFAULT_ALIGNMENT = alignof(std::max_align_t);
+
+  /** A position in an arena. See mark() and rewind(). */
+  struct marker_t
+  {
+    size_t chunk;
+    size_t offset;
+  };
+
+  /**
+    @param chunk_size Size of each chunk the arena allocates. Allocations
+    larger than this get a chunk of their own.
+  */
+  explicit arena_t(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  ~arena_t();
+
+  arena_t(const arena_t &) = delete;
+  arena_t &operator = (const arena_t &) = delete;
+
+  /**
+    Allocates size bytes aligned to alignment, which must be a power of two.
+    Never returns null; throws std::bad_alloc if malloc fails, or aborts if
+    exceptions are disabled.
+  */
+  inline void *allocate(size_t size, size_t alignment = DEFAULT_ALIGNMENT)
+  {
+    const uintptr_t aligned = (cur_ + alignment - 1) & ~uintptr_t(alignment - 1);
+    if (aligned >= cur_ && aligned < end_ && size <= end_ - aligned) {
+      cur_ = aligned + size;
+      return reinterpret_cast<void *>(aligned);
+    }
+    return allocate_slow(size, alignment);
+  }
+
+  /** Allocates uninitialized storage for count objects of type T. */
+  template <typename T>
+  S_HIDDEN T *allocate_array(size_t count)
+  {
+    if (count > SIZE_MAX / sizeof(T)) {
+#if USE_EXCEPTIONS
+      throw std::bad_alloc();
+#else
+      s_fatal_error("arena_t array size overflow");
+#endif
+    }
+    return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+  }
+
+  /** Allocates and constructs a T. Its destructor won't be called. */
+  template <typename T, typename... ARGS>
+  S_HIDDEN T *make(ARGS&&... args)
+  {
+    return new(allocate(sizeof(T), alignof(T))) T(std::forward<ARGS>(args)...);
+  }
+
+  /** Copies str into the arena with a terminating null character. */
+  char *copy_string(const string_ref_t &str);
+
+  /** Returns the current position. */
+  marker_t mark() const;
+  /**
+    Frees everything allocated since marker was taken. Markers taken after it
+    become invalid.
+  */
+  void rewind(const marker_t &marker);
+  /** Frees everything allocated from the arena, keeping its chunks. */
+  void reset();
+  /** Frees everything allocated from the arena and releases its chunks. */
+  void release();
+
+  /** Bytes allocated since the last reset, including alignment padding. */
+  size_t bytes_used() const;
+  /** Bytes held in chunks. */
+  size_t bytes_reserved() const;
+
+private:
+  struct chunk_t
+  {
+    char   *data;
+    size_t  size;
+  };
+
+  void *allocate_slow(size_t size, size_t alignment);
+  void use_chunk(size_t index, size_t offset);
+
+  size_t                chunk_size_;
+  std::vector<chunk_t>  chunks_;
+  // Index of the chunk cur_ and end_ point into. Chunks after it are unused.
+  size_t                chunk_;
+  uintptr_t             cur_;
+  uintptr_t             end_;
+};
+
+
+
+/*==============================================================================
+
+  A double-buffered arena for temporary data that lives for a frame. Memory
+  allocated during one frame stays valid through the next frame, then is
+  freed all at once, so data produced in frame N can still be consumed in
+  frame N + 1 without copying it.
+
+  Frames are counted globally: the main loop calls
+  frame_allocator_t::advance_frame() once per frame, and each frame allocator
+  flips its arenas the next time it's used in a new frame. local() returns a
+  frame allocator private to the calling thread, so worker threads can
+  allocate frame data without locks.
+
+  A single frame allocator is not thread-safe; use local() from each thread.
+
+==============================================================================*/
+struct S_EXPORT frame_allocator_t
+{
+  explicit frame_allocator_t(size_t chunk_size = arena_t::DEFAULT_CHUNK_SIZE);
+
+  frame_allocator_t(const frame_allocator_t &) = delete;
+  frame_allocator_t &operator = (const frame_allocator_t &) = delete;
+
+  /** Returns the calling thread's frame allocator. */
+  static frame_allocator_t &local();
+
+  /** Starts a new frame for every frame allocator. */
+  static void advance_frame();
+  /** Returns the current global frame number. */
+  static uint64_t frame();
+
+  inline void *allocate(size_t size, size_t alignment = arena_t::DEFAULT_ALIGNMENT)
+  {
+    return arena().allocate(size, alignment);
+  }
+
+  template <typename T>
+  S_HIDDEN T *allocate_array(size_t count) { return arena().allocate_array<T>(count); }
+
+  template <typename T, typename... ARGS>
+  S_HIDDEN T *make(ARGS&&... args) { return arena().make<T>(std::forward<ARGS>(args)...); }
+
+  inline char *copy_string(const string_ref_t &str) { return arena().copy_string(str); }
+
+  /** Returns the arena for the current frame, flipping arenas if the frame has advanced. */
+  inline arena_t &arena()
+  {
+    if (frame_ != global_frame_.load(std::memory_order_relaxed)) {
+      sync_frame();
+    }
+    return (frame_ & 1) ? odd_ : even_;
+  }
+
+private:
+  void sync_frame();
+
+  static std::atomic<uint64_t> global_frame_;
+
+  // Arenas for even and odd frames.
+  arena_t   even_;
+  arena_t   odd_;
+  uint64_t  frame_;
+};
+
+
+
+/*==============================================================================
+
+  An STL allocator that draws from an arena_t or frame_allocator_t. deallocate
+  is a no-op: memory is reclaimed when the arena is reset or rewound, so
+  containers using it must not outlive that.
+
+    std::vector<int, arena_allocator_t<int>> values { arena_allocator_t<int>(arena) };
+
+==============================================================================*/
+template <typename T, typename ARENA = arena_t>
+struct arena_allocator_t
+{
+  using value_type = T;
+
+  template <typename U>
+  struct rebind { using other = arena_allocator_t<U, ARENA>; };
+
+  arena_allocator_t(ARENA &arena) : arena_(&arena) {}
+
+  template <typename U>
+  arena_allocator_t(const arena_allocator_t<U, ARENA> &other) : arena_(other.arena_) {}
+
+  T *allocate(size_t count)
+  {
+    if (count > SIZE_MAX / sizeof(T)) {
+#if USE_EXCEPTIONS
+      throw std::bad_alloc();
+#else
+      s_fatal_error("arena_allocator_t array size overflow");
+#endif
+    }
+    return static_cast<T *>(arena_->allocate(count * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *, size_t) {}
+
+  template <typename U>
+  bool operator == (const arena_allocator_t<U, ARENA> &other) const { return arena_ == other.arena_; }
+
+  template <typename U>
+  bool operator != (const arena_allocator_t<U, ARENA> &other) const { return arena_ != other.arena_; }
+
+private:
+  template <typename U, typename A>
+  friend struct arena_allocator_t;
+
+  ARENA *arena_;
+};
+
+
+
+/**
+  Returns a string_t whose characters are stored in the arena. string_t
+  can't take an allocator, so this uses its non-owning constructor: the
+  string must not outlive the arena's memory, and resizing it copies it to
+  the heap.
+*/
+template <typename ARENA>
+S_HIDDEN string_t arena_string(ARENA &arena, const string_ref_t &str)
+{
+  return string_t(arena.copy_string(str), str.size(), true);
+}
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__ARENA_HH__ include guard */
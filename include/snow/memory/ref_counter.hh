@@ -4,9 +4,9 @@
 #define __SNOW_COMMON__REF_COUNTER_HH__
 
 #include <snow/config.hh>
+#include <snow/types/hash_map.hh>
 #include <cassert>
 #include <cstdint>
-#include <map>
 #include <memory>
 #include <mutex>
 
@@ -18,7 +18,7 @@ struct S_EXPORT ref_counter_t
 {
     template <typename T>
     using finalizer_t = void (*)(T *object);
-    using retain_map_t = std::map<const void *, uint_fast32_t>;
+    using retain_map_t = hash_map_t<const void *, uint_fast32_t>;
 
     template <typename T>
     auto  retain(T *object) -> T *;
@@ -0,0 +1,194 @@
+// slab.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__SLAB_HH__
+#define __SNOW_COMMON__SLAB_HH__
+
+#include <snow/config.hh>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Slab allocator
+
+  A process-wide allocator for large numbers of small blocks (up to
+  SLAB_MAX_SIZE bytes), such as tree nodes and messages. Sizes are rounded up
+  to a size class: multiples of 8 up to 32 bytes, then four classes per
+  power of two (2^k scaled by 1.25, 1.5, 1.75, and 2), so no more than 25% of
+  a block is wasted to rounding. Larger sizes go to malloc.
+
+  Each thread keeps a magazine of free blocks per size class, so most
+  allocations and frees touch only thread-local memory. A thread refills an
+  empty magazine from, and returns half of a full magazine to, a shared free
+  list for the class, under a per-class lock. Blocks may be freed by any
+  thread: a block freed on another thread joins that thread's magazine and
+  flows back to the shared list from there. A thread's magazines are returned
+  when it exits.
+
+  Blocks are carved out of 64KB slabs, which are cut from 2MB regions mapped
+  from the OS -- optionally backed by huge pages (see slab_configure). Slab
+  memory is reused for blocks of the same class but never returned to the
+  OS.
+
+  Frees are sized: slab_free must be passed the size the block was allocated
+  with. Blocks are aligned to 8 bytes, and to 16 bytes if their size is a
+  multiple of 16.
+
+==============================================================================*/
+
+/** Largest size served from slabs. */
+const size_t SLAB_MAX_SIZE = 4096;
+/** Number of slab size classes. */
+const size_t SLAB_NUM_CLASSES = 32;
+
+
+struct slab_options_t
+{
+  /**
+    Back new regions with huge pages: explicit huge pages if any are
+    reserved, otherwise transparent huge pages where supported.
+  */
+  bool huge_pages = false;
+};
+
+
+struct slab_class_stats_t
+{
+  /** Size of each block in the class. */
+  size_t block_size;
+  /** Slabs carved up for the class. */
+  size_t slabs;
+  /** Blocks handed out to threads: in use, or cached in a thread's magazine. */
+  size_t blocks_allocated;
+  /** Blocks on the class's shared free list or not yet carved from a slab. */
+  size_t blocks_free;
+};
+
+
+struct slab_stats_t
+{
+  std::vector<slab_class_stats_t> classes;
+  /** Bytes mapped from the OS for regions. */
+  size_t bytes_mapped;
+  /** Number of regions backed by huge pages. */
+  size_t huge_page_regions;
+  /** Allocations larger than SLAB_MAX_SIZE passed on to malloc, and not yet freed. */
+  size_t large_allocations;
+  size_t large_bytes;
+};
+
+
+/** Sets options for regions mapped after the call. */
+S_EXPORT void slab_configure(const slab_options_t &options);
+
+/**
+  Allocates a block of at least size bytes. A size of zero is treated as
+  one. Throws std::bad_alloc if memory can't be mapped, or aborts if
+  exceptions are disabled.
+*/
+S_EXPORT void *slab_allocate(size_t size);
+
+/** Frees a block, which may be null. size must be the size passed to slab_allocate. */
+S_EXPORT void slab_free(void *block, size_t size);
+
+/** Returns the size class index for size, or SLAB_NUM_CLASSES if it's too large. */
+S_EXPORT size_t slab_size_class(size_t size);
+
+/** Returns the block size of a size class. */
+S_EXPORT size_t slab_class_size(size_t size_class);
+
+/** Returns the calling thread's cached blocks to the shared free lists. */
+S_EXPORT void slab_flush_thread_cache();
+
+/** Returns a snapshot of the allocator's statistics. */
+S_EXPORT slab_stats_t slab_stats();
+
+
+/** Allocates and constructs a T from the slab allocator. */
+template <typename T, typename... ARGS>
+T *slab_new(ARGS&&... args)
+{
+  static_assert(alignof(T) <= 16, "slab_new requires alignment of 16 or less");
+  void *block = slab_allocate(sizeof(T));
+#if USE_EXCEPTIONS
+  try {
+    return new(block) T(std::forward<ARGS>(args)...);
+  } catch (...) {
+    slab_free(block, sizeof(T));
+    throw;
+  }
+#else
+  return new(block) T(std::forward<ARGS>(args)...);
+#endif
+}
+
+
+/** Destroys and frees an object created with slab_new. */
+template <typename T>
+void slab_delete(T *object)
+{
+  if (object) {
+    object->~T();
+    slab_free(object, sizeof(T));
+  }
+}
+
+
+
+/*==============================================================================
+
+  An STL allocator backed by the slab allocator. Stateless, so containers
+  using it can be moved and swapped freely and may free memory on any
+  thread.
+
+==============================================================================*/
+template <typename T>
+struct slab_allocator_t
+{
+  static_assert(alignof(T) <= 16, "slab_allocator_t requires alignment of 16 or less");
+
+  using value_type = T;
+
+  template <typename U>
+  struct rebind { using other = slab_allocator_t<U>; };
+
+  slab_allocator_t() = default;
+
+  template <typename U>
+  slab_allocator_t(const slab_allocator_t<U> &) {}
+
+  T *allocate(size_t count)
+  {
+    if (count > SIZE_MAX / sizeof(T)) {
+#if USE_EXCEPTIONS
+      throw std::bad_alloc();
+#else
+      s_fatal_error("slab_allocator_t array size overflow");
+#endif
+    }
+    return static_cast<T *>(slab_allocate(count * sizeof(T)));
+  }
+
+  void deallocate(T *block, size_t count)
+  {
+    slab_free(block, count * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator == (const slab_allocator_t<U> &) const { return true; }
+
+  template <typename U>
+  bool operator != (const slab_allocator_t<U> &) const { return false; }
+};
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__SLAB_HH__ include guard */
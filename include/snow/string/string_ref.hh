@@ -0,0 +1,93 @@
+// string_ref.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__STRING_REF_HH__
+#define __SNOW_COMMON__STRING_REF_HH__
+
+#include <snow/config.hh>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Non-owning reference to a run of characters. Does not require a null
+  terminator and never allocates, so it can point into the middle of a buffer
+  or a string_t. The referenced memory must outlive the string_ref_t.
+
+==============================================================================*/
+struct string_ref_t
+{
+  using value_type = char;
+  using size_type = size_t;
+  using const_iterator = const char *;
+
+
+  string_ref_t() = default;
+
+  string_ref_t(const char *data, size_type length) :
+    data_(data), length_(length)
+  {
+    /* nop */
+  }
+
+  string_ref_t(const char *zstr) :
+    data_(zstr), length_(zstr ? std::strlen(zstr) : 0)
+  {
+    /* nop */
+  }
+
+  string_ref_t(const string_t &str) :
+    data_(str.data()), length_(str.size())
+  {
+    /* nop */
+  }
+
+  string_ref_t(const std::string &str) :
+    data_(str.data()), length_(str.size())
+  {
+    /* nop */
+  }
+
+  inline const char *data() const { return data_; }
+  inline size_type size() const { return length_; }
+  inline bool empty() const { return length_ == 0; }
+
+  inline const_iterator begin() const { return data_; }
+  inline const_iterator end() const { return data_ + length_; }
+
+  inline char operator [] (size_type index) const { return data_[index]; }
+
+  // Copies the referenced characters into a new string.
+  inline string_t str() const { return length_ ? string_t(data_, length_) : string_t(); }
+
+  inline bool operator == (const string_ref_t &other) const
+  {
+    return length_ == other.length_ &&
+      (data_ == other.data_ || std::memcmp(data_, other.data_, length_) == 0);
+  }
+
+  inline bool operator != (const string_ref_t &other) const
+  {
+    return !(*this == other);
+  }
+
+private:
+  const char *data_ = nullptr;
+  size_type   length_ = 0;
+};
+
+
+
+inline std::ostream &operator << (std::ostream &out, const string_ref_t &in)
+{
+  return out.write(in.data(), in.size());
+}
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__STRING_REF_HH__ include guard */
@@ -5,7 +5,12 @@
 
 #include <snow/config.hh>
 
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 namespace snow {
 
@@ -17,6 +22,204 @@ S_EXPORT void async_thread(FNT &&func, ARGS&&... args)
   std::thread(func, args...).detach();
 }
 
+
+
+/*==============================================================================
+
+  A persistent set of threads that parallel_for_blocks runs on, so a loop run
+  every frame doesn't start and join threads on every call. Between jobs the
+  threads wait on a condition variable.
+
+  A set runs one job at a time. A call that finds the set busy -- from another
+  thread, or nested inside a job -- can't use it, and parallel_for_blocks runs
+  on the calling thread alone instead. Code that runs parallel loops from
+  several threads at once should give each its own set.
+
+==============================================================================*/
+struct S_EXPORT worker_threads_t
+{
+  using job_fn_t = void (*)(void *context, unsigned thread);
+
+  /**
+    Starts num_threads - 1 threads, the calling thread making up the rest. Zero
+    means std::thread::hardware_concurrency(). If a thread can't be started,
+    the threads already started are stopped and joined before the error is
+    thrown.
+  */
+  explicit worker_threads_t(unsigned num_threads = 0);
+  /** Stops and joins the threads. Must not be called while a job is running. */
+  ~worker_threads_t();
+
+  worker_threads_t(const worker_threads_t &) = delete;
+  worker_threads_t &operator = (const worker_threads_t &) = delete;
+
+  /** The number of threads a job can run on, including the calling thread. */
+  inline unsigned size() const { return unsigned(threads_.size()) + 1; }
+
+  /**
+    The set used when parallel_for_blocks isn't given one. Started on first
+    use with hardware_concurrency() threads and never destroyed.
+  */
+  static worker_threads_t &shared();
+
+  /**
+    Calls job(context, thread) for every thread in [0, num_threads) -- thread
+    zero on the calling thread, the rest on the set's threads -- and returns
+    once all of them return. num_threads is clamped to size(). job must not
+    throw.
+
+    Returns false without calling job if the set is already running a job.
+  */
+  bool try_run(unsigned num_threads, job_fn_t job, void *context);
+
+private:
+  void worker_main(unsigned thread);
+  void stop();
+
+  std::mutex                lock_;
+  std::condition_variable   wake_;
+  std::condition_variable   done_;
+  std::vector<std::thread>  threads_;
+  job_fn_t                  job_;
+  void                     *context_;
+  unsigned                  job_threads_;
+  unsigned                  pending_;
+  uint64_t                  generation_;
+  bool                      busy_;
+  bool                      stopping_;
+};
+
+
+
+/*==============================================================================
+  parallel_for_blocks
+
+    Calls func(block) once for every block in [0, num_blocks), spread across up
+    to num_threads threads -- the calling thread and the threads of workers,
+    or of worker_threads_t::shared() if workers is null. Zero means every
+    thread in the set. Returns once every block is done. If the set is busy,
+    every block runs on the calling thread.
+
+    Each thread starts with an equal, contiguous run of blocks and takes them
+    from the front. A thread that runs out steals the back half of another
+    thread's remaining run, so uneven blocks don't leave threads idle.
+
+    If func throws, the remaining blocks may or may not run, and the first
+    exception is rethrown in the calling thread once all threads finish.
+==============================================================================*/
+template <class FNT>
+void parallel_for_blocks(size_t num_blocks, FNT &&func, unsigned num_threads = 0,
+                         worker_threads_t *workers = nullptr)
+{
+  if (num_threads == 1 || num_blocks <= 1) {
+    for (size_t block = 0; block < num_blocks; ++block) {
+      func(block);
+    }
+    return;
+  }
+  if (workers == nullptr) {
+    workers = &worker_threads_t::shared();
+  }
+  if (num_threads == 0 || num_threads > workers->size()) {
+    num_threads = workers->size();
+  }
+  if (num_threads > num_blocks) {
+    num_threads = unsigned(num_blocks);
+  }
+  if (num_threads <= 1) {
+    for (size_t block = 0; block < num_blocks; ++block) {
+      func(block);
+    }
+    return;
+  }
+  if (num_blocks > UINT32_MAX) {
+    s_throw(std::length_error, "Too many blocks for parallel_for_blocks");
+  }
+
+  // Each run packs its next block in the low 32 bits and its end in the high
+  // 32 bits, so taking from the front and stealing from the back are both a
+  // single compare-exchange. Padded so runs don't share a cache line.
+  struct run_t {
+    std::atomic<uint64_t> blocks;
+    char                  padding[64 - sizeof(std::atomic<uint64_t>)];
+  };
+
+  std::vector<run_t> runs(num_threads);
+  for (unsigned thread = 0; thread < num_threads; ++thread) {
+    const uint64_t first = num_blocks * thread / num_threads;
+    const uint64_t end = num_blocks * (thread + 1) / num_threads;
+    runs[thread].blocks.store(first | (end << 32), std::memory_order_relaxed);
+  }
+
+  std::mutex error_lock;
+  std::exception_ptr error;
+
+  auto worker = [&](unsigned self) {
+    std::atomic<uint64_t> &own = runs[self].blocks;
+    for (;;) {
+      uint64_t run = own.load(std::memory_order_acquire);
+      const uint64_t block = run & 0xFFFFFFFFu;
+      if (block < (run >> 32)) {
+        if (own.compare_exchange_weak(run, run + 1, std::memory_order_acq_rel)) {
+#if USE_EXCEPTIONS
+          try {
+            func(size_t(block));
+          } catch (...) {
+            std::lock_guard<std::mutex> guard(error_lock);
+            if (!error) {
+              error = std::current_exception();
+            }
+          }
+#else
+          func(size_t(block));
+#endif
+        }
+        continue;
+      }
+
+      // Own run is empty: steal the back half of the first non-empty run.
+      bool stole = false;
+      for (unsigned offset = 1; offset < num_threads && !stole; ++offset) {
+        std::atomic<uint64_t> &victim = runs[(self + offset) % num_threads].blocks;
+        uint64_t theirs = victim.load(std::memory_order_acquire);
+        for (;;) {
+          const uint64_t first = theirs & 0xFFFFFFFFu;
+          const uint64_t end = theirs >> 32;
+          if (first >= end) {
+            break;
+          }
+          const uint64_t split = end - (end - first + 1) / 2;
+          if (victim.compare_exchange_weak(theirs, first | (split << 32),
+                                           std::memory_order_acq_rel)) {
+            // Only this thread stores to its own run while it's empty.
+            own.store(split | (end << 32), std::memory_order_release);
+            stole = true;
+            break;
+          }
+        }
+      }
+      if (!stole) {
+        return;
+      }
+    }
+  };
+
+  using worker_t = decltype(worker);
+  const worker_threads_t::job_fn_t job = [](void *context, unsigned thread) {
+    (*static_cast<worker_t *>(context))(thread);
+  };
+  if (!workers->try_run(num_threads, job, &worker)) {
+    // Another job holds the set, so the calling thread takes every run.
+    worker(0);
+  }
+
+#if USE_EXCEPTIONS
+  if (error) {
+    std::rethrow_exception(error);
+  }
+#endif
+}
+
 } // namespace snow
 
 #endif /* end __SNOW_COMMON__THREAD_HH__ include guard */
@@ -0,0 +1,245 @@
+// bloom_filter.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__BLOOM_FILTER_HH__
+#define __SNOW_COMMON__BLOOM_FILTER_HH__
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <snow/data/hash.hh>
+#include <snow/string/string_ref.hh>
+#include <cstdint>
+#include <vector>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Bloom filter. Answers "definitely not present" or "possibly present" for a
+  set of keys using a fixed number of bits. Keys are hashed once with hash64,
+  finalized with hash_mix64, and the k bit positions are derived from that by
+  double hashing (h1 + i * h2).
+
+  Filters may be written to and read from a buffer_stream_t. attach() points a
+  filter at serialized bits in place (e.g., in a mapped file) without copying
+  them. Serialized filters use host byte order.
+
+==============================================================================*/
+struct S_EXPORT bloom_filter_t
+{
+  /**
+    Constructs an empty filter sized for the given number of keys and false
+    positive rate.
+  */
+  bloom_filter_t(size_t expected_keys = 1024, double false_positive_rate = 0.01);
+  bloom_filter_t(const bloom_filter_t &other);
+  bloom_filter_t(bloom_filter_t &&other) = default;
+  bloom_filter_t &operator = (const bloom_filter_t &other);
+  bloom_filter_t &operator = (bloom_filter_t &&other) = default;
+
+  /** Hashes a key the same way insert and contains do. */
+  static inline uint64_t key_hash(const string_ref_t &key)
+  {
+    return hash_mix64(hash64(key.data(), key.size()));
+  }
+
+  inline void insert(const string_ref_t &key) { insert_hash(key_hash(key)); }
+  inline bool contains(const string_ref_t &key) const { return contains_hash(key_hash(key)); }
+
+  /** Inserts a key by its key_hash. */
+  void insert_hash(uint64_t hash);
+  /** Tests for a key by its key_hash. */
+  bool contains_hash(uint64_t hash) const;
+
+  /** Clears all bits. If attached, this clears the attached memory. */
+  void clear();
+
+  inline size_t bit_count() const { return num_bits_; }
+  inline unsigned hash_count() const { return num_hashes_; }
+  /** Whether the filter's bits are owned by another buffer (see attach). */
+  inline bool attached() const { return bits_ != owned_.data(); }
+
+  /** Returns the most bytes write() may need, including alignment padding. */
+  size_t serialized_size() const;
+  /**
+    Writes the filter to the stream. Returns the number of bytes written, or
+    zero if the stream doesn't have room for the whole filter, in which case
+    nothing is written.
+  */
+  size_t write(buffer_stream_t &stream) const;
+  /**
+    Reads a filter previously written with write() and copies its bits. Returns
+    false and leaves the filter and stream unchanged if the stream doesn't hold
+    a valid filter.
+  */
+  bool read(const buffer_stream_t &stream);
+  /**
+    Like read(), but uses the bits in the stream's memory directly. The memory
+    must outlive the filter (or the next read/attach) and the bits must be
+    8-byte aligned. Inserting into an attached filter writes to that memory.
+
+    write() aligns the bits relative to the start of its stream, so a filter
+    can be attached wherever it was written as long as the reader's stream
+    starts at an address aligned at least as strictly (e.g., a mapped file).
+  */
+  bool attach(buffer_stream_t &stream);
+
+private:
+  static const uint32_t MAGIC = 0x4D4C4253U; // 'SBLM'
+
+  size_t      num_words_;
+  size_t      num_bits_;
+  unsigned    num_hashes_;
+  uint64_t   *bits_;
+  std::vector<uint64_t> owned_;
+};
+
+
+
+/*==============================================================================
+
+  Blocked Bloom filter. Each key maps to a single 64-byte, cache-line-aligned
+  block and all of its k bits are set within that block, so a query costs one
+  cache miss at most. Needs slightly more bits than a plain Bloom filter for
+  the same false positive rate.
+
+==============================================================================*/
+struct S_EXPORT blocked_bloom_filter_t
+{
+  static const size_t BLOCK_BITS = 512;
+  static const size_t BLOCK_WORDS = BLOCK_BITS / 64;
+
+  blocked_bloom_filter_t(size_t expected_keys = 1024, double false_positive_rate = 0.01);
+  blocked_bloom_filter_t(const blocked_bloom_filter_t &other);
+  blocked_bloom_filter_t(blocked_bloom_filter_t &&other) = default;
+  blocked_bloom_filter_t &operator = (const blocked_bloom_filter_t &other);
+  blocked_bloom_filter_t &operator = (blocked_bloom_filter_t &&other) = default;
+
+  static inline uint64_t key_hash(const string_ref_t &key)
+  {
+    return bloom_filter_t::key_hash(key);
+  }
+
+  inline void insert(const string_ref_t &key) { insert_hash(key_hash(key)); }
+  inline bool contains(const string_ref_t &key) const { return contains_hash(key_hash(key)); }
+
+  void insert_hash(uint64_t hash);
+  bool contains_hash(uint64_t hash) const;
+
+  void clear();
+
+  inline size_t block_count() const { return num_blocks_; }
+  inline size_t bit_count() const { return num_blocks_ * BLOCK_BITS; }
+  inline unsigned hash_count() const { return num_hashes_; }
+  inline bool attached() const { return blocks_ != aligned_owned(); }
+
+  /** @see bloom_filter_t::serialized_size */
+  size_t serialized_size() const;
+  /** @see bloom_filter_t::write */
+  size_t write(buffer_stream_t &stream) const;
+  /** @see bloom_filter_t::read */
+  bool read(const buffer_stream_t &stream);
+  /**
+    @see bloom_filter_t::attach -- blocks must be 64-byte aligned, so the
+    stream's memory must start on a 64-byte boundary.
+  */
+  bool attach(buffer_stream_t &stream);
+
+private:
+  static const uint32_t MAGIC = 0x4C424253U; // 'SBBL'
+
+  void allocate_blocks(size_t num_blocks);
+  uint64_t *aligned_owned() const;
+
+  size_t      num_blocks_;
+  unsigned    num_hashes_;
+  uint64_t   *blocks_;
+  // Over-allocated by one block so blocks_ can be aligned to a cache line.
+  std::vector<uint64_t> owned_;
+};
+
+
+
+
+/*==============================================================================
+
+  Cuckoo filter. Like a Bloom filter, but stores a 16-bit fingerprint of each
+  key in one of two candidate buckets of four slots, which makes it possible to
+  erase keys. Lookups read at most two buckets (each a single 64-bit word).
+
+  Insertion fails once the filter is too full to place a fingerprint, at
+  around 95% occupancy. Erasing a key that was never inserted may erase a
+  different key with the same fingerprint, so only erase keys known to be in
+  the filter.
+
+==============================================================================*/
+struct S_EXPORT cuckoo_filter_t
+{
+  static const size_t BUCKET_SLOTS = 4;
+
+  /** Constructs an empty filter with room for at least expected_keys keys. */
+  cuckoo_filter_t(size_t expected_keys = 1024);
+  cuckoo_filter_t(const cuckoo_filter_t &other);
+  cuckoo_filter_t(cuckoo_filter_t &&other) = default;
+  cuckoo_filter_t &operator = (const cuckoo_filter_t &other);
+  cuckoo_filter_t &operator = (cuckoo_filter_t &&other) = default;
+
+  static inline uint64_t key_hash(const string_ref_t &key)
+  {
+    return bloom_filter_t::key_hash(key);
+  }
+
+  /** Inserts a key. Returns false if the filter is full. */
+  inline bool insert(const string_ref_t &key) { return insert_hash(key_hash(key)); }
+  inline bool contains(const string_ref_t &key) const { return contains_hash(key_hash(key)); }
+  /** Erases a key. Returns false if no matching fingerprint was found. */
+  inline bool erase(const string_ref_t &key) { return erase_hash(key_hash(key)); }
+
+  bool insert_hash(uint64_t hash);
+  bool contains_hash(uint64_t hash) const;
+  bool erase_hash(uint64_t hash);
+
+  void clear();
+
+  /** Number of keys in the filter. */
+  inline size_t size() const { return static_cast<size_t>(words_[COUNT_WORD]); }
+  inline size_t bucket_count() const { return num_buckets_; }
+  inline size_t capacity() const { return num_buckets_ * BUCKET_SLOTS; }
+  inline bool attached() const { return words_ != owned_.data(); }
+
+  /** @see bloom_filter_t::serialized_size */
+  size_t serialized_size() const;
+  /** @see bloom_filter_t::write */
+  size_t write(buffer_stream_t &stream) const;
+  /** @see bloom_filter_t::read */
+  bool read(const buffer_stream_t &stream);
+  /** @see bloom_filter_t::attach */
+  bool attach(buffer_stream_t &stream);
+
+private:
+  static const uint32_t MAGIC = 0x4B434253U; // 'SBCK'
+  // words_ layout: key count, victim, then one word per bucket.
+  static const size_t COUNT_WORD = 0;
+  static const size_t VICTIM_WORD = 1;
+  static const size_t HEADER_WORDS = 2;
+  static const uint64_t VICTIM_VALID = uint64_t(1) << 63;
+
+  bool place(size_t index, uint16_t fingerprint);
+  bool remove(size_t index, uint16_t fingerprint);
+  bool bucket_contains(size_t index, uint16_t fingerprint) const;
+  size_t alt_index(size_t index, uint16_t fingerprint) const;
+
+  inline uint64_t *buckets() { return words_ + HEADER_WORDS; }
+  inline const uint64_t *buckets() const { return words_ + HEADER_WORDS; }
+
+  size_t      num_buckets_;
+  uint64_t    rng_state_;
+  uint64_t   *words_;
+  std::vector<uint64_t> owned_;
+};
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__BLOOM_FILTER_HH__ include guard */
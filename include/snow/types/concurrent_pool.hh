@@ -0,0 +1,517 @@
+// concurrent_pool.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__CONCURRENT_POOL_HH__
+#define __SNOW_COMMON__CONCURRENT_POOL_HH__
+
+#include <snow/config.hh>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  An object pool for use from many threads at once, without locks.
+
+  Objects live in fixed-size pages that are never moved, so at() and
+  operator [] are plain loads -- no lock is taken to read or write an object,
+  and references stay valid until the object is destroyed. The page table is
+  sized for max_objects when the pool is constructed.
+
+  Unused slots are kept on a global lock-free stack. Its head packs a slot
+  index and a tag that changes on every push and pop, so a slot that is
+  popped, reused, and pushed again between another thread's load and
+  compare-exchange can't corrupt the stack.
+
+  For throughput, each worker thread should allocate and destroy through its
+  own cache_t. A cache hands out slots from a small local array and only
+  touches the global stack to refill or flush a batch at a time, so most
+  allocations are a few local instructions and threads rarely share a cache
+  line. Allocating and destroying without a cache goes directly to the global
+  stack.
+
+  Creating and destroying objects is safe from any thread. Accessing an
+  object concurrently with its own destruction, iterating while other threads
+  destroy objects, and destroying the pool while caches or other threads
+  still use it are not.
+
+==============================================================================*/
+template <typename T, size_t PAGE_SIZE = 4096>
+struct concurrent_pool_t
+{
+  static_assert(PAGE_SIZE > 0 && (PAGE_SIZE & (PAGE_SIZE - 1)) == 0,
+                "concurrent_pool_t PAGE_SIZE must be a power of two");
+
+  using object_t = T;
+  using index_t  = uint32_t;
+
+  static const index_t NO_INDEX = index_t(~index_t(0));
+  // Number of slots a cache holds at most, and moves to or from the global
+  // stack at a time.
+  static const size_t CACHE_SIZE = 64;
+  static const size_t CACHE_BATCH = CACHE_SIZE / 2;
+
+
+/*==============================================================================
+
+  A per-thread cache of unused slots. A cache must only be used by one thread
+  at a time and must be destroyed before its pool.
+
+==============================================================================*/
+  struct cache_t
+  {
+    explicit cache_t(concurrent_pool_t &pool) : pool_(pool) {}
+    ~cache_t() { flush(); }
+
+    cache_t(const cache_t &) = delete;
+    cache_t &operator = (const cache_t &) = delete;
+
+    // Returns every cached slot to the pool.
+    void flush()
+    {
+      pool_.push_slots(slots_, count_);
+      count_ = 0;
+      pool_.add_live(live_delta_);
+      live_delta_ = 0;
+    }
+
+  private:
+    friend struct concurrent_pool_t;
+
+    concurrent_pool_t  &pool_;
+    index_t             slots_[CACHE_SIZE];
+    size_t              count_ = 0;
+    // Objects allocated minus objects destroyed through this cache since the
+    // pool's live count was last updated.
+    ptrdiff_t           live_delta_ = 0;
+  };
+
+
+
+/*==============================================================================
+  ctor
+
+    Creates a pool that can hold up to max_objects objects. Only the page table
+    is allocated up front.
+==============================================================================*/
+  explicit concurrent_pool_t(size_t max_objects = size_t(1) << 24) :
+    num_pages_((std::min(max_objects, size_t(NO_INDEX)) + PAGE_SIZE - 1) >> PAGE_SHIFT),
+    pages_(new std::atomic<store_t *>[num_pages_])
+  {
+    for (size_t page = 0; page < num_pages_; ++page) {
+      pages_[page].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+
+
+  concurrent_pool_t(const concurrent_pool_t &) = delete;
+  concurrent_pool_t &operator = (const concurrent_pool_t &) = delete;
+
+
+
+/*==============================================================================
+  dtor
+
+    Destroys any objects left in the pool and frees its pages.
+==============================================================================*/
+  ~concurrent_pool_t()
+  {
+    const size_t end = std::min(high_water_.load(std::memory_order_acquire), capacity());
+    for (size_t index = 0; !std::is_pod<object_t>::value && index < end; ++index) {
+      // Slots can be reserved past the last page if allocating a page threw.
+      store_t *page = pages_[index >> PAGE_SHIFT].load(std::memory_order_relaxed);
+      if (page == nullptr) {
+        index |= SLOT_MASK;
+        continue;
+      }
+      store_t &store = page[index & SLOT_MASK];
+      if (store.used.load(std::memory_order_relaxed)) {
+        ((object_t *)&store.data)->~object_t();
+      }
+    }
+    for (size_t page = 0; page < num_pages_; ++page) {
+      delete [] pages_[page].load(std::memory_order_relaxed);
+    }
+  }
+
+
+
+/*==============================================================================
+  allocate
+
+    Constructs an object in an unused slot and returns its index. Throws
+    std::length_error if the pool is full.
+==============================================================================*/
+  template <typename... ARGS>
+  index_t allocate(ARGS&&... args)
+  {
+    index_t index = pop_slot();
+    if (index == NO_INDEX) {
+      index = reserve_slots(1);
+    }
+    add_live(1);
+    return construct(index, std::forward<ARGS>(args)...);
+  }
+
+
+
+  template <typename... ARGS>
+  index_t allocate(cache_t &cache, ARGS&&... args)
+  {
+    if (cache.count_ == 0) {
+      refill(cache);
+    }
+    const index_t index = cache.slots_[--cache.count_];
+    ++cache.live_delta_;
+    return construct(index, std::forward<ARGS>(args)...);
+  }
+
+
+
+/*==============================================================================
+  destroy
+
+    Destroys the object at index and returns its slot to the pool. Throws
+    std::out_of_range if the index doesn't refer to an allocated object.
+==============================================================================*/
+  void destroy(index_t index)
+  {
+    release(index);
+    push_slots(&index, 1);
+    add_live(-1);
+  }
+
+
+
+  void destroy(cache_t &cache, index_t index)
+  {
+    release(index);
+    if (cache.count_ == CACHE_SIZE) {
+      // Return the older half of the cache, keeping recently freed slots local.
+      push_slots(cache.slots_, CACHE_BATCH);
+      std::copy(cache.slots_ + CACHE_BATCH, cache.slots_ + CACHE_SIZE, cache.slots_);
+      cache.count_ -= CACHE_BATCH;
+      add_live(cache.live_delta_);
+      cache.live_delta_ = 0;
+    }
+    cache.slots_[cache.count_++] = index;
+    --cache.live_delta_;
+  }
+
+
+
+/*==============================================================================
+  at
+
+    Gets the object at the given index. Throws std::out_of_range if the index
+    doesn't refer to an allocated object. Takes no lock.
+==============================================================================*/
+  object_t &at(index_t index)
+  {
+    return *(object_t *)&checked_store(index).data;
+  }
+
+
+
+  const object_t &at(index_t index) const
+  {
+    return *(const object_t *)&checked_store(index).data;
+  }
+
+
+
+/*==============================================================================
+  operator []
+
+    Gets the object at the given index without checking that it's allocated.
+==============================================================================*/
+  object_t &operator [] (index_t index)
+  {
+    return *(object_t *)&store_at(index).data;
+  }
+
+
+
+  const object_t &operator [] (index_t index) const
+  {
+    return *(const object_t *)&store_at(index).data;
+  }
+
+
+
+/*==============================================================================
+  each_object
+
+    Calls func(object, index) for every allocated object. Objects allocated
+    concurrently may or may not be visited; objects must not be destroyed
+    concurrently.
+==============================================================================*/
+  template <typename FN>
+  void each_object(FN &&func)
+  {
+    const size_t end = std::min(high_water_.load(std::memory_order_acquire), capacity());
+    for (size_t index = 0; index < end; ++index) {
+      store_t *page = pages_[index >> PAGE_SHIFT].load(std::memory_order_acquire);
+      if (page == nullptr) {
+        index |= SLOT_MASK;
+        continue;
+      }
+      store_t &store = page[index & SLOT_MASK];
+      if (store.used.load(std::memory_order_acquire)) {
+        func(*(object_t *)&store.data, index_t(index));
+      }
+    }
+  }
+
+
+
+/*==============================================================================
+  size
+
+    Returns the number of allocated objects. Allocations and destructions
+    through a cache are counted when the cache next exchanges slots with the
+    pool or is flushed, so this is approximate while caches are in use.
+==============================================================================*/
+  size_t size() const
+  {
+    const ptrdiff_t live = live_.load(std::memory_order_relaxed);
+    return live < 0 ? 0 : size_t(live);
+  }
+
+
+
+/*==============================================================================
+  capacity
+
+    Returns the maximum number of objects the pool can hold. Caches reserve new
+    slots a batch at a time, so allocating through caches may fail up to
+    CACHE_BATCH objects short of this.
+==============================================================================*/
+  size_t capacity() const
+  {
+    return num_pages_ * PAGE_SIZE;
+  }
+
+
+
+private:
+
+  struct store_t
+  {
+    using data_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    // Next slot on the free stack, while this slot is on it.
+    std::atomic<index_t>  next_free { NO_INDEX };
+    std::atomic<uint8_t>  used { 0 };
+    data_t                data;
+  };
+
+
+  static constexpr size_t log2(size_t value)
+  {
+    return value <= 1 ? 0 : 1 + log2(value >> 1);
+  }
+
+  static constexpr size_t PAGE_SHIFT = log2(PAGE_SIZE);
+  static constexpr size_t SLOT_MASK = PAGE_SIZE - 1;
+
+
+  // Free stack head: low 32 bits are the top slot's index, high 32 bits a tag
+  // bumped by every successful push and pop.
+  static uint64_t pack_head(index_t index, uint64_t head)
+  {
+    return ((head + (uint64_t(1) << 32)) & ~uint64_t(0xFFFFFFFF)) | index;
+  }
+
+
+
+  store_t &store_at(size_t index) const
+  {
+    return pages_[index >> PAGE_SHIFT].load(std::memory_order_acquire)[index & SLOT_MASK];
+  }
+
+
+
+  store_t &checked_store(index_t index) const
+  {
+    if (index >= std::min(high_water_.load(std::memory_order_acquire), capacity())) {
+      s_throw(std::out_of_range, "Index is out of range");
+    }
+    // Reserved slots may not have a page yet, either because the reserving
+    // thread hasn't published it or because allocating it threw.
+    store_t *page = pages_[index >> PAGE_SHIFT].load(std::memory_order_acquire);
+    if (page == nullptr) {
+      s_throw(std::out_of_range, "Index is out of range");
+    }
+    store_t &store = page[index & SLOT_MASK];
+    if (!store.used.load(std::memory_order_acquire)) {
+      s_throw(std::out_of_range, "Index is out of range");
+    }
+    return store;
+  }
+
+
+
+  template <typename... ARGS>
+  index_t construct(index_t index, ARGS&&... args)
+  {
+    store_t &store = store_at(index);
+    new(&store.data) object_t(std::forward<ARGS>(args)...);
+    store.used.store(1, std::memory_order_release);
+    return index;
+  }
+
+
+
+  void release(index_t index)
+  {
+    store_t &store = checked_store(index);
+    if (!store.used.exchange(0, std::memory_order_acq_rel)) {
+      s_throw(std::out_of_range, "Index is out of range");
+    }
+    if (!std::is_pod<object_t>::value) {
+      ((object_t *)&store.data)->~object_t();
+    }
+  }
+
+
+
+  void add_live(ptrdiff_t delta)
+  {
+    if (delta != 0) {
+      live_.fetch_add(delta, std::memory_order_relaxed);
+    }
+  }
+
+
+
+/*==============================================================================
+  pop_slot
+
+    Pops a slot off the global free stack. Returns NO_INDEX if it's empty.
+==============================================================================*/
+  index_t pop_slot()
+  {
+    uint64_t head = free_head_.load(std::memory_order_acquire);
+    for (;;) {
+      const index_t index = index_t(head);
+      if (index == NO_INDEX) {
+        return NO_INDEX;
+      }
+      // If another thread pops this slot first, next may be stale, but then
+      // the tag has changed and the exchange fails.
+      const index_t next = store_at(index).next_free.load(std::memory_order_relaxed);
+      if (free_head_.compare_exchange_weak(head, pack_head(next, head),
+                                           std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+        return index;
+      }
+    }
+  }
+
+
+
+/*==============================================================================
+  push_slots
+
+    Links count slots together and pushes them onto the global free stack with
+    a single compare-exchange.
+==============================================================================*/
+  void push_slots(const index_t *slots, size_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    for (size_t index = 1; index < count; ++index) {
+      store_at(slots[index - 1]).next_free.store(slots[index], std::memory_order_relaxed);
+    }
+    std::atomic<index_t> &last_next = store_at(slots[count - 1]).next_free;
+    uint64_t head = free_head_.load(std::memory_order_relaxed);
+    do {
+      last_next.store(index_t(head), std::memory_order_relaxed);
+    } while (!free_head_.compare_exchange_weak(head, pack_head(slots[0], head),
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+  }
+
+
+
+/*==============================================================================
+  reserve_slots
+
+    Takes count never-used slots from the end of the pool, allocating pages for
+    them as needed, and returns the first. Throws std::length_error if the pool
+    can't hold them.
+==============================================================================*/
+  index_t reserve_slots(size_t count)
+  {
+    const size_t first = high_water_.fetch_add(count, std::memory_order_acq_rel);
+    if (first + count > capacity()) {
+      s_throw(std::length_error, "concurrent_pool_t is full");
+    }
+    for (size_t page = first >> PAGE_SHIFT; page <= (first + count - 1) >> PAGE_SHIFT; ++page) {
+      if (pages_[page].load(std::memory_order_acquire) == nullptr) {
+        store_t *fresh = new store_t[PAGE_SIZE];
+        store_t *expected = nullptr;
+        if (!pages_[page].compare_exchange_strong(expected, fresh,
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_acquire)) {
+          delete [] fresh;
+        }
+      }
+    }
+    return index_t(first);
+  }
+
+
+
+/*==============================================================================
+  refill
+
+    Fills an empty cache with up to CACHE_BATCH slots from the free stack, or
+    with new slots if the stack is empty.
+==============================================================================*/
+  void refill(cache_t &cache)
+  {
+    add_live(cache.live_delta_);
+    cache.live_delta_ = 0;
+
+    size_t count = 0;
+    index_t index;
+    while (count < CACHE_BATCH && (index = pop_slot()) != NO_INDEX) {
+      cache.slots_[count++] = index;
+    }
+    if (count == 0) {
+      const index_t first = reserve_slots(CACHE_BATCH);
+      // Reversed so the cache hands out the lowest index first.
+      for (; count < CACHE_BATCH; ++count) {
+        cache.slots_[count] = index_t(first + CACHE_BATCH - 1 - count);
+      }
+    }
+    cache.count_ = count;
+  }
+
+
+
+  const size_t                            num_pages_;
+  std::unique_ptr<std::atomic<store_t *>[]> pages_;
+  // Number of slots ever handed out. May exceed capacity() after a failed
+  // allocation.
+  std::atomic<size_t>                     high_water_ { 0 };
+  std::atomic<uint64_t>                   free_head_ { NO_INDEX };
+  std::atomic<ptrdiff_t>                  live_ { 0 };
+
+}; // struct concurrent_pool_t
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__CONCURRENT_POOL_HH__ include guard */
@@ -0,0 +1,904 @@
+// hash_map.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__HASH_MAP_HH__
+#define __SNOW_COMMON__HASH_MAP_HH__
+
+#include <snow/config.hh>
+#include <snow/data/hash.hh>
+#include <snow/string/string_ref.hh>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  Default hash functor for hash_map_t. Integers and pointers are run through a
+  64-bit finalizer. Strings are hashed with snow::hash64 and finalized the same
+  way, since hash64 doesn't fully mix its last bytes into the bits the table
+  uses to pick groups and tags. Any string type hashes to the same value as a
+  string_t with the same contents, so string_t keys may be looked up by
+  string_ref_t, std::string, or C string without constructing a string_t.
+
+==============================================================================*/
+template <typename K, typename = void>
+struct hasher_t;
+
+
+template <typename K>
+struct hasher_t<K, typename std::enable_if<std::is_integral<K>::value ||
+                                           std::is_enum<K>::value>::type>
+{
+  uint64_t operator () (K key) const
+  {
+    return hash_mix64(static_cast<uint64_t>(key));
+  }
+};
+
+
+template <typename K>
+struct hasher_t<K *, void>
+{
+  uint64_t operator () (const K *key) const
+  {
+    return hash_mix64(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key)));
+  }
+};
+
+
+template <>
+struct hasher_t<string_t, void>
+{
+  uint64_t operator () (const string_ref_t &key) const
+  {
+    return hash_mix64(hash64(key.data(), key.size()));
+  }
+
+  uint64_t operator () (const string_t &key) const
+  {
+    return hash_mix64(hash64(key.data(), key.size()));
+  }
+
+  uint64_t operator () (const std::string &key) const
+  {
+    return hash_mix64(hash64(key.data(), key.size()));
+  }
+
+  uint64_t operator () (const char *key) const
+  {
+    return hash_mix64(hash64(key, std::strlen(key)));
+  }
+};
+
+
+template <>
+struct hasher_t<string_ref_t, void> : hasher_t<string_t, void> {};
+
+
+
+/*==============================================================================
+
+  Default key comparison for hash_map_t. The string specialization accepts
+  anything convertible to a string_ref_t for heterogeneous lookup.
+
+==============================================================================*/
+template <typename K>
+struct key_equal_t
+{
+  bool operator () (const K &lhs, const K &rhs) const
+  {
+    return lhs == rhs;
+  }
+};
+
+
+template <>
+struct key_equal_t<string_t>
+{
+  bool operator () (const string_ref_t &lhs, const string_ref_t &rhs) const
+  {
+    return lhs == rhs;
+  }
+};
+
+
+template <>
+struct key_equal_t<string_ref_t> : key_equal_t<string_t> {};
+
+
+
+/*==============================================================================
+
+  Open-addressing hash map in the style of Abseil's Swiss tables. Each slot has
+  a one-byte control word holding either an empty/deleted marker or the low 7
+  bits of the key's hash. Lookups probe a group of control bytes at once (16
+  with SSE2, otherwise 8 using plain 64-bit arithmetic) and only compare keys
+  whose 7-bit hash matches, so most probes never touch the slot array.
+
+  Elements are stored inline in one flat array, so there is no per-entry
+  allocation. Like std::unordered_map, any insertion that grows the table
+  invalidates iterators and references; erasing does not. Capacity is always a
+  power of two and the table grows once it is 7/8 full.
+
+  Lookups are templated on the key type so the hasher and key comparison may
+  accept types other than K (see hasher_t<string_t>).
+
+==============================================================================*/
+template <typename K, typename V,
+          typename H = hasher_t<K>,
+          typename E = key_equal_t<K>>
+struct hash_map_t
+{
+  using key_type        = K;
+  using mapped_type     = V;
+  using value_type      = std::pair<const K, V>;
+  using size_type       = size_t;
+  using hasher          = H;
+  using key_equal       = E;
+
+private:
+  using ctrl_t = int8_t;
+
+  static const ctrl_t EMPTY   = -128; // 0b10000000
+  static const ctrl_t DELETED = -2;   // 0b11111110
+
+#if defined(__SSE2__)
+  // Group of 16 control bytes matched with SSE2 compares. Matches are returned
+  // as a bitmask with one bit per byte.
+  struct group_t
+  {
+    static const size_t WIDTH = 16;
+    static const unsigned SHIFT = 0;
+
+    explicit group_t(const ctrl_t *ctrl) :
+      ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl)))
+    {
+      /* nop */
+    }
+
+    uint32_t match(ctrl_t hash) const
+    {
+      return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(hash), ctrl_)));
+    }
+
+    uint32_t match_empty() const
+    {
+      return match(EMPTY);
+    }
+
+    // Empty and deleted are the only control bytes with the high bit set.
+    uint32_t match_empty_or_deleted() const
+    {
+      return static_cast<uint32_t>(_mm_movemask_epi8(ctrl_));
+    }
+
+    __m128i ctrl_;
+  };
+#else
+  // Group of 8 control bytes matched with plain 64-bit arithmetic. Matches are
+  // returned as a mask with the high bit of each matching byte set. match()
+  // may report false positives, which are weeded out by the key comparison.
+  struct group_t
+  {
+    static const size_t WIDTH = 8;
+    static const unsigned SHIFT = 3;
+    static const uint64_t LSBS = 0x0101010101010101ULL;
+    static const uint64_t MSBS = 0x8080808080808080ULL;
+
+    explicit group_t(const ctrl_t *ctrl)
+    {
+      std::memcpy(&ctrl_, ctrl, sizeof(ctrl_));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      ctrl_ = __builtin_bswap64(ctrl_);
+#endif
+    }
+
+    uint64_t match(ctrl_t hash) const
+    {
+      const uint64_t x = ctrl_ ^ (LSBS * static_cast<uint8_t>(hash));
+      return (x - LSBS) & ~x & MSBS;
+    }
+
+    uint64_t match_empty() const
+    {
+      return ctrl_ & ~(ctrl_ << 6) & MSBS;
+    }
+
+    uint64_t match_empty_or_deleted() const
+    {
+      return ctrl_ & MSBS;
+    }
+
+    uint64_t ctrl_;
+  };
+#endif
+
+  static const size_t GROUP_WIDTH = group_t::WIDTH;
+  static const size_t MIN_CAPACITY = GROUP_WIDTH;
+
+  using slot_t = typename std::aligned_storage<sizeof(value_type),
+                                               alignof(value_type)>::type;
+
+  static const size_t npos = ~size_t(0);
+
+
+  template <typename MASK>
+  static inline unsigned lowest_bit(MASK mask)
+  {
+    return static_cast<unsigned>(__builtin_ctzll(mask)) >> group_t::SHIFT;
+  }
+
+  static inline ctrl_t h2(uint64_t hash)
+  {
+    return static_cast<ctrl_t>(hash & 0x7F);
+  }
+
+  static inline size_t h1(uint64_t hash)
+  {
+    return static_cast<size_t>(hash >> 7);
+  }
+
+  static inline bool is_full(ctrl_t ctrl)
+  {
+    return ctrl >= 0;
+  }
+
+  // Maximum number of elements (including tombstones) for a capacity.
+  static inline size_t max_load(size_t capacity)
+  {
+    return capacity - capacity / 8;
+  }
+
+
+public:
+
+  template <bool is_const>
+  struct iterator_base_t
+  {
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = typename hash_map_t::value_type;
+    using difference_type   = ptrdiff_t;
+    using pointer = typename std::conditional<
+      is_const, const value_type *, value_type *>::type;
+    using reference = typename std::conditional<
+      is_const, const value_type &, value_type &>::type;
+
+    iterator_base_t() = default;
+
+    // Allow iterator -> const_iterator conversion
+    template <bool other_const>
+    iterator_base_t(const iterator_base_t<other_const> &other,
+                    typename std::enable_if<is_const && !other_const>::type * = nullptr) :
+      ctrl_(other.ctrl_), end_(other.end_), slot_(other.slot_)
+    {
+      /* nop */
+    }
+
+    reference operator * () const
+    {
+      return *reinterpret_cast<pointer>(slot_);
+    }
+
+    pointer operator -> () const
+    {
+      return reinterpret_cast<pointer>(slot_);
+    }
+
+    iterator_base_t &operator ++ ()
+    {
+      ++ctrl_;
+      ++slot_;
+      skip_empty();
+      return *this;
+    }
+
+    iterator_base_t operator ++ (int dummy)
+    {
+      iterator_base_t cur = *this;
+      ++*this;
+      return cur;
+    }
+
+    template <bool other_const>
+    bool operator == (const iterator_base_t<other_const> &other) const
+    {
+      return ctrl_ == other.ctrl_;
+    }
+
+    template <bool other_const>
+    bool operator != (const iterator_base_t<other_const> &other) const
+    {
+      return ctrl_ != other.ctrl_;
+    }
+
+  private:
+    friend struct hash_map_t;
+    template <bool> friend struct iterator_base_t;
+
+    using slot_ptr_t = typename std::conditional<
+      is_const, const slot_t *, slot_t *>::type;
+
+    iterator_base_t(const ctrl_t *ctrl, const ctrl_t *end, slot_ptr_t slot) :
+      ctrl_(ctrl), end_(end), slot_(slot)
+    {
+      /* nop */
+    }
+
+    void skip_empty()
+    {
+      while (ctrl_ < end_ && !is_full(*ctrl_)) {
+        ++ctrl_;
+        ++slot_;
+      }
+    }
+
+    const ctrl_t *ctrl_ = nullptr;
+    const ctrl_t *end_ = nullptr;
+    slot_ptr_t    slot_ = nullptr;
+  };
+
+  using iterator        = iterator_base_t<false>;
+  using const_iterator  = iterator_base_t<true>;
+
+
+  hash_map_t() = default;
+
+  explicit hash_map_t(size_type reserved)
+  {
+    reserve(reserved);
+  }
+
+  hash_map_t(std::initializer_list<value_type> init)
+  {
+    reserve(init.size());
+    for (const value_type &pair : init) {
+      insert(pair);
+    }
+  }
+
+  hash_map_t(const hash_map_t &other) :
+    hasher_(other.hasher_), equal_(other.equal_)
+  {
+    reserve(other.size_);
+    for (const value_type &pair : other) {
+      insert_unique_nogrow(pair);
+    }
+  }
+
+  hash_map_t(hash_map_t &&other)
+    noexcept(std::is_nothrow_move_constructible<H>::value &&
+             std::is_nothrow_move_constructible<E>::value) :
+    ctrl_(other.ctrl_),
+    slots_(other.slots_),
+    capacity_(other.capacity_),
+    size_(other.size_),
+    deleted_(other.deleted_),
+    hasher_(std::move(other.hasher_)),
+    equal_(std::move(other.equal_))
+  {
+    other.ctrl_ = nullptr;
+    other.slots_ = nullptr;
+    other.capacity_ = 0;
+    other.size_ = 0;
+    other.deleted_ = 0;
+  }
+
+  ~hash_map_t()
+  {
+    destroy_storage();
+  }
+
+  hash_map_t &operator = (const hash_map_t &other)
+  {
+    if (&other != this) {
+      hash_map_t copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+
+  hash_map_t &operator = (hash_map_t &&other)
+    noexcept(std::is_nothrow_move_constructible<H>::value &&
+             std::is_nothrow_move_constructible<E>::value &&
+             std::is_nothrow_move_assignable<H>::value &&
+             std::is_nothrow_move_assignable<E>::value)
+  {
+    if (&other != this) {
+      destroy_storage();
+      hash_map_t temp(std::move(other));
+      swap(temp);
+    }
+    return *this;
+  }
+
+  void swap(hash_map_t &other)
+  {
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    std::swap(deleted_, other.deleted_);
+    std::swap(hasher_, other.hasher_);
+    std::swap(equal_, other.equal_);
+  }
+
+
+  iterator begin()
+  {
+    iterator iter(ctrl_, ctrl_ + capacity_, slots_);
+    iter.skip_empty();
+    return iter;
+  }
+
+  const_iterator begin() const
+  {
+    const_iterator iter(ctrl_, ctrl_ + capacity_, slots_);
+    iter.skip_empty();
+    return iter;
+  }
+
+  const_iterator cbegin() const { return begin(); }
+
+  iterator end()
+  {
+    return iterator(ctrl_ + capacity_, ctrl_ + capacity_, slots_ + capacity_);
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator(ctrl_ + capacity_, ctrl_ + capacity_, slots_ + capacity_);
+  }
+
+  const_iterator cend() const { return end(); }
+
+
+  inline size_type size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline size_type capacity() const { return capacity_; }
+
+  inline float load_factor() const
+  {
+    return capacity_ ? float(size_) / float(capacity_) : 0.0f;
+  }
+
+  inline float max_load_factor() const
+  {
+    return 7.0f / 8.0f;
+  }
+
+
+/*==============================================================================
+  reserve
+
+    Ensures the map can hold at least count elements without growing.
+==============================================================================*/
+  void reserve(size_type count)
+  {
+    if (count > max_load(capacity_) - deleted_) {
+      rehash(count);
+    }
+  }
+
+
+/*==============================================================================
+  rehash
+
+    Rebuilds the table with room for at least count elements (and at least the
+    current size). Also clears out any tombstones left by erase. Passing zero
+    shrinks the table to fit its current contents.
+==============================================================================*/
+  void rehash(size_type count)
+  {
+    if (count < size_) {
+      count = size_;
+    }
+    if (count == 0 && size_ == 0) {
+      destroy_storage();
+      return;
+    }
+    size_t capacity = MIN_CAPACITY;
+    while (max_load(capacity) < count) {
+      capacity <<= 1;
+    }
+    resize(capacity);
+  }
+
+
+/*==============================================================================
+  clear
+
+    Destroys all elements. Keeps the current capacity.
+==============================================================================*/
+  void clear()
+  {
+    if (!capacity_) {
+      return;
+    }
+    destroy_elements();
+    std::memset(ctrl_, EMPTY, capacity_ + GROUP_WIDTH);
+    size_ = 0;
+    deleted_ = 0;
+  }
+
+
+/*==============================================================================
+  find
+
+    Returns an iterator to the element with the given key or end() if there is
+    no such element. The key may be of any type accepted by both the hasher and
+    the key comparison.
+==============================================================================*/
+  template <typename Q>
+  iterator find(const Q &key)
+  {
+    const size_t index = find_index(key, hasher_(key));
+    return index == npos ? end() : iterator_at(index);
+  }
+
+  template <typename Q>
+  const_iterator find(const Q &key) const
+  {
+    const size_t index = find_index(key, hasher_(key));
+    return index == npos ? end() : const_iterator_at(index);
+  }
+
+  template <typename Q>
+  bool contains(const Q &key) const
+  {
+    return find_index(key, hasher_(key)) != npos;
+  }
+
+  template <typename Q>
+  size_type count(const Q &key) const
+  {
+    return contains(key) ? 1 : 0;
+  }
+
+
+/*==============================================================================
+  at
+
+    Returns the value for the given key. Throws std::out_of_range if the key is
+    not in the map.
+==============================================================================*/
+  template <typename Q>
+  V &at(const Q &key)
+  {
+    const size_t index = find_index(key, hasher_(key));
+    if (index == npos) {
+      s_throw(std::out_of_range, "Key is not in map");
+    }
+    return slot_value(index).second;
+  }
+
+  template <typename Q>
+  const V &at(const Q &key) const
+  {
+    const size_t index = find_index(key, hasher_(key));
+    if (index == npos) {
+      s_throw(std::out_of_range, "Key is not in map");
+    }
+    return slot_value(index).second;
+  }
+
+
+/*==============================================================================
+  operator []
+
+    Returns the value for the given key, default-constructing it if the key is
+    not already in the map.
+==============================================================================*/
+  V &operator [] (const K &key)
+  {
+    return emplace(key).first->second;
+  }
+
+  V &operator [] (K &&key)
+  {
+    return emplace(std::move(key)).first->second;
+  }
+
+
+/*==============================================================================
+  emplace
+
+    Inserts a value constructed from args under the given key if the key is not
+    already in the map. Does not construct anything if the key is present.
+    Returns an iterator to the element for the key and whether it was inserted.
+==============================================================================*/
+  template <typename KK, typename... ARGS>
+  std::pair<iterator, bool> emplace(KK &&key, ARGS&&... args)
+  {
+    const uint64_t hash = hasher_(key);
+    size_t index = find_index(key, hash);
+    if (index != npos) {
+      return { iterator_at(index), false };
+    }
+    index = prepare_insert(hash);
+    new(&slots_[index]) value_type(std::piecewise_construct,
+      std::forward_as_tuple(std::forward<KK>(key)),
+      std::forward_as_tuple(std::forward<ARGS>(args)...));
+    return { iterator_at(index), true };
+  }
+
+  std::pair<iterator, bool> insert(const value_type &pair)
+  {
+    return emplace(pair.first, pair.second);
+  }
+
+  std::pair<iterator, bool> insert(value_type &&pair)
+  {
+    return emplace(pair.first, std::move(pair.second));
+  }
+
+
+/*==============================================================================
+  erase
+
+    Removes the element with the given key, if any, and returns the number of
+    elements removed. Erased slots become tombstones until the next rehash.
+==============================================================================*/
+  template <typename Q>
+  size_type erase(const Q &key)
+  {
+    const size_t index = find_index(key, hasher_(key));
+    if (index == npos) {
+      return 0;
+    }
+    erase_index(index);
+    return 1;
+  }
+
+  iterator erase(const_iterator pos)
+  {
+    const size_t index = static_cast<size_t>(pos.ctrl_ - ctrl_);
+    erase_index(index);
+    iterator next = iterator_at(index);
+    next.skip_empty();
+    return next;
+  }
+
+  iterator erase(iterator pos)
+  {
+    return erase(const_iterator(pos));
+  }
+
+
+private:
+
+  inline value_type &slot_value(size_t index)
+  {
+    return *reinterpret_cast<value_type *>(&slots_[index]);
+  }
+
+  inline const value_type &slot_value(size_t index) const
+  {
+    return *reinterpret_cast<const value_type *>(&slots_[index]);
+  }
+
+  inline iterator iterator_at(size_t index)
+  {
+    return iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+  }
+
+  inline const_iterator const_iterator_at(size_t index) const
+  {
+    return const_iterator(ctrl_ + index, ctrl_ + capacity_, slots_ + index);
+  }
+
+
+/*==============================================================================
+  set_ctrl
+
+    Sets a control byte. The first GROUP_WIDTH bytes are mirrored past the end
+    of the control array so that a group load starting anywhere in the table
+    sees the wrapped-around bytes without any bounds checks.
+==============================================================================*/
+  inline void set_ctrl(size_t index, ctrl_t value)
+  {
+    ctrl_[index] = value;
+    if (index < GROUP_WIDTH) {
+      ctrl_[capacity_ + index] = value;
+    }
+  }
+
+
+/*==============================================================================
+  find_index
+
+    Probes groups of control bytes starting at the key's home group, moving by
+    one more group each step (triangular probing visits every group of a
+    power-of-two table). Stops at the first group containing an empty slot.
+==============================================================================*/
+  template <typename Q>
+  size_t find_index(const Q &key, uint64_t hash) const
+  {
+    if (!capacity_) {
+      return npos;
+    }
+    const size_t mask = capacity_ - 1;
+    const ctrl_t tag = h2(hash);
+    size_t pos = h1(hash) & mask;
+    size_t step = 0;
+    for (;;) {
+      const group_t group(ctrl_ + pos);
+      for (auto match = group.match(tag); match; match &= match - 1) {
+        const size_t index = (pos + lowest_bit(match)) & mask;
+        if (equal_(slot_value(index).first, key)) {
+          return index;
+        }
+      }
+      if (group.match_empty()) {
+        return npos;
+      }
+      step += GROUP_WIDTH;
+      pos = (pos + step) & mask;
+    }
+  }
+
+
+/*==============================================================================
+  find_insert_index
+
+    Returns the first empty or deleted slot on the probe sequence for hash.
+    The table must not be full.
+==============================================================================*/
+  size_t find_insert_index(uint64_t hash) const
+  {
+    const size_t mask = capacity_ - 1;
+    size_t pos = h1(hash) & mask;
+    size_t step = 0;
+    for (;;) {
+      const group_t group(ctrl_ + pos);
+      const auto match = group.match_empty_or_deleted();
+      if (match) {
+        return (pos + lowest_bit(match)) & mask;
+      }
+      step += GROUP_WIDTH;
+      pos = (pos + step) & mask;
+    }
+  }
+
+
+/*==============================================================================
+  prepare_insert
+
+    Finds a slot for a new element with the given hash, growing the table if
+    needed, and marks it as used. The caller constructs the element.
+==============================================================================*/
+  size_t prepare_insert(uint64_t hash)
+  {
+    if (size_ + deleted_ + 1 > max_load(capacity_)) {
+      // If tombstones make up a large part of the load, rehashing in place is
+      // enough. Otherwise double.
+      if (capacity_ && size_ + 1 <= max_load(capacity_) / 2) {
+        resize(capacity_);
+      } else {
+        resize(capacity_ ? capacity_ * 2 : MIN_CAPACITY);
+      }
+    }
+    const size_t index = find_insert_index(hash);
+    if (ctrl_[index] == DELETED) {
+      --deleted_;
+    }
+    set_ctrl(index, h2(hash));
+    ++size_;
+    return index;
+  }
+
+
+  void erase_index(size_t index)
+  {
+    slot_value(index).~value_type();
+    set_ctrl(index, DELETED);
+    --size_;
+    ++deleted_;
+  }
+
+
+/*==============================================================================
+  insert_unique_nogrow
+
+    Inserts a copy of a value known not to be in the map into a table known to
+    have room for it. Used when copying maps.
+==============================================================================*/
+  void insert_unique_nogrow(const value_type &value)
+  {
+    const uint64_t hash = hasher_(value.first);
+    const size_t index = find_insert_index(hash);
+    set_ctrl(index, h2(hash));
+    new(&slots_[index]) value_type(value);
+    ++size_;
+  }
+
+
+/*==============================================================================
+  resize
+
+    Moves all elements into a fresh table of the given capacity. Drops all
+    tombstones.
+==============================================================================*/
+  void resize(size_t capacity)
+  {
+    ctrl_t *old_ctrl = ctrl_;
+    slot_t *old_slots = slots_;
+    const size_t old_capacity = capacity_;
+
+    ctrl_ = new ctrl_t[capacity + GROUP_WIDTH];
+    slots_ = static_cast<slot_t *>(::operator new(capacity * sizeof(slot_t)));
+    capacity_ = capacity;
+    deleted_ = 0;
+    std::memset(ctrl_, EMPTY, capacity + GROUP_WIDTH);
+
+    for (size_t index = 0; index < old_capacity; ++index) {
+      if (is_full(old_ctrl[index])) {
+        value_type &value = *reinterpret_cast<value_type *>(&old_slots[index]);
+        const uint64_t hash = hasher_(value.first);
+        const size_t new_index = find_insert_index(hash);
+        set_ctrl(new_index, h2(hash));
+        new(&slots_[new_index]) value_type(std::move(value));
+        value.~value_type();
+      }
+    }
+
+    delete [] old_ctrl;
+    ::operator delete(old_slots);
+  }
+
+
+  void destroy_elements()
+  {
+    if (!std::is_trivially_destructible<value_type>::value) {
+      for (size_t index = 0; index < capacity_; ++index) {
+        if (is_full(ctrl_[index])) {
+          slot_value(index).~value_type();
+        }
+      }
+    }
+  }
+
+
+  void destroy_storage()
+  {
+    if (capacity_) {
+      destroy_elements();
+      delete [] ctrl_;
+      ::operator delete(slots_);
+    }
+    ctrl_ = nullptr;
+    slots_ = nullptr;
+    capacity_ = 0;
+    size_ = 0;
+    deleted_ = 0;
+  }
+
+
+  ctrl_t   *ctrl_ = nullptr;
+  slot_t   *slots_ = nullptr;
+  size_t    capacity_ = 0;
+  size_t    size_ = 0;
+  // Number of tombstones left by erase
+  size_t    deleted_ = 0;
+  hasher    hasher_;
+  key_equal equal_;
+
+}; // struct hash_map_t
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__HASH_MAP_HH__ include guard */
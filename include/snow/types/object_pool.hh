@@ -4,6 +4,10 @@
 #define __SNOW_COMMON__OBJECT_POOL_HH__
 
 #include <snow/config.hh>
+#include <snow/memory/accounting.hh>
+#include <snow/thread.hh>
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <iterator>
@@ -16,22 +20,80 @@
 namespace snow {
 
 
+/*==============================================================================
+
+  A handle to an object in an object_pool_t: the object's index and the
+  generation of its slot when it was allocated. A slot's generation changes
+  every time an object is allocated in it or destroyed, so a handle to a
+  destroyed object never matches the slot again, even after the slot is
+  reused. Validating a handle is a single compare against its slot.
+
+  Generations are 32 bits and advance by two per allocate/destroy cycle of a
+  slot, so a stale handle can only match again after 2^31 reuses of its slot.
+
+==============================================================================*/
+struct object_handle_t
+{
+  uint32_t index = 0;
+  // Odd for a handle to a live object; zero for a null handle.
+  uint32_t generation = 0;
+
+  inline explicit operator bool () const { return generation != 0; }
+
+  inline bool operator == (const object_handle_t &other) const
+  {
+    return index == other.index && generation == other.generation;
+  }
+
+  inline bool operator != (const object_handle_t &other) const
+  {
+    return !(*this == other);
+  }
+};
+
+
+
 // Note: because this is backed by a vector, you _should not_ store pointers or
 // references to objects in the pool. Use the indices to access the objects when
 // you need them. In addition, you can iterate over all allocated objects if
 // you need to, so there's that.
+//
+// Unused slots form an intrusive free list: each holds the index of the next
+// unused slot in place of an object, so allocating and destroying objects are
+// O(1) however fragmented the pool is. The most recently freed slot is reused
+// first.
+//
+// Occupied slots are also tracked in a bitmap, one bit per slot, so iterating
+// skips 64 unused slots at a time: iterating a few live objects in a large,
+// mostly empty pool doesn't touch every slot.
+//
+// Because indices are reused, an index kept past its object's destruction
+// silently refers to whatever is allocated in its slot next. Use handles
+// (allocate_handle, handle_of) where that matters: access through a stale
+// handle fails instead.
 template <typename T, typename IT = size_t, bool THREADSAFE = true>
 struct object_pool_t
 {
   struct store_t {
-    using data_t = typename std::aligned_storage<sizeof(T)>::type;
+    using data_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    // Odd while the slot holds an object. Incremented on allocate and destroy.
+    uint32_t    generation = 0;
+    union {
+      data_t    data;
+      // Next unused slot, when this slot is unused.
+      IT        next_free;
+    };
 
-    uint8_t     used = 0;
-    data_t      data;
+    inline bool used() const { return (generation & 1) != 0; }
   };
 
   using object_t            = T;
   using index_t             = IT;
+  using handle_t            = object_handle_t;
+
+  // Number of slots in each block handed to a thread by parallel_for_each.
+  static const size_t PARALLEL_BLOCK_SLOTS = 1024;
   using objects_t           = std::vector<store_t>;
   using object_iter_t       = std::function<void(object_t &, const index_t &)>;
   using const_object_iter_t = std::function<void(const object_t &, const index_t &)>;
@@ -43,19 +105,17 @@ struct object_pool_t
 
     const object_t *operator -> () const
     {
-      return (object_t *)&iter_->data;
+      return (const object_t *)&pool_->objects_[index_].data;
     }
 
     const object_t &operator * () const
     {
-      return *(object_t *)&iter_->data;
+      return *(const object_t *)&pool_->objects_[index_].data;
     }
 
     const_iterator &operator ++ ()
     {
-      do {
-        ++iter_;
-      } while (iter_ != end_ && !iter_->used);
+      index_ = pool_->next_used(index_ + 1);
       return *this;
     }
 
@@ -68,27 +128,26 @@ struct object_pool_t
 
     bool operator == (const const_iterator &other) const
     {
-      return iter_ == other.iter_;
+      return index_ == other.index_;
     }
 
     bool operator != (const const_iterator &other) const
     {
-      return iter_ != other.iter_;
+      return index_ != other.index_;
     }
 
   protected:
     friend struct object_pool_t;
-    using base_iter = typename objects_t::iterator;
 
-    const_iterator(base_iter iter, base_iter end) :
-      iter_(iter),
-      end_(end)
+    const_iterator(const object_pool_t *pool, size_t index) :
+      pool_(pool),
+      index_(index)
     {
       /* nop */
     }
 
-    base_iter iter_;
-    base_iter end_;
+    const object_pool_t *pool_ = nullptr;
+    size_t index_ = 0;
   };
 
 
@@ -99,12 +158,12 @@ struct object_pool_t
 
     object_t *operator -> ()
     {
-      return (object_t *)&(const_iterator::iter_->data);
+      return (object_t *)&pool()->objects_[const_iterator::index_].data;
     }
 
     object_t &operator * ()
     {
-      return *(object_t *)&(const_iterator::iter_->data);
+      return *(object_t *)&pool()->objects_[const_iterator::index_].data;
     }
 
     iterator &operator ++ ()
@@ -122,70 +181,59 @@ struct object_pool_t
 
   protected:
     friend struct object_pool_t;
-    using base_iter = typename const_iterator::base_iter;
 
-    iterator(base_iter iter, base_iter end) :
-      const_iterator(iter, end)
+    iterator(object_pool_t *pool, size_t index) :
+      const_iterator(pool, index)
     {
       /* nop */
     }
+
+    object_pool_t *pool() const
+    {
+      return const_cast<object_pool_t *>(const_iterator::pool_);
+    }
   };
 
 
 
   iterator begin()
   {
-    auto iter = objects_.begin();
-    auto iter_end = objects_.end();
-    while (!iter->used && iter != iter_end) {
-      ++iter;
-    }
-    return iterator(iter, iter_end);
+    return iterator(this, next_used(0));
   }
 
 
 
   const_iterator begin() const
   {
-    auto iter = objects_.begin();
-    auto iter_end = objects_.end();
-    while (!iter->used && iter != iter_end) {
-      ++iter;
-    }
-    return iterator(iter, iter_end);
+    return const_iterator(this, next_used(0));
   }
 
 
 
   const_iterator cbegin() const
   {
-    auto iter = objects_.begin();
-    auto iter_end = objects_.end();
-    while (!iter->used && iter != iter_end) {
-      ++iter;
-    }
-    return iterator(iter, iter_end);
+    return begin();
   }
 
 
 
   iterator end()
   {
-    return iterator(objects_.end(), objects_.end());
+    return iterator(this, objects_.size());
   }
 
 
 
   const_iterator end() const
   {
-    return iterator(objects_.end(), objects_.end());
+    return const_iterator(this, objects_.size());
   }
 
 
 
   const_iterator cend() const
   {
-    return iterator(objects_.end(), objects_.end());
+    return end();
   }
 
 
@@ -224,7 +272,9 @@ struct object_pool_t
 ==============================================================================*/
   void reserve(size_t num_objects)
   {
+    std::lock_guard<lock_t> lock(lock_);
     objects_.reserve(num_objects);
+    s_memory_usage_update(storage_usage_, storage_bytes());
   }
 
 
@@ -256,17 +306,20 @@ struct object_pool_t
   {
     index_t index;
     std::lock_guard<lock_t> lock(lock_);
-    index = next_unused_;
-    const size_t length = objects_.size();
-    for (; index < length; ++index) {
-      if (!objects_[index].used) {
-        goto construct_object_at_index;
+    if (free_head_ != NO_INDEX) {
+      index = free_head_;
+      free_head_ = objects_[index].next_free;
+    } else {
+      index = index_t(objects_.size());
+      objects_.emplace_back();
+      if (objects_.size() > occupied_.size() * 64) {
+        occupied_.push_back(0);
       }
+      s_memory_usage_update(storage_usage_, storage_bytes());
     }
-    next_unused_ = (index = index_t(length)) + 1;
-    objects_.emplace_back();
-construct_object_at_index:
-    objects_[index].used = 1;
+    ++objects_[index].generation;
+    set_occupied(index, true);
+    ++live_count_;
     return index;
   }
 
@@ -284,15 +337,16 @@ construct_object_at_index:
     throw_unallocated(index);
 
     store_t &store = objects_[index];
-    store.used = 0;
+    ++store.generation;
+    set_occupied(index, false);
 
     if (!std::is_pod<object_t>::value) {
       ((object_t *)&store.data)->~object_t();
     }
 
-    if (next_unused_ > index) {
-      next_unused_ = index;
-    }
+    store.next_free = free_head_;
+    free_head_ = index;
+    --live_count_;
   }
 
 
@@ -301,20 +355,25 @@ construct_object_at_index:
   index_of
 
     Gets the index of an object, if it's in the pool. Only tests for whether the
-    object address matches that of one in the pool.
+    object address matches that of an allocated object in the pool, which is
+    computed from the address rather than searched for.
 ==============================================================================*/
   std::pair<bool, index_t> index_of(const object_t &obj) const
   {
     std::pair<bool, index_t> result { false, 0 };
     std::lock_guard<lock_t> lock(lock_);
-    const object_t *addr = &obj;
-    index_t index = 0;
-    const auto length = objects_.size();
-    for (; index < length; ++index) {
-      if (ptr_for_index(index) == addr) {
-        result = { true, index };
-        break;
-      }
+    if (objects_.empty()) {
+      return result;
+    }
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(&obj);
+    const uintptr_t first = reinterpret_cast<uintptr_t>(&objects_.front().data);
+    if (addr < first) {
+      return result;
+    }
+    const uintptr_t offset = addr - first;
+    const size_t index = offset / sizeof(store_t);
+    if (offset % sizeof(store_t) == 0 && index < objects_.size() && objects_[index].used()) {
+      result = { true, index_t(index) };
     }
     return result;
   }
@@ -372,6 +431,134 @@ construct_object_at_index:
 
 
 
+/*==============================================================================
+  allocate_handle
+
+    Same as allocate, but returns a handle to the new object.
+==============================================================================*/
+  template <typename... ARGS>
+  handle_t allocate_handle(ARGS&&... args)
+  {
+    return handle_of(allocate(std::forward<ARGS>(args)...));
+  }
+
+
+
+/*==============================================================================
+  handle_of
+
+    Returns a handle to the object at the given index. Throws an exception if
+    the index doesn't match an allocated object.
+==============================================================================*/
+  handle_t handle_of(const index_t index) const
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    throw_unallocated(index);
+    if (size_t(index) > UINT32_MAX) {
+      s_throw(std::out_of_range, "Index is too large for a handle");
+    }
+    handle_t handle;
+    handle.index = uint32_t(index);
+    handle.generation = objects_[index].generation;
+    return handle;
+  }
+
+
+
+/*==============================================================================
+  get
+
+    Returns a pointer to the object a handle refers to, or null if the handle
+    is stale or null. Validating the handle is a bounds check and a compare of
+    the handle's generation against its slot's.
+==============================================================================*/
+  object_t *get(const handle_t handle)
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    return (object_t *)data_for_handle(handle);
+  }
+
+
+
+  const object_t *get(const handle_t handle) const
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    return (const object_t *)data_for_handle(handle);
+  }
+
+
+
+/*==============================================================================
+  valid
+
+    Returns whether a handle refers to a live object.
+==============================================================================*/
+  bool valid(const handle_t handle) const
+  {
+    return get(handle) != nullptr;
+  }
+
+
+
+/*==============================================================================
+  at (handle)
+
+    Gets the object a handle refers to. Throws an exception if the handle is
+    stale or null.
+==============================================================================*/
+  object_t &at(const handle_t handle)
+  {
+    object_t *obj = get(handle);
+    if (!obj) {
+      s_throw(std::out_of_range, "Handle does not refer to a live object");
+    }
+    return *obj;
+  }
+
+
+
+  const object_t &at(const handle_t handle) const
+  {
+    const object_t *obj = get(handle);
+    if (!obj) {
+      s_throw(std::out_of_range, "Handle does not refer to a live object");
+    }
+    return *obj;
+  }
+
+
+
+  object_t &operator [](const handle_t handle)
+  {
+    return at(handle);
+  }
+
+
+
+  const object_t &operator [](const handle_t handle) const
+  {
+    return at(handle);
+  }
+
+
+
+/*==============================================================================
+  destroy (handle)
+
+    Destroys the object a handle refers to. Throws an exception if the handle
+    is stale or null.
+==============================================================================*/
+  void destroy(const handle_t handle)
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    if (!data_for_handle(handle)) {
+      s_throw(std::out_of_range, "Handle does not refer to a live object");
+    }
+    destroy(index_t(handle.index));
+  }
+
+
+
 /*==============================================================================
   each_object
 
@@ -383,13 +570,9 @@ construct_object_at_index:
   void each_object(object_iter_t &iter)
   {
     std::lock_guard<lock_t> lock(lock_);
-    index_t index = 0;
     const size_t size = objects_.size();
-    for (; index < size; ++index) {
-      store_t &store = objects_[index];
-      if (store.used) {
-        iter(*(object_t *)&store.data, index);
-      }
+    for (size_t index = next_used(0); index < size; index = next_used(index + 1)) {
+      iter(*(object_t *)&objects_[index].data, index_t(index));
     }
   }
 
@@ -404,32 +587,75 @@ construct_object_at_index:
   void each_object_const(const const_object_iter_t &iter) const
   {
     std::lock_guard<lock_t> lock(lock_);
-    index_t index = 0;
     const size_t size = objects_.size();
-    for (; index < size; ++index) {
-      store_t &store = objects_[index];
-      if (store.used) {
-        iter(*(object_t *)&store.data, index);
-      }
+    for (size_t index = next_used(0); index < size; index = next_used(index + 1)) {
+      iter(*(const object_t *)&objects_[index].data, index_t(index));
     }
   }
 
 
 
+/*==============================================================================
+  parallel_for_each
+
+    Calls func(object, index) for each allocated object in the pool, spread
+    across up to num_threads threads of workers, or of the shared worker set if
+    workers is null (see parallel_for_blocks). func is called directly, not
+    through a std::function.
+
+    The slots are split into blocks of PARALLEL_BLOCK_SLOTS, a multiple of 64
+    so that no two blocks share a word of the occupancy bitmap or a cache line
+    of slots (relative to the start of the slot array). Threads take blocks
+    from their own run and steal from others once it's exhausted.
+
+    The pool's lock is held by the calling thread until every object has been
+    visited. func must not allocate or destroy objects, or call any pool
+    method that takes the lock -- from another thread, that deadlocks.
+==============================================================================*/
+  template <typename FN>
+  void parallel_for_each(FN &&func, unsigned num_threads = 0,
+                         worker_threads_t *workers = nullptr)
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    const size_t num_blocks = (objects_.size() + PARALLEL_BLOCK_SLOTS - 1) / PARALLEL_BLOCK_SLOTS;
+    parallel_for_blocks(num_blocks, [&](size_t block) {
+      for_each_block<object_t>(block, func);
+    }, num_threads, workers);
+  }
+
+
+
+  template <typename FN>
+  void parallel_for_each(FN &&func, unsigned num_threads = 0,
+                         worker_threads_t *workers = nullptr) const
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    const size_t num_blocks = (objects_.size() + PARALLEL_BLOCK_SLOTS - 1) / PARALLEL_BLOCK_SLOTS;
+    parallel_for_blocks(num_blocks, [&](size_t block) {
+      for_each_block<const object_t>(block, func);
+    }, num_threads, workers);
+  }
+
+
+
 /*==============================================================================
   clear
 
     Wipes out all objects in the collection. Does call the dtor on each object
-    in the pool. This does not assure anything with respect to memory usage.
+    in the pool. This does not assure anything with respect to memory usage --
+    slots are kept, with their generations, so handles from before the clear
+    stay invalid.
 ==============================================================================*/
   void clear()
   {
     std::lock_guard<lock_t> lock(lock_);
-    if (!std::is_pod<object_t>::value) {
-      destroy_all_nolock();
+    destroy_all_nolock();
+    free_head_ = NO_INDEX;
+    for (size_t index = objects_.size(); index > 0; --index) {
+      objects_[index - 1].next_free = free_head_;
+      free_head_ = index_t(index - 1);
     }
-    objects_.clear();
-    next_unused_ = 0;
+    live_count_ = 0;
   }
 
 
@@ -442,16 +668,7 @@ construct_object_at_index:
   size_t size() const
   {
     std::lock_guard<lock_t> lock(lock_);
-    size_t count = 0;
-    index_t index = 0;
-    const size_t size = objects_.size();
-    for (; index < size; ++index) {
-      store_t &store = objects_[index];
-      if (store.used) {
-        ++count;
-      }
-    }
-    return count;
+    return live_count_;
   }
 
 
@@ -478,15 +695,95 @@ private:
 ==============================================================================*/
   void destroy_all_nolock()
   {
-    const auto length = objects_.size();
-    for (int index = 0; index < length; ++index) {
+    const size_t length = objects_.size();
+    for (size_t index = next_used(0); index < length; index = next_used(index + 1)) {
       store_t &store = objects_[index];
-      if (store.used) {
-        store.used = 0;
+      ++store.generation;
+      if (!std::is_pod<object_t>::value) {
         ((object_t *)&store.data)->~object_t();
       }
     }
-    next_unused_ = 0;
+    std::fill(occupied_.begin(), occupied_.end(), 0);
+  }
+
+
+
+/*==============================================================================
+  storage_bytes
+
+    Returns the bytes held by the pool's slots and occupancy bitmap.
+==============================================================================*/
+  size_t storage_bytes() const
+  {
+    return objects_.capacity() * sizeof(store_t) + occupied_.capacity() * sizeof(uint64_t);
+  }
+
+
+
+/*==============================================================================
+  set_occupied
+
+    Sets or clears the occupancy bit for a slot.
+==============================================================================*/
+  void set_occupied(size_t index, bool used)
+  {
+    const uint64_t bit = uint64_t(1) << (index & 63);
+    if (used) {
+      occupied_[index >> 6] |= bit;
+    } else {
+      occupied_[index >> 6] &= ~bit;
+    }
+  }
+
+
+
+/*==============================================================================
+  next_used
+
+    Returns the index of the first used slot at or after from and before
+    limit, or limit if there is none. Scans the occupancy bitmap a word at a
+    time. limit defaults to the number of slots.
+==============================================================================*/
+  size_t next_used(size_t from) const
+  {
+    return next_used(from, objects_.size());
+  }
+
+
+
+  size_t next_used(size_t from, size_t limit) const
+  {
+    if (from >= limit) {
+      return limit;
+    }
+    const size_t last_word = (limit - 1) >> 6;
+    size_t word = from >> 6;
+    uint64_t bits = occupied_[word] & (~uint64_t(0) << (from & 63));
+    while (bits == 0) {
+      if (++word > last_word) {
+        return limit;
+      }
+      bits = occupied_[word];
+    }
+    const size_t index = (word << 6) + size_t(__builtin_ctzll(bits));
+    return index < limit ? index : limit;
+  }
+
+
+
+/*==============================================================================
+  for_each_block
+
+    Calls func for each allocated object in the slots of one parallel block.
+==============================================================================*/
+  template <typename OBJ, typename FN>
+  void for_each_block(size_t block, FN &func) const
+  {
+    const size_t first = block * PARALLEL_BLOCK_SLOTS;
+    const size_t end = std::min(first + PARALLEL_BLOCK_SLOTS, objects_.size());
+    for (size_t index = next_used(first, end); index < end; index = next_used(index + 1, end)) {
+      func(*(OBJ *)&objects_[index].data, index_t(index));
+    }
   }
 
 
@@ -498,13 +795,32 @@ private:
 ==============================================================================*/
   void throw_unallocated(index_t index) const
   {
-    if (!objects_.at(index).used) {
+    if (!objects_.at(index).used()) {
       s_throw(std::out_of_range, "Index is out of range");
     }
   }
 
 
 
+/*==============================================================================
+  data_for_handle
+
+    Returns the storage for the object a handle refers to, or null if the
+    handle doesn't match its slot's generation. A slot's generation is odd
+    only while it's used and handle generations are always odd, so this also
+    rejects unused slots and null handles.
+==============================================================================*/
+  const void *data_for_handle(const handle_t handle) const
+  {
+    if (handle.index >= objects_.size()) {
+      return nullptr;
+    }
+    const store_t &store = objects_[handle.index];
+    return store.generation == handle.generation && handle.generation != 0 ? &store.data : nullptr;
+  }
+
+
+
 /*==============================================================================
   ptr_for_index
 
@@ -546,9 +862,19 @@ private:
   using lock_t = typename std::conditional<THREADSAFE, std::recursive_mutex, dummylock_t>::type;
 
 
+  // Marks the end of the free list.
+  static constexpr index_t NO_INDEX = index_t(~index_t(0));
+
   objects_t         objects_;
-  index_t           next_unused_ = ~0;
+  // One bit per slot, set while the slot holds an object.
+  std::vector<uint64_t> occupied_;
+  // First unused slot, or NO_INDEX if every slot is in use.
+  index_t           free_head_ = NO_INDEX;
+  size_t            live_count_ = 0;
   mutable lock_t    lock_;
+#if USE_MEMORY_ACCOUNTING
+  memory_usage_t    storage_usage_ { MEMORY_OBJECT_POOL };
+#endif
 
 }; // struct object_pool_t
 
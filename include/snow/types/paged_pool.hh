@@ -0,0 +1,595 @@
+// paged_pool.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__PAGED_POOL_HH__
+#define __SNOW_COMMON__PAGED_POOL_HH__
+
+#include <snow/config.hh>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+namespace snow {
+
+
+// A variant of object_pool_t that stores its objects in fixed-size pages
+// instead of one vector. Pages are never moved or freed while the pool is
+// alive, so pointers and references to objects remain valid until the object
+// is destroyed, regardless of how many objects are allocated after it.
+// Growing the pool allocates one page; existing objects are never copied.
+//
+// An index is a (page, slot) pair packed as page * PAGE_SIZE + slot, so
+// PAGE_SIZE must be a power of two. Like object_pool_t, unused slots form an
+// intrusive free list and the most recently freed slot is reused first.
+template <typename T, typename IT = size_t, size_t PAGE_SIZE = 4096, bool THREADSAFE = true>
+struct paged_pool_t
+{
+  static_assert(PAGE_SIZE > 0 && (PAGE_SIZE & (PAGE_SIZE - 1)) == 0,
+                "paged_pool_t PAGE_SIZE must be a power of two");
+
+  struct store_t {
+    using data_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    uint8_t     used = 0;
+    union {
+      data_t    data;
+      // Next unused slot, when this slot is unused.
+      IT        next_free;
+    };
+  };
+
+  using object_t            = T;
+  using index_t             = IT;
+  using page_t              = std::unique_ptr<store_t[]>;
+  using object_iter_t       = std::function<void(object_t &, const index_t &)>;
+  using const_object_iter_t = std::function<void(const object_t &, const index_t &)>;
+
+  static constexpr size_t page_size = PAGE_SIZE;
+
+
+  struct const_iterator : public std::iterator<object_t, std::input_iterator_tag>
+  {
+    const_iterator() = default;
+
+    const object_t *operator -> () const
+    {
+      return (const object_t *)&pool_->store_at(index_).data;
+    }
+
+    const object_t &operator * () const
+    {
+      return *(const object_t *)&pool_->store_at(index_).data;
+    }
+
+    const_iterator &operator ++ ()
+    {
+      do {
+        ++index_;
+      } while (index_ != end_ && !pool_->store_at(index_).used);
+      return *this;
+    }
+
+    const_iterator operator ++ (int dummy)
+    {
+      const_iterator cur = *this;
+      ++*this;
+      return cur;
+    }
+
+    bool operator == (const const_iterator &other) const
+    {
+      return index_ == other.index_;
+    }
+
+    bool operator != (const const_iterator &other) const
+    {
+      return index_ != other.index_;
+    }
+
+  protected:
+    friend struct paged_pool_t;
+
+    const_iterator(const paged_pool_t *pool, size_t index, size_t end) :
+      pool_(pool),
+      index_(index),
+      end_(end)
+    {
+      /* nop */
+    }
+
+    const paged_pool_t *pool_ = nullptr;
+    size_t index_ = 0;
+    size_t end_ = 0;
+  };
+
+
+
+  struct iterator : public const_iterator
+  {
+    iterator() = default;
+
+    object_t *operator -> ()
+    {
+      return (object_t *)&const_iterator::pool_->store_at(const_iterator::index_).data;
+    }
+
+    object_t &operator * ()
+    {
+      return *(object_t *)&const_iterator::pool_->store_at(const_iterator::index_).data;
+    }
+
+    iterator &operator ++ ()
+    {
+      const_iterator::operator++();
+      return *this;
+    }
+
+    iterator operator ++ (int)
+    {
+      iterator cur = *this;
+      const_iterator::operator++();
+      return cur;
+    }
+
+  protected:
+    friend struct paged_pool_t;
+
+    iterator(const paged_pool_t *pool, size_t index, size_t end) :
+      const_iterator(pool, index, end)
+    {
+      /* nop */
+    }
+  };
+
+
+
+  iterator begin()
+  {
+    return iterator(this, first_used(), high_water_);
+  }
+
+
+
+  const_iterator begin() const
+  {
+    return const_iterator(this, first_used(), high_water_);
+  }
+
+
+
+  const_iterator cbegin() const
+  {
+    return begin();
+  }
+
+
+
+  iterator end()
+  {
+    return iterator(this, high_water_, high_water_);
+  }
+
+
+
+  const_iterator end() const
+  {
+    return const_iterator(this, high_water_, high_water_);
+  }
+
+
+
+  const_iterator cend() const
+  {
+    return end();
+  }
+
+
+
+  paged_pool_t()
+  {
+    /* nop */
+  }
+
+
+
+  paged_pool_t(size_t reserved)
+  {
+    reserve(reserved);
+  }
+
+
+
+  paged_pool_t(const paged_pool_t &) = delete;
+  paged_pool_t &operator = (const paged_pool_t &) = delete;
+
+
+
+/*==============================================================================
+  dtor
+
+    Destroys the pool and calls the destructor for any uncollected objects in
+    the pool.
+==============================================================================*/
+  ~paged_pool_t()
+  {
+    clear();
+  }
+
+
+
+/*==============================================================================
+  reserve
+
+    Allocates enough pages to hold the given number of objects.
+==============================================================================*/
+  void reserve(size_t num_objects)
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    while (pages_.size() * PAGE_SIZE < num_objects) {
+      add_page();
+    }
+  }
+
+
+
+/*==============================================================================
+  allocate
+
+    Reserves an object in the pool and constructs it. Arguments correspond to
+    whatever constructor of the pool's object type they match. Returns the
+    object's index.
+==============================================================================*/
+  template <typename... ARGS>
+  index_t allocate(ARGS&&... args)
+  {
+    index_t index;
+    store_t *store;
+    {
+      std::lock_guard<lock_t> lock(lock_);
+      store = &take_slot(index);
+    }
+    // Pages don't move, so the slot can be constructed outside the lock.
+    new(&store->data) object_t(std::forward<ARGS>(args)...);
+    return index;
+  }
+
+
+
+/*==============================================================================
+  make_storage
+
+    Reserves an object in the pool. Does not construct the object at all,
+    simply returns its index.
+==============================================================================*/
+  index_t make_storage()
+  {
+    index_t index;
+    std::lock_guard<lock_t> lock(lock_);
+    take_slot(index);
+    return index;
+  }
+
+
+
+/*==============================================================================
+  destroy
+
+    Collects an object's index, calls its dtor, and prepares it to be reused
+    later.
+==============================================================================*/
+  void destroy(const index_t index)
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    throw_unallocated(index);
+
+    store_t &store = store_at(index);
+    store.used = 0;
+
+    if (!std::is_pod<object_t>::value) {
+      ((object_t *)&store.data)->~object_t();
+    }
+
+    store.next_free = free_head_;
+    free_head_ = index;
+    --live_count_;
+  }
+
+
+
+/*==============================================================================
+  index_of
+
+    Gets the index of an object, if it's in the pool. Only tests for whether the
+    object address matches that of an allocated object in the pool. Checks each
+    page's address range, so this is linear in the number of pages rather than
+    the number of objects.
+==============================================================================*/
+  std::pair<bool, index_t> index_of(const object_t &obj) const
+  {
+    std::pair<bool, index_t> result { false, 0 };
+    std::lock_guard<lock_t> lock(lock_);
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(&obj);
+    const size_t num_pages = pages_.size();
+    for (size_t page = 0; page < num_pages; ++page) {
+      const uintptr_t first = reinterpret_cast<uintptr_t>(&pages_[page][0].data);
+      if (addr < first || addr >= first + PAGE_SIZE * sizeof(store_t)) {
+        continue;
+      }
+      const uintptr_t offset = addr - first;
+      const size_t index = page * PAGE_SIZE + offset / sizeof(store_t);
+      if (offset % sizeof(store_t) == 0 && index < high_water_ && store_at(index).used) {
+        result = { true, index_t(index) };
+      }
+      break;
+    }
+    return result;
+  }
+
+
+
+/*==============================================================================
+  at
+
+    Gets an object at the given index. Will throw an exception if the index
+    doesn't match an allocated object. The reference remains valid until the
+    object is destroyed.
+==============================================================================*/
+  object_t &at(const index_t index)
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    throw_unallocated(index);
+    return *(object_t *)&store_at(index).data;
+  }
+
+
+
+  const object_t &at(const index_t index) const
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    throw_unallocated(index);
+    return *(const object_t *)&store_at(index).data;
+  }
+
+
+
+/*==============================================================================
+  operator []
+
+    See 'at'
+==============================================================================*/
+  object_t &operator [](const index_t index)
+  {
+    return at(index);
+  }
+
+
+
+  const object_t &operator [](const index_t index) const
+  {
+    return at(index);
+  }
+
+
+
+/*==============================================================================
+  each_object
+
+    Calls the object iter function for each allocated object in the pool. The
+    iter function must not cause any objects other than the one currently being
+    evaluated to be collected.
+==============================================================================*/
+  void each_object(const object_iter_t &iter)
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    for (size_t index = 0; index < high_water_; ++index) {
+      store_t &store = store_at(index);
+      if (store.used) {
+        iter(*(object_t *)&store.data, index_t(index));
+      }
+    }
+  }
+
+
+
+/*==============================================================================
+  each_object_const
+
+    Same as each_object.
+==============================================================================*/
+  void each_object_const(const const_object_iter_t &iter) const
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    for (size_t index = 0; index < high_water_; ++index) {
+      const store_t &store = store_at(index);
+      if (store.used) {
+        iter(*(const object_t *)&store.data, index_t(index));
+      }
+    }
+  }
+
+
+
+/*==============================================================================
+  clear
+
+    Destroys all objects in the pool. Pages are kept for reuse; they're only
+    freed when the pool is destroyed.
+==============================================================================*/
+  void clear()
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    for (size_t index = 0; index < high_water_; ++index) {
+      store_t &store = store_at(index);
+      if (store.used) {
+        store.used = 0;
+        if (!std::is_pod<object_t>::value) {
+          ((object_t *)&store.data)->~object_t();
+        }
+      }
+    }
+    high_water_ = 0;
+    free_head_ = NO_INDEX;
+    live_count_ = 0;
+  }
+
+
+
+/*==============================================================================
+  size
+
+    Returns the total number of allocated objects in the pool.
+==============================================================================*/
+  size_t size() const
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    return live_count_;
+  }
+
+
+
+/*==============================================================================
+  capacity
+
+    Returns the number of objects the pool can hold without adding a page.
+==============================================================================*/
+  size_t capacity() const
+  {
+    std::lock_guard<lock_t> lock(lock_);
+    return pages_.size() * PAGE_SIZE;
+  }
+
+
+
+private:
+
+  static constexpr size_t log2(size_t value)
+  {
+    return value <= 1 ? 0 : 1 + log2(value >> 1);
+  }
+
+  static constexpr size_t PAGE_SHIFT = log2(PAGE_SIZE);
+  static constexpr size_t SLOT_MASK = PAGE_SIZE - 1;
+
+/*==============================================================================
+  store_at
+
+    Returns the slot for an index without checking it.
+==============================================================================*/
+  store_t &store_at(size_t index)
+  {
+    return pages_[index >> PAGE_SHIFT][index & SLOT_MASK];
+  }
+
+
+
+  const store_t &store_at(size_t index) const
+  {
+    return pages_[index >> PAGE_SHIFT][index & SLOT_MASK];
+  }
+
+
+
+/*==============================================================================
+  add_page
+
+    Appends an unused page. Only the page table grows, so no object moves.
+==============================================================================*/
+  void add_page()
+  {
+    pages_.emplace_back(new store_t[PAGE_SIZE]);
+  }
+
+
+
+/*==============================================================================
+  take_slot
+
+    Pops a slot off the free list, or takes the next untouched slot if the list
+    is empty, and marks it used. Must be called with the lock held.
+==============================================================================*/
+  store_t &take_slot(index_t &index)
+  {
+    if (free_head_ != NO_INDEX) {
+      index = free_head_;
+      free_head_ = store_at(index).next_free;
+    } else {
+      if (high_water_ == pages_.size() * PAGE_SIZE) {
+        add_page();
+      }
+      index = index_t(high_water_++);
+    }
+    store_t &store = store_at(index);
+    store.used = 1;
+    ++live_count_;
+    return store;
+  }
+
+
+
+/*==============================================================================
+  first_used
+
+    Returns the index of the first used slot, or high_water_ if there is none.
+==============================================================================*/
+  size_t first_used() const
+  {
+    size_t index = 0;
+    while (index < high_water_ && !store_at(index).used) {
+      ++index;
+    }
+    return index;
+  }
+
+
+
+/*==============================================================================
+  throw_unallocated
+
+    Throws an out_of_range exception if the given index isn't already allocated.
+==============================================================================*/
+  void throw_unallocated(index_t index) const
+  {
+    if (size_t(index) >= high_water_ || !store_at(index).used) {
+      s_throw(std::out_of_range, "Index is out of range");
+    }
+  }
+
+
+
+/*==============================================================================
+
+  Dummy lock type that implements the BasicLockable concept. lock and unlock are
+  no-ops.
+
+==============================================================================*/
+  struct dummylock_t {
+    void lock() {}
+    void unlock() {}
+  };
+
+
+  using lock_t = typename std::conditional<THREADSAFE, std::recursive_mutex, dummylock_t>::type;
+
+
+  // Marks the end of the free list.
+  static constexpr index_t NO_INDEX = index_t(~index_t(0));
+
+  std::vector<page_t> pages_;
+  // Number of slots ever handed out; slots past this are untouched.
+  size_t            high_water_ = 0;
+  // First unused slot below high_water_, or NO_INDEX if every slot is in use.
+  index_t           free_head_ = NO_INDEX;
+  size_t            live_count_ = 0;
+  mutable lock_t    lock_;
+
+}; // struct paged_pool_t
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__PAGED_POOL_HH__ include guard */
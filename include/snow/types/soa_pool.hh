@@ -0,0 +1,432 @@
+// soa_pool.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__SOA_POOL_HH__
+#define __SNOW_COMMON__SOA_POOL_HH__
+
+#include <snow/config.hh>
+#include <snow/types/object_pool.hh>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace snow {
+
+
+/*==============================================================================
+
+  A structure-of-arrays pool for component data. Each object is a set of
+  fields, one of each of FIELDS, and each field is stored in its own
+  contiguous, cache-line-aligned array.
+
+  Live objects are kept packed at the front of the arrays: destroying an
+  object moves the last object into its place. A loop over field<N>() from 0
+  to size() therefore touches only live objects and only the fields it uses,
+  and simple loops over it auto-vectorize.
+
+  Because objects move, they're identified by handles, which stay valid
+  until the object is destroyed (see object_handle_t). The packed position of
+  an object -- its dense index -- is only stable until the next destroy.
+
+  Not thread-safe.
+
+==============================================================================*/
+template <typename... FIELDS>
+struct soa_pool_t
+{
+  static_assert(sizeof...(FIELDS) > 0, "soa_pool_t requires at least one field");
+
+  using handle_t = object_handle_t;
+
+  template <size_t N>
+  using field_t = typename std::tuple_element<N, std::tuple<FIELDS...>>::type;
+
+  static const size_t NUM_FIELDS = sizeof...(FIELDS);
+  /** Alignment of each field array. */
+  static const size_t ALIGNMENT = 64;
+
+
+  soa_pool_t()
+  {
+    for (size_t index = 0; index < NUM_FIELDS; ++index) {
+      columns_[index] = nullptr;
+    }
+  }
+
+
+
+  explicit soa_pool_t(size_t reserved) : soa_pool_t()
+  {
+    reserve(reserved);
+  }
+
+
+
+  soa_pool_t(const soa_pool_t &) = delete;
+  soa_pool_t &operator = (const soa_pool_t &) = delete;
+
+
+
+/*==============================================================================
+  dtor
+
+    Destroys all objects in the pool.
+==============================================================================*/
+  ~soa_pool_t()
+  {
+    clear();
+  }
+
+
+
+/*==============================================================================
+  reserve
+
+    Grows every field array to hold at least the given number of objects.
+==============================================================================*/
+  void reserve(size_t num_objects)
+  {
+    if (num_objects > capacity_) {
+      grow(num_objects, indices_t());
+    }
+  }
+
+
+
+/*==============================================================================
+  allocate
+
+    Adds an object with the given field values, or with value-initialized
+    fields if none are given, and returns a handle to it.
+==============================================================================*/
+  handle_t allocate()
+  {
+    const size_t dense = push_slot();
+    construct_fields(dense, indices_t());
+    return handle_at(dense);
+  }
+
+
+
+  handle_t allocate(const FIELDS &... values)
+  {
+    const size_t dense = push_slot();
+    construct_fields(dense, indices_t(), values...);
+    return handle_at(dense);
+  }
+
+
+
+/*==============================================================================
+  destroy
+
+    Destroys the object a handle refers to, moving the last object in the pool
+    into its place. Throws std::out_of_range if the handle is stale.
+==============================================================================*/
+  void destroy(const handle_t handle)
+  {
+    const size_t dense = index_of(handle);
+    const size_t last = size_ - 1;
+    if (dense != last) {
+      move_fields(last, dense, indices_t());
+      dense_slots_[dense] = dense_slots_[last];
+      slots_[dense_slots_[dense]].dense = uint32_t(dense);
+    }
+    destroy_fields(last, indices_t());
+    dense_slots_.pop_back();
+    --size_;
+
+    slot_t &slot = slots_[handle.index];
+    ++slot.generation;
+    slot.dense = free_head_;
+    free_head_ = handle.index;
+  }
+
+
+
+/*==============================================================================
+  valid
+
+    Returns whether a handle refers to a live object.
+==============================================================================*/
+  bool valid(const handle_t handle) const
+  {
+    return handle.index < slots_.size() &&
+           handle.generation != 0 &&
+           slots_[handle.index].generation == handle.generation;
+  }
+
+
+
+/*==============================================================================
+  index_of
+
+    Returns the dense index of the object a handle refers to. Throws
+    std::out_of_range if the handle is stale.
+==============================================================================*/
+  size_t index_of(const handle_t handle) const
+  {
+    if (!valid(handle)) {
+      s_throw(std::out_of_range, "Handle does not refer to a live object");
+    }
+    return slots_[handle.index].dense;
+  }
+
+
+
+/*==============================================================================
+  handle_at
+
+    Returns a handle to the object at the given dense index.
+==============================================================================*/
+  handle_t handle_at(size_t dense) const
+  {
+    if (dense >= size_) {
+      s_throw(std::out_of_range, "Index is out of range");
+    }
+    handle_t handle;
+    handle.index = dense_slots_[dense];
+    handle.generation = slots_[handle.index].generation;
+    return handle;
+  }
+
+
+
+/*==============================================================================
+  field
+
+    Returns the packed array of field N. Elements 0 through size() - 1 are the
+    live objects' fields. The pointer is invalidated by anything that grows
+    the pool.
+==============================================================================*/
+  template <size_t N>
+  field_t<N> *field()
+  {
+    return static_cast<field_t<N> *>(columns_[N]);
+  }
+
+
+
+  template <size_t N>
+  const field_t<N> *field() const
+  {
+    return static_cast<const field_t<N> *>(columns_[N]);
+  }
+
+
+
+/*==============================================================================
+  get
+
+    Returns field N of the object a handle refers to.
+==============================================================================*/
+  template <size_t N>
+  field_t<N> &get(const handle_t handle)
+  {
+    return field<N>()[index_of(handle)];
+  }
+
+
+
+  template <size_t N>
+  const field_t<N> &get(const handle_t handle) const
+  {
+    return field<N>()[index_of(handle)];
+  }
+
+
+
+/*==============================================================================
+  each
+
+    Calls func with references to every field of each live object, in dense
+    order. func must not allocate or destroy objects.
+==============================================================================*/
+  template <typename FN>
+  void each(FN &&func)
+  {
+    for (size_t dense = 0; dense < size_; ++dense) {
+      call_with_fields(func, dense, indices_t());
+    }
+  }
+
+
+
+/*==============================================================================
+  clear
+
+    Destroys all objects. Field arrays are kept; handles from before the clear
+    stay invalid.
+==============================================================================*/
+  void clear()
+  {
+    while (size_ > 0) {
+      destroy(handle_at(size_ - 1));
+    }
+  }
+
+
+
+  inline size_t size() const { return size_; }
+  inline size_t capacity() const { return capacity_; }
+  inline bool empty() const { return size_ == 0; }
+
+
+
+private:
+
+  template <size_t... I>
+  struct indices_of_t {};
+
+  template <size_t N, size_t... I>
+  struct make_indices_t : make_indices_t<N - 1, N - 1, I...> {};
+
+  template <size_t... I>
+  struct make_indices_t<0, I...> { using type = indices_of_t<I...>; };
+
+  using indices_t = typename make_indices_t<NUM_FIELDS>::type;
+
+
+  struct slot_t
+  {
+    // Odd while the slot refers to a live object.
+    uint32_t  generation;
+    // Dense index while live, next unused slot while on the free list.
+    uint32_t  dense;
+  };
+
+
+  static const uint32_t NO_INDEX = ~uint32_t(0);
+
+
+/*==============================================================================
+  push_slot
+
+    Takes an unused slot for a new object at the end of the dense arrays,
+    growing them if needed, and returns the object's dense index.
+==============================================================================*/
+  size_t push_slot()
+  {
+    if (size_ == capacity_) {
+      grow(capacity_ ? capacity_ * 2 : 16, indices_t());
+    }
+    uint32_t index = free_head_;
+    if (index != NO_INDEX) {
+      free_head_ = slots_[index].dense;
+    } else {
+      if (slots_.size() >= NO_INDEX) {
+        s_throw(std::length_error, "soa_pool_t is full");
+      }
+      index = uint32_t(slots_.size());
+      slots_.push_back(slot_t { 0, 0 });
+    }
+    slot_t &slot = slots_[index];
+    ++slot.generation;
+    slot.dense = uint32_t(size_);
+    dense_slots_.push_back(index);
+    return size_++;
+  }
+
+
+
+  template <size_t N>
+  void grow_field(size_t new_capacity)
+  {
+    using type = field_t<N>;
+    std::unique_ptr<char[]> raw(new char[new_capacity * sizeof(type) + ALIGNMENT - 1]);
+    const uintptr_t base = reinterpret_cast<uintptr_t>(raw.get());
+    type *moved = reinterpret_cast<type *>((base + ALIGNMENT - 1) & ~uintptr_t(ALIGNMENT - 1));
+    type *old = field<N>();
+    for (size_t dense = 0; dense < size_; ++dense) {
+      new(moved + dense) type(std::move(old[dense]));
+      old[dense].~type();
+    }
+    raw_[N] = std::move(raw);
+    columns_[N] = moved;
+  }
+
+
+
+  template <size_t... I>
+  void grow(size_t new_capacity, indices_of_t<I...>)
+  {
+    int expand[] = { 0, (grow_field<I>(new_capacity), 0)... };
+    (void)expand;
+    slots_.reserve(new_capacity);
+    dense_slots_.reserve(new_capacity);
+    capacity_ = new_capacity;
+  }
+
+
+
+  template <size_t... I>
+  void construct_fields(size_t dense, indices_of_t<I...>)
+  {
+    int expand[] = { 0, (new(field<I>() + dense) field_t<I>(), 0)... };
+    (void)expand;
+  }
+
+
+
+  template <size_t... I>
+  void construct_fields(size_t dense, indices_of_t<I...>, const FIELDS &... values)
+  {
+    int expand[] = { 0, (new(field<I>() + dense) field_t<I>(values), 0)... };
+    (void)expand;
+  }
+
+
+
+  template <size_t... I>
+  void move_fields(size_t from, size_t to, indices_of_t<I...>)
+  {
+    int expand[] = { 0, (field<I>()[to] = std::move(field<I>()[from]), 0)... };
+    (void)expand;
+  }
+
+
+
+  template <typename F>
+  static void destroy_one(F &value)
+  {
+    value.~F();
+  }
+
+
+
+  template <size_t... I>
+  void destroy_fields(size_t dense, indices_of_t<I...>)
+  {
+    int expand[] = { 0, (destroy_one(field<I>()[dense]), 0)... };
+    (void)expand;
+  }
+
+
+
+  template <typename FN, size_t... I>
+  void call_with_fields(FN &func, size_t dense, indices_of_t<I...>)
+  {
+    func(field<I>()[dense]...);
+  }
+
+
+
+  void                    *columns_[NUM_FIELDS];
+  std::unique_ptr<char[]>  raw_[NUM_FIELDS];
+  size_t                   size_ = 0;
+  size_t                   capacity_ = 0;
+  // Handle index -> slot, and dense index -> handle index.
+  std::vector<slot_t>      slots_;
+  std::vector<uint32_t>    dense_slots_;
+  uint32_t                 free_head_ = NO_INDEX;
+
+}; // struct soa_pool_t
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__SOA_POOL_HH__ include guard */
@@ -166,6 +166,54 @@ function snow.mkdir_p(path)
 end -- mkdir_p
 
 
+--[[----------------------------------------------------------------------------
+  tool_project
+
+    Adds a console program built from the sources in dir and linked against
+    snow-common, e.g., for checks and benchmarks that aren't part of the
+    library.
+------------------------------------------------------------------------------]]
+function snow.tool_project(name, dir)
+  project(name)
+  kind "ConsoleApp"
+  language "C++"
+  targetdir "bin"
+  objdir "obj"
+  buildoptions { "-std=c++11" }
+  flags { "FloatStrict", "NoRTTI" }
+  includedirs { "include" }
+  files { dir .. "/*.cc" }
+  links { "snow-common" }
+
+  configuration "Release-*"
+  defines { "NDEBUG" }
+  flags { "OptimizeSpeed" }
+
+  configuration "Debug-*"
+  defines { "DEBUG" }
+  flags { "Symbols" }
+
+  configuration "not exclude-openssl"
+  linkoptions { "`pkg-config openssl --libs`" }
+
+  configuration "no-exceptions"
+  flags { "NoExceptions" }
+
+  configuration "linux"
+  links { "pthread" }
+
+  configuration { "macosx", "universal" }
+  buildoptions { "-arch x86_64", "-arch i386" }
+  linkoptions { "-arch x86_64", "-arch i386" }
+
+  configuration "macosx"
+  buildoptions { "-stdlib=libc++" }
+  links { "c++" }
+
+  configuration {}
+end -- tool_project
+
+
 
 -- Main build configuration
 
@@ -216,6 +264,16 @@ newoption {
   description = "Exclude Lua headers from installation"
 }
 
+newoption {
+  trigger = "exclude-io-uring",
+  description = "Do not compile the io_uring async I/O backend (Linux only; thread pool is always available)"
+}
+
+newoption {
+  trigger = "memory-accounting",
+  description = "Enables per-category memory accounting and allocation site sampling (see snow/memory/accounting.hh)"
+}
+
 newoption {
   trigger = "prefix",
   description = "Installation prefix",
@@ -308,7 +366,9 @@ flags { "Symbols" }
 g_build_config_opts = {
   USE_EXCEPTIONS = not _OPTIONS["no-exceptions"],
   HAS_SHA256 = not _OPTIONS["exclude-openssl"],
-  HAS_LBIND = not _OPTIONS["exclude-lua"]
+  HAS_LBIND = not _OPTIONS["exclude-lua"],
+  HAS_IO_URING = os.is("linux") and not _OPTIONS["exclude-io-uring"],
+  USE_MEMORY_ACCOUNTING = _OPTIONS["memory-accounting"] ~= nil
 }
 
 g_pkgconfig_opts = {
@@ -342,6 +402,10 @@ linkoptions { "`pkg-config openssl --libs`" }
 configuration "no-exceptions"
 flags { "NoExceptions" }
 
+-- Linux specific options (async_io_t's thread pool)
+configuration "linux"
+links { "pthread" }
+
 -- OS X specific options
 configuration { "macosx", "universal" }
 buildoptions { "-arch x86_64", "-arch i386" }
@@ -374,3 +438,15 @@ if _ACTION and _ACTION ~= "install" then
     return false
   end
 end
+
+
+-- Hash quality and speed checks (not part of the library)
+snow.tool_project("hash-quality", "tools/hash_quality")
+
+
+-- hash_map_t against the std containers
+snow.tool_project("hash-map-bench", "tools/hash_map_bench")
+
+
+-- Per-field cost of the buffer stream bounds policies
+snow.tool_project("buffer-stream-bench", "tools/buffer_stream_bench")
@@ -0,0 +1,673 @@
+// async_io.cc -- Noel Cower -- Public Domain
+#include <snow/data/async_io.hh>
+
+#if !S_PLATFORM_WINDOWS
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if S_PLATFORM_LINUX
+#include <sys/eventfd.h>
+#endif
+
+#if HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+
+namespace snow {
+
+
+struct async_io_request_t
+{
+  async_io_result_t   result;
+  async_io_callback_t callback;
+  // Bytes transferred so far.
+  size_t              done;
+  // Return value of the last attempt: bytes transferred or -errno.
+  ssize_t             status;
+  // Set by the engine if the last attempt reached the end of the file.
+  bool                at_end;
+  struct iovec        iov;
+
+  inline void prepare_iov()
+  {
+    iov.iov_base = result.buffer + done;
+    iov.iov_len = result.length - done;
+  }
+};
+
+
+
+/*==============================================================================
+
+  Base for the I/O backends. Requests wait in the backlog until submit()
+  starts them, which keeps at most depth requests in flight.
+
+==============================================================================*/
+struct async_io_engine_t
+{
+  async_io_engine_t(unsigned depth) : depth(std::max(depth, 1U)), in_flight(0) {}
+  virtual ~async_io_engine_t() {}
+
+  // Starts a request. Returns false if the engine has no room for it.
+  virtual bool start(async_io_request_t *request) = 0;
+  // Hands started requests to the kernel or workers.
+  virtual void flush() = 0;
+  // Moves finished attempts to out, blocking for at least one if block is
+  // true and something is in flight.
+  virtual void reap(std::vector<async_io_request_t *> &out, bool block) = 0;
+  virtual int event_fd() const = 0;
+
+  void submit()
+  {
+    while (!backlog.empty() && in_flight < depth && start(backlog.front())) {
+      backlog.pop_front();
+      ++in_flight;
+    }
+    flush();
+  }
+
+  unsigned depth;
+  size_t in_flight;
+  std::deque<async_io_request_t *> backlog;
+};
+
+
+
+namespace {
+
+
+/*==============================================================================
+  notifier_t
+
+    A descriptor pair that can be polled for readability: an eventfd on Linux,
+    otherwise a non-blocking pipe.
+==============================================================================*/
+struct notifier_t
+{
+  notifier_t() : read_fd(-1), write_fd(-1)
+  {
+#if S_PLATFORM_LINUX
+    read_fd = write_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    int fds[2];
+    if (::pipe(fds) == 0) {
+      for (int fd : fds) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+      read_fd = fds[0];
+      write_fd = fds[1];
+    }
+#endif
+    if (read_fd == -1) {
+      s_throw(std::runtime_error, "Unable to create async I/O notifier: %s", std::strerror(errno));
+    }
+  }
+
+  ~notifier_t()
+  {
+    if (write_fd != read_fd) {
+      ::close(write_fd);
+    }
+    ::close(read_fd);
+  }
+
+  void notify()
+  {
+#if S_PLATFORM_LINUX
+    const uint64_t one = 1;
+#else
+    const char one = 1;
+#endif
+    while (::write(write_fd, &one, sizeof(one)) == -1 && errno == EINTR) ;
+  }
+
+  void drain()
+  {
+    char buffer[64];
+    while (::read(read_fd, buffer, sizeof(buffer)) > 0 || errno == EINTR) ;
+  }
+
+  int read_fd;
+  int write_fd;
+};
+
+
+
+/*==============================================================================
+
+  Thread pool backend. Each worker performs blocking pread/pwrite calls and
+  posts finished requests back to the owning thread.
+
+==============================================================================*/
+struct thread_pool_engine_t : public async_io_engine_t
+{
+  thread_pool_engine_t(unsigned depth, unsigned thread_count) :
+    async_io_engine_t(depth),
+    started_(0),
+    stopping_(false)
+  {
+    thread_count = std::max(thread_count, 1U);
+    threads_.reserve(thread_count);
+    for (unsigned index = 0; index < thread_count; ++index) {
+      threads_.emplace_back(&thread_pool_engine_t::run, this);
+    }
+  }
+
+  ~thread_pool_engine_t()
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stopping_ = true;
+    }
+    work_cond_.notify_all();
+    for (std::thread &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  bool start(async_io_request_t *request) override
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    work_.push_back(request);
+    ++started_;
+    return true;
+  }
+
+  void flush() override
+  {
+    if (started_ == 1) {
+      work_cond_.notify_one();
+    } else if (started_ > 1) {
+      work_cond_.notify_all();
+    }
+    started_ = 0;
+  }
+
+  void reap(std::vector<async_io_request_t *> &out, bool block) override
+  {
+    notifier_.drain();
+    std::unique_lock<std::mutex> guard(lock_);
+    if (block && in_flight > 0) {
+      done_cond_.wait(guard, [this] { return !done_.empty(); });
+    }
+    out.insert(out.end(), done_.begin(), done_.end());
+    in_flight -= done_.size();
+    done_.clear();
+  }
+
+  int event_fd() const override
+  {
+    return notifier_.read_fd;
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    for (;;) {
+      work_cond_.wait(guard, [this] { return stopping_ || !work_.empty(); });
+      if (work_.empty()) {
+        return;
+      }
+
+      async_io_request_t *request = work_.front();
+      work_.pop_front();
+      guard.unlock();
+      perform(request);
+      guard.lock();
+
+      done_.push_back(request);
+      done_cond_.notify_one();
+      notifier_.notify();
+    }
+  }
+
+  static void perform(async_io_request_t *request)
+  {
+    const async_io_result_t &info = request->result;
+    size_t done = request->done;
+    request->status = 0;
+    request->at_end = false;
+    while (done < info.length) {
+      const off_t offset = static_cast<off_t>(info.offset + done);
+      const ssize_t count = info.is_write
+        ? ::pwrite(info.fd, info.buffer + done, info.length - done, offset)
+        : ::pread(info.fd, info.buffer + done, info.length - done, offset);
+      if (count < 0) {
+        if (errno == EINTR) {
+          continue;
+        } else if (done == request->done) {
+          request->status = -errno;
+          return;
+        }
+        // Report the bytes transferred; the error recurs on resubmission.
+        break;
+      } else if (count == 0) {
+        request->at_end = true;
+        break;
+      }
+      done += static_cast<size_t>(count);
+    }
+    request->status = static_cast<ssize_t>(done - request->done);
+  }
+
+  size_t started_;
+  bool stopping_;
+  std::mutex lock_;
+  std::condition_variable work_cond_;
+  std::condition_variable done_cond_;
+  std::deque<async_io_request_t *> work_;
+  std::vector<async_io_request_t *> done_;
+  std::vector<std::thread> threads_;
+  notifier_t notifier_;
+};
+
+
+
+#if HAS_IO_URING && defined(__NR_io_uring_setup)
+
+/*==============================================================================
+
+  io_uring backend, using the raw system calls so as not to depend on
+  liburing. Requests are written to the submission ring as READV/WRITEV
+  operations (supported since Linux 5.1) and submitted in one io_uring_enter
+  call per flush. Completions are signalled through a registered eventfd.
+
+==============================================================================*/
+struct uring_engine_t : public async_io_engine_t
+{
+  uring_engine_t(unsigned depth) :
+    async_io_engine_t(depth),
+    ring_fd_(-1),
+    sq_ptr_(MAP_FAILED),
+    cq_ptr_(MAP_FAILED),
+    sqes_(static_cast<struct io_uring_sqe *>(MAP_FAILED)),
+    sq_size_(0),
+    cq_size_(0),
+    sqes_size_(0),
+    to_submit_(0)
+  {
+    /* nop */
+  }
+
+  ~uring_engine_t()
+  {
+    if (sqes_ != MAP_FAILED) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+      ::munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != MAP_FAILED) {
+      ::munmap(sq_ptr_, sq_size_);
+    }
+    if (ring_fd_ != -1) {
+      ::close(ring_fd_);
+    }
+  }
+
+  // Sets up the rings. Returns false if io_uring is unavailable.
+  bool init()
+  {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &params));
+    if (ring_fd_ < 0) {
+      ring_fd_ = -1;
+      return false;
+    }
+
+    depth = std::min(depth, params.sq_entries);
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+
+    sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+      return false;
+    }
+    if (single_mmap) {
+      cq_ptr_ = sq_ptr_;
+    } else {
+      cq_ptr_ = ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_CQ_RING);
+      if (cq_ptr_ == MAP_FAILED) {
+        return false;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe *>(
+      ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             ring_fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      return false;
+    }
+
+    char *sq = static_cast<char *>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    char *cq = static_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    int event_fd = notifier_.read_fd;
+    return ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_EVENTFD, &event_fd, 1) == 0;
+  }
+
+  bool start(async_io_request_t *request) override
+  {
+    const unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+      return false;
+    }
+
+    const unsigned index = tail & sq_mask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    request->prepare_iov();
+    sqe->opcode = request->result.is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = request->result.fd;
+    sqe->off = request->result.offset + request->done;
+    sqe->addr = reinterpret_cast<uintptr_t>(&request->iov);
+    sqe->len = 1;
+    sqe->user_data = reinterpret_cast<uintptr_t>(request);
+
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++to_submit_;
+    return true;
+  }
+
+  void flush() override
+  {
+    while (to_submit_ > 0) {
+      const int submitted = enter(to_submit_, 0, 0);
+      if (submitted < 0) {
+        if (errno == EINTR) {
+          continue;
+        } else if (errno == EAGAIN || errno == EBUSY) {
+          // Out of kernel resources -- retry on the next flush.
+          return;
+        }
+        s_throw(std::runtime_error, "io_uring_enter failed: %s", std::strerror(errno));
+        return;
+      }
+      to_submit_ -= static_cast<unsigned>(submitted);
+    }
+  }
+
+  void reap(std::vector<async_io_request_t *> &out, bool block) override
+  {
+    notifier_.drain();
+    for (;;) {
+      unsigned head = *cq_head_;
+      const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      const bool found = head != tail;
+      for (; head != tail; ++head) {
+        const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+        async_io_request_t *request = reinterpret_cast<async_io_request_t *>(
+          static_cast<uintptr_t>(cqe.user_data));
+        request->status = cqe.res;
+        request->at_end = cqe.res == 0;
+        out.push_back(request);
+        --in_flight;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+      if (found || !block || in_flight == 0) {
+        return;
+      }
+      // Submits anything a previous flush couldn't and waits for a completion.
+      const int submitted = enter(to_submit_, 1, IORING_ENTER_GETEVENTS);
+      if (submitted >= 0) {
+        to_submit_ -= static_cast<unsigned>(submitted);
+      } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        s_throw(std::runtime_error, "io_uring_enter failed: %s", std::strerror(errno));
+        return;
+      }
+    }
+  }
+
+  int event_fd() const override
+  {
+    return notifier_.read_fd;
+  }
+
+private:
+  int enter(unsigned submit, unsigned min_complete, unsigned flags)
+  {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, submit, min_complete,
+                                      flags, nullptr, 0));
+  }
+
+  int ring_fd_;
+  void *sq_ptr_;
+  void *cq_ptr_;
+  struct io_uring_sqe *sqes_;
+  size_t sq_size_;
+  size_t cq_size_;
+  size_t sqes_size_;
+
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned *sq_array_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned to_submit_;
+
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe *cqes_;
+
+  notifier_t notifier_;
+};
+
+#endif /* HAS_IO_URING */
+
+
+} // namespace <anon>
+
+
+
+async_io_t::async_io_t(unsigned queue_depth, async_io_backend_t backend, unsigned thread_count) :
+  backend_(ASYNC_IO_THREAD_POOL),
+  next_id_(1),
+  pending_(0)
+{
+#if HAS_IO_URING && defined(__NR_io_uring_setup)
+  if (backend != ASYNC_IO_THREAD_POOL) {
+    std::unique_ptr<uring_engine_t> uring(new uring_engine_t(queue_depth));
+    if (uring->init()) {
+      engine_ = std::move(uring);
+      backend_ = ASYNC_IO_URING;
+      return;
+    }
+  }
+#endif
+  engine_.reset(new thread_pool_engine_t(queue_depth, thread_count));
+}
+
+
+
+async_io_t::~async_io_t()
+{
+  wait(pending_);
+}
+
+
+
+uint64_t async_io_t::read(int fd, uint64_t offset, void *buffer, size_t length,
+                          async_io_callback_t callback, void *context)
+{
+  return enqueue(false, fd, offset, static_cast<char *>(buffer), length,
+                 std::move(callback), context);
+}
+
+
+
+uint64_t async_io_t::read(int fd, uint64_t offset, buffer_stream_t &stream,
+                          async_io_callback_t callback, void *context)
+{
+  return enqueue(false, fd, offset, stream.pointer(), stream.remainder(),
+                 std::move(callback), context);
+}
+
+
+
+uint64_t async_io_t::write(int fd, uint64_t offset, const void *buffer, size_t length,
+                           async_io_callback_t callback, void *context)
+{
+  return enqueue(true, fd, offset, static_cast<char *>(const_cast<void *>(buffer)), length,
+                 std::move(callback), context);
+}
+
+
+
+uint64_t async_io_t::write(int fd, uint64_t offset, const buffer_stream_t &stream,
+                           async_io_callback_t callback, void *context)
+{
+  return enqueue(true, fd, offset, const_cast<char *>(stream.base()),
+                 static_cast<size_t>(stream.tell()), std::move(callback), context);
+}
+
+
+
+void async_io_t::submit()
+{
+  engine_->submit();
+}
+
+
+
+size_t async_io_t::poll()
+{
+  engine_->submit();
+  engine_->reap(finished_, false);
+  return dispatch(finished_);
+}
+
+
+
+size_t async_io_t::wait(size_t min_completions)
+{
+  size_t completed = 0;
+  while (completed < min_completions && pending_ > 0) {
+    engine_->submit();
+    engine_->reap(finished_, true);
+    completed += dispatch(finished_);
+  }
+  return completed;
+}
+
+
+
+bool async_io_t::next_completion(async_io_result_t &result)
+{
+  if (completions_.empty()) {
+    return false;
+  }
+  result = completions_.front();
+  completions_.pop_front();
+  return true;
+}
+
+
+
+int async_io_t::event_fd() const
+{
+  return engine_->event_fd();
+}
+
+
+
+uint64_t async_io_t::enqueue(bool is_write, int fd, uint64_t offset, char *buffer, size_t length,
+                             async_io_callback_t &&callback, void *context)
+{
+  async_io_request_t *request = new async_io_request_t;
+  request->result.id = next_id_++;
+  request->result.fd = fd;
+  request->result.offset = offset;
+  request->result.buffer = buffer;
+  request->result.length = length;
+  request->result.result = 0;
+  request->result.is_write = is_write;
+  request->result.context = context;
+  request->callback = std::move(callback);
+  request->done = 0;
+  request->status = 0;
+  request->at_end = false;
+  engine_->backlog.push_back(request);
+  ++pending_;
+  return request->result.id;
+}
+
+
+
+size_t async_io_t::dispatch(std::vector<async_io_request_t *> &finished)
+{
+  // Swap out the list in case a callback reaps completions itself.
+  std::vector<async_io_request_t *> requests;
+  requests.swap(finished);
+
+  size_t completed = 0;
+  for (size_t index = 0; index < requests.size(); ++index) {
+    async_io_request_t *request = requests[index];
+    const ssize_t status = request->status;
+    if (status == -EINTR || status == -EAGAIN) {
+      engine_->backlog.push_back(request);
+      continue;
+    } else if (status > 0) {
+      request->done += static_cast<size_t>(status);
+    }
+
+    if (status >= 0 && !request->at_end && request->done < request->result.length) {
+      // Short transfer -- resubmit the rest.
+      engine_->backlog.push_back(request);
+      continue;
+    }
+
+    std::unique_ptr<async_io_request_t> owned(request);
+    request->result.result = status < 0 ? status : static_cast<ssize_t>(request->done);
+    --pending_;
+    ++completed;
+    if (request->callback) {
+      request->callback(request->result);
+    } else {
+      completions_.push_back(request->result);
+    }
+  }
+
+  if (finished.empty()) {
+    requests.clear();
+    finished.swap(requests);
+  }
+  return completed;
+}
+
+
+} // namespace snow
+
+#endif /* !S_PLATFORM_WINDOWS */
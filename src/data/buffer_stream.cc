@@ -1,48 +1,64 @@
 // buffer_stream.cc -- Noel Cower -- Public Domain
 #include <snow/data/buffer_stream.hh>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 
 namespace snow {
 
 
-buffer_stream_t::buffer_stream_t(void *data, size_t length) :
-  base_(static_cast<char *>(data)),
-  end_(length == unchecked ? (char *)INTPTR_MAX : base_ + length),
-  offset_(base_)
+void checked_bounds_t::fail(const char *what, ptrdiff_t offset)
 {
-  /* nop */
+  s_throw(std::out_of_range, "%s (offset %td)", what, offset);
 }
 
 
 
-ptrdiff_t buffer_stream_t::seek(ptrdiff_t offset) const
+template <typename Bounds>
+basic_buffer_stream_t<Bounds>::basic_buffer_stream_t(void *data, size_t length) :
+  base_(static_cast<char *>(data)),
+  end_(length == unchecked ? (char *)INTPTR_MAX : base_ + length),
+  offset_(base_)
 {
-  char *next_offset = base_ + offset;
-  if (next_offset < base_ || (next_offset > end_)) {
-    s_throw(std::out_of_range, "Attempt to seek to out of range offset %td", offset);
-    return tell();
-  }
-  offset_ = next_offset;
-  return tell();
+  /* nop */
 }
 
 
 
-size_t buffer_stream_t::write(const void *buffer, size_t length)
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::write(const void *buffer, size_t length)
 {
   assert(length > 0);
   assert(buffer != nullptr);
   length = std::min(length, remainder());
   if (length) {
     std::memmove(offset_, buffer, length);
+    seek(tell() + length);
   }
   return length;
 }
 
 
 
-template <>
-size_t buffer_stream_t::write(const string &string)
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::write_varint(uint64_t value)
+{
+  char encoded[VARINT_MAX_BYTES];
+  const size_t length = encode_varint(value, encoded);
+  if (remainder() < length) {
+    return 0;
+  }
+  return write(encoded, length);
+}
+
+
+
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::write(const string &string)
 {
   const size_t rem = remainder();
   if (rem <= 1) {
@@ -59,7 +75,8 @@ size_t buffer_stream_t::write(const string &string)
 
 
 
-size_t buffer_stream_t::read(void *buffer, size_t length) const
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::read(void *buffer, size_t length) const
 {
   assert(length > 0);
   length = std::min(length, remainder());
@@ -72,16 +89,125 @@ size_t buffer_stream_t::read(void *buffer, size_t length) const
 
 
 
-template <>
-size_t buffer_stream_t::read(string &result) const
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::read_varint(uint64_t &result) const
+{
+  const size_t length = decode_varint(offset_, end_, result);
+  if (length == 0) {
+    if (Bounds::enabled) {
+      Bounds::fail("Truncated or malformed varint", tell());
+    }
+    return 0;
+  }
+  offset_ += length;
+  return length;
+}
+
+
+
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::read_svarint(int64_t &result) const
 {
-  char *lenptr = offset_;
-  for (; lenptr < end_ && *lenptr; ++lenptr) ;
-  size_t length = static_cast<size_t>(lenptr - offset_);
-  result.resize(length);
-  std::memmove(result.data(), offset_, length);
+  uint64_t encoded = 0;
+  const size_t length = read_varint(encoded);
+  result = zigzag_decode(encoded);
+  return length;
+}
+
+
+
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::read(string &result) const
+{
+  string_ref_t view;
+  const size_t length = read_string(view);
+  result.assign(view.data(), view.size());
+  return length;
+}
+
+
+
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::read_string(string_ref_t &result) const
+{
+  const size_t rem = remainder();
+  const char *start = offset_;
+  const char *term = static_cast<const char *>(std::memchr(start, '\0', rem));
+  if (term == nullptr) {
+    result = string_ref_t(start, rem);
+    seek(tell() + rem);
+    return rem;
+  }
+  const size_t length = static_cast<size_t>(term - start);
+  result = string_ref_t(start, length);
+  seek(tell() + length + 1);
   return length + 1;
 }
 
 
+
+template <typename Bounds>
+size_t basic_buffer_stream_t<Bounds>::read_strings(string_ref_t *results, size_t count) const
+{
+  const char *const end = end_;
+  const char *start = offset_;
+  const char *scan = start;
+  size_t found = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+
+#if defined(__SSE2__)
+  // Scan to a 16-byte boundary, then compare whole aligned blocks against zero
+  // and walk the resulting bit masks. Only blocks entirely inside the buffer
+  // are loaded.
+  for (; found < count && scan < end && (reinterpret_cast<uintptr_t>(scan) & 15); ++scan) {
+    if (*scan == '\0') {
+      results[found++] = string_ref_t(start, static_cast<size_t>(scan - start));
+      start = scan + 1;
+    }
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  for (; found < count && end - scan >= 16; scan += 16) {
+    const __m128i block = _mm_load_si128(reinterpret_cast<const __m128i *>(scan));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)));
+    while (mask) {
+      const char *term = scan + __builtin_ctz(mask);
+      results[found++] = string_ref_t(start, static_cast<size_t>(term - start));
+      start = term + 1;
+      if (found == count) {
+        break;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  // Remaining strings (or all of them, without SSE2).
+  while (found < count && start < end) {
+    scan = std::max(scan, start);
+    const char *term = static_cast<const char *>(
+      std::memchr(scan, '\0', static_cast<size_t>(end - scan)));
+    if (term == nullptr) {
+      results[found++] = string_ref_t(start, static_cast<size_t>(end - start));
+      start = end;
+      break;
+    }
+    results[found++] = string_ref_t(start, static_cast<size_t>(term - start));
+    start = scan = term + 1;
+  }
+
+  seek(start - base_);
+  return found;
+}
+
+
+
+template struct basic_buffer_stream_t<checked_bounds_t>;
+template struct basic_buffer_stream_t<unchecked_bounds_t>;
+template struct basic_buffer_stream_t<assert_bounds_t>;
+
+
 } // namespace snow
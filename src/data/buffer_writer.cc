@@ -0,0 +1,199 @@
+// buffer_writer.cc -- Noel Cower -- Public Domain
+#include <snow/data/buffer_writer.hh>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+
+namespace snow {
+
+
+namespace {
+
+
+const size_t MIN_CAPACITY = 64;
+
+
+} // namespace <anon>
+
+
+
+buffer_writer_t::buffer_writer_t(size_t initial_capacity) :
+  data_(nullptr),
+  size_(0),
+  capacity_(0)
+{
+  if (initial_capacity) {
+    reserve(initial_capacity);
+  }
+}
+
+
+
+buffer_writer_t::buffer_writer_t(const buffer_writer_t &other) :
+  buffer_writer_t(other.size_)
+{
+  if (other.size_) {
+    std::memcpy(data_, other.data_, other.size_);
+  }
+  size_ = other.size_;
+}
+
+
+
+buffer_writer_t::buffer_writer_t(buffer_writer_t &&other) :
+  data_(other.data_),
+  size_(other.size_),
+  capacity_(other.capacity_)
+{
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.capacity_ = 0;
+}
+
+
+
+buffer_writer_t::~buffer_writer_t()
+{
+  std::free(data_);
+}
+
+
+
+buffer_writer_t &buffer_writer_t::operator = (const buffer_writer_t &other)
+{
+  if (this != &other) {
+    buffer_writer_t copy(other);
+    swap(copy);
+  }
+  return *this;
+}
+
+
+
+buffer_writer_t &buffer_writer_t::operator = (buffer_writer_t &&other)
+{
+  if (this != &other) {
+    std::free(data_);
+    data_ = other.data_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+  }
+  return *this;
+}
+
+
+
+size_t buffer_writer_t::write(const void *data, size_t length)
+{
+  if (length) {
+    assert(data != nullptr);
+    std::memcpy(append(length), data, length);
+  }
+  return length;
+}
+
+
+
+size_t buffer_writer_t::write_varint(uint64_t value)
+{
+  char encoded[VARINT_MAX_BYTES];
+  return write(encoded, encode_varint(value, encoded));
+}
+
+
+
+size_t buffer_writer_t::write(const string &string)
+{
+  const size_t length = string.size();
+  char *dst = append(length + 1);
+  if (length) {
+    std::memcpy(dst, string.data(), length);
+  }
+  dst[length] = '\0';
+  return length + 1;
+}
+
+
+
+char *buffer_writer_t::append(size_t length)
+{
+  if (length > capacity_ - size_) {
+    if (length > SIZE_MAX - size_) {
+      s_throw(std::length_error, "buffer_writer_t size overflow");
+    }
+    size_t next_capacity = capacity_ ? capacity_ : MIN_CAPACITY;
+    while (next_capacity < size_ + length) {
+      next_capacity = next_capacity > SIZE_MAX / 2 ? size_ + length : next_capacity * 2;
+    }
+    reserve(next_capacity);
+  }
+  char *result = data_ + size_;
+  size_ += length;
+  return result;
+}
+
+
+
+void buffer_writer_t::reserve(size_t capacity)
+{
+  if (capacity <= capacity_) {
+    return;
+  }
+  char *next_data = static_cast<char *>(std::realloc(data_, capacity));
+  if (next_data == nullptr) {
+#if USE_EXCEPTIONS
+    throw std::bad_alloc();
+#else
+    s_fatal_error("buffer_writer_t failed to allocate %zu bytes", capacity);
+#endif
+  }
+  data_ = next_data;
+  capacity_ = capacity;
+}
+
+
+
+void buffer_writer_t::shrink_to_fit()
+{
+  if (size_ == capacity_) {
+    return;
+  } else if (size_ == 0) {
+    std::free(data_);
+    data_ = nullptr;
+    capacity_ = 0;
+    return;
+  }
+  char *next_data = static_cast<char *>(std::realloc(data_, size_));
+  if (next_data != nullptr) {
+    data_ = next_data;
+    capacity_ = size_;
+  }
+}
+
+
+
+void buffer_writer_t::swap(buffer_writer_t &other)
+{
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+  std::swap(capacity_, other.capacity_);
+}
+
+
+
+void buffer_writer_t::check_patch(size_t offset, size_t length) const
+{
+  if (offset > size_ || length > size_ - offset) {
+    s_throw(std::out_of_range, "Attempt to patch %zu bytes at out of range offset %zu",
+      length, offset);
+  }
+}
+
+
+} // namespace snow
@@ -0,0 +1,247 @@
+// chunker.cc -- Noel Cower -- Public Domain
+
+#include <snow/data/chunker.hh>
+#include <snow/data/hash.hh>
+#include <algorithm>
+
+#if HAS_SHA256
+#include <snow/data/sha256.hh>
+#endif
+
+
+namespace snow {
+
+
+namespace {
+
+
+const unsigned GEAR_TABLE_SIZE = 256;
+// Number of extra mask bits applied below/above the average chunk size.
+const unsigned NORMALIZATION_LEVEL = 2;
+
+
+/*==============================================================================
+  gear_table_t
+
+    Table of random 64-bit values, one per byte value, for the gear hash. Filled
+    with splitmix64 output from a fixed seed so that chunk boundaries never
+    differ between builds or platforms.
+==============================================================================*/
+struct gear_table_t
+{
+  uint64_t values[GEAR_TABLE_SIZE];
+
+  gear_table_t()
+  {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (unsigned index = 0; index < GEAR_TABLE_SIZE; ++index) {
+      uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      values[index] = z ^ (z >> 31);
+    }
+  }
+};
+
+
+const gear_table_t GEAR;
+
+
+
+/*==============================================================================
+  high_bits_mask
+
+    Returns a mask of the top `bits` bits of a 64-bit word. The gear hash mixes
+    new bytes in from the bottom, so its top bits depend on the most bytes.
+==============================================================================*/
+inline uint64_t high_bits_mask(int bits)
+{
+  bits = std::max(1, std::min(63, bits));
+  return ~uint64_t(0) << (64 - bits);
+}
+
+
+/*==============================================================================
+  roll_gear
+
+    Rolls the gear hash over bytes [index, end) and returns the offset just past
+    the first byte at which (hash & mask) is zero, or zero if there is none.
+    Steps two bytes at a time: the hash after the second byte is computed
+    directly from the hash before the first, which halves the length of the
+    shift-add dependency chain without changing the result.
+==============================================================================*/
+inline size_t roll_gear(const uint8_t *bytes, size_t index, size_t end,
+                        uint64_t mask, uint64_t &hash)
+{
+  const uint64_t *gear = GEAR.values;
+  for (; index + 1 < end; index += 2) {
+    const uint64_t first = gear[bytes[index]];
+    const uint64_t single = (hash << 1) + first;
+    hash = (hash << 2) + ((first << 1) + gear[bytes[index + 1]]);
+    if (!(single & mask)) {
+      return index + 1;
+    } else if (!(hash & mask)) {
+      return index + 2;
+    }
+  }
+  if (index < end) {
+    hash = (hash << 1) + gear[bytes[index]];
+    if (!(hash & mask)) {
+      return index + 1;
+    }
+  }
+  return 0;
+}
+
+
+
+
+#if !HAS_SHA256
+
+/*==============================================================================
+  load_le64
+
+    Reads a little-endian 64-bit word, so digests don't differ between
+    platforms.
+==============================================================================*/
+inline uint64_t load_le64(const uint8_t *bytes)
+{
+  uint64_t value = 0;
+  for (int index = 7; index >= 0; --index) {
+    value = (value << 8) | bytes[index];
+  }
+  return value;
+}
+
+
+
+/*==============================================================================
+  murmur3_128
+
+    MurmurHash3 x64_128 (Austin Appleby, public domain) with a zero seed.
+    Writes the 16-byte digest to out, low half first, each half little-endian.
+==============================================================================*/
+void murmur3_128(const char *data, size_t length, uint8_t out[16])
+{
+  const uint64_t c1 = 0x87C37B91114253D5ULL;
+  const uint64_t c2 = 0x4CF5AD432745937FULL;
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  const size_t num_blocks = length / 16;
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+
+  for (size_t block = 0; block < num_blocks; ++block) {
+    uint64_t k1 = load_le64(bytes + block * 16);
+    uint64_t k2 = load_le64(bytes + block * 16 + 8);
+
+    k1 *= c1; k1 = hash_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = hash_rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+
+    k2 *= c2; k2 = hash_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = hash_rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+  }
+
+  const uint8_t *tail = bytes + num_blocks * 16;
+  const size_t tail_length = length & 15;
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  for (size_t index = tail_length; index > 8; --index) {
+    k2 = (k2 << 8) | tail[index - 1];
+  }
+  for (size_t index = std::min(tail_length, size_t(8)); index > 0; --index) {
+    k1 = (k1 << 8) | tail[index - 1];
+  }
+  if (tail_length > 8) {
+    k2 *= c2; k2 = hash_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+  }
+  if (tail_length > 0) {
+    k1 *= c1; k1 = hash_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+
+  h1 ^= uint64_t(length);
+  h2 ^= uint64_t(length);
+  h1 += h2;
+  h2 += h1;
+  h1 = hash_mix64(h1);
+  h2 = hash_mix64(h2);
+  h1 += h2;
+  h2 += h1;
+
+  for (int index = 0; index < 8; ++index) {
+    out[index] = uint8_t(h1 >> (index * 8));
+    out[index + 8] = uint8_t(h2 >> (index * 8));
+  }
+}
+
+#endif // !HAS_SHA256
+
+
+} // anonymous namespace
+
+
+
+chunker_t::chunker_t(size_t min_size, size_t avg_size, size_t max_size, hash_fn_t hash) :
+  min_size_(min_size),
+  avg_size_(avg_size),
+  max_size_(max_size),
+  hash_(hash)
+{
+  if (min_size == 0 || min_size > avg_size || avg_size > max_size) {
+    s_throw(std::invalid_argument,
+      "Chunk sizes must satisfy 0 < min (%zu) <= avg (%zu) <= max (%zu)",
+      min_size, avg_size, max_size);
+  }
+
+  int bits = 0;
+  while ((size_t(2) << bits) <= avg_size) {
+    ++bits;
+  }
+  avg_size_ = std::max(min_size_, size_t(1) << bits);
+  mask_small_ = high_bits_mask(bits + NORMALIZATION_LEVEL);
+  mask_large_ = high_bits_mask(bits - NORMALIZATION_LEVEL);
+}
+
+
+
+/*==============================================================================
+  next_boundary
+
+    Rolls the gear hash over the data starting at min_size_ (bytes before that
+    can never hold a boundary, so they're skipped entirely) and returns the
+    first cut point.
+==============================================================================*/
+size_t chunker_t::next_boundary(const char *data, size_t length) const
+{
+  if (length <= min_size_) {
+    return length;
+  }
+
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  const size_t limit = std::min(length, max_size_);
+  const size_t normal = std::min(limit, avg_size_);
+  uint64_t hash = 0;
+  size_t cut;
+
+  if ((cut = roll_gear(bytes, min_size_, normal, mask_small_, hash)) ||
+      (cut = roll_gear(bytes, normal, limit, mask_large_, hash))) {
+    return cut;
+  }
+
+  return limit;
+}
+
+
+
+void chunker_t::default_hash(const char *data, size_t length, chunk_digest_t &digest)
+{
+#if HAS_SHA256
+  static_assert(SHA256_DIGEST_LENGTH == chunk_digest_t::SIZE, "SHA-256 digest must fill a chunk digest");
+  sha256(data, length, reinterpret_cast<char *>(digest.bytes));
+#else
+  murmur3_128(data, length, digest.bytes);
+  std::memset(digest.bytes + 16, 0, chunk_digest_t::SIZE - 16);
+#endif
+}
+
+
+} // namespace snow
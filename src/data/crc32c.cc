@@ -0,0 +1,108 @@
+// crc32c.cc -- Noel Cower -- Public Domain
+#include <snow/data/crc32c.hh>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+
+namespace snow {
+
+
+namespace {
+
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+
+const uint32_t CRC32C_POLY = 0x82F63B78U; // Reflected Castagnoli polynomial
+
+
+struct crc32c_table_t
+{
+  uint32_t slices[8][256];
+
+  crc32c_table_t()
+  {
+    for (uint32_t index = 0; index < 256; ++index) {
+      uint32_t crc = index;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+      }
+      slices[0][index] = crc;
+    }
+    for (uint32_t index = 0; index < 256; ++index) {
+      for (int slice = 1; slice < 8; ++slice) {
+        const uint32_t prev = slices[slice - 1][index];
+        slices[slice][index] = (prev >> 8) ^ slices[0][prev & 0xFF];
+      }
+    }
+  }
+};
+
+
+const crc32c_table_t &crc32c_table()
+{
+  static const crc32c_table_t table;
+  return table;
+}
+
+#endif
+
+
+} // namespace <anon>
+
+
+
+uint32_t crc32c(const void *data, size_t length, uint32_t crc)
+{
+  const unsigned char *ptr = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+
+  for (; length >= 8; length -= 8, ptr += 8) {
+    uint64_t word;
+    std::memcpy(&word, ptr, sizeof(word));
+#if defined(__SSE4_2__)
+    crc = static_cast<uint32_t>(_mm_crc32_u64(crc, word));
+#else
+    crc = __crc32cd(crc, word);
+#endif
+  }
+  for (; length; --length, ++ptr) {
+#if defined(__SSE4_2__)
+    crc = _mm_crc32_u8(crc, *ptr);
+#else
+    crc = __crc32cb(crc, *ptr);
+#endif
+  }
+
+#else
+
+  const crc32c_table_t &table = crc32c_table();
+  for (; length >= 8; length -= 8, ptr += 8) {
+    const uint32_t low = crc ^ (ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) |
+                                (static_cast<uint32_t>(ptr[3]) << 24));
+    crc = table.slices[7][low & 0xFF] ^
+          table.slices[6][(low >> 8) & 0xFF] ^
+          table.slices[5][(low >> 16) & 0xFF] ^
+          table.slices[4][low >> 24] ^
+          table.slices[3][ptr[4]] ^
+          table.slices[2][ptr[5]] ^
+          table.slices[1][ptr[6]] ^
+          table.slices[0][ptr[7]];
+  }
+  for (; length; --length, ++ptr) {
+    crc = (crc >> 8) ^ table.slices[0][(crc ^ *ptr) & 0xFF];
+  }
+
+#endif
+
+  return ~crc;
+}
+
+
+} // namespace snow
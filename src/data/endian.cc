@@ -0,0 +1,148 @@
+// endian.cc -- Noel Cower -- Public Domain
+#include <snow/data/endian.hh>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif S_ARCH_ARM_NEON || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+namespace snow {
+
+
+namespace {
+
+
+template <typename T>
+void swap_scalars(char *dst, const char *src, size_t count)
+{
+  for (; count; --count, dst += sizeof(T), src += sizeof(T)) {
+    T value;
+    std::memcpy(&value, src, sizeof(value));
+    value = byte_swap(value);
+    std::memcpy(dst, &value, sizeof(value));
+  }
+}
+
+
+
+#if defined(__SSE2__)
+
+// SSE2 has no byte shuffle, so wider scalars have their 16-bit words reversed
+// with shufflelo/hi first and then each word's bytes are swapped with shifts.
+template <size_t WIDTH>
+inline __m128i swap_lanes(__m128i v)
+{
+  if (WIDTH == 4) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+  } else if (WIDTH == 8) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+
+// Swaps 16 bytes at a time, returning the number of scalars swapped. The
+// remainder is left to swap_scalars.
+template <size_t WIDTH>
+size_t swap_vectors_sse2(char *dst, const char *src, size_t count)
+{
+  const size_t per_vector = 16 / WIDTH;
+  const size_t vectors = count / per_vector;
+  size_t index = 0;
+  for (; index + 4 <= vectors; index += 4) {
+    const __m128i *in = reinterpret_cast<const __m128i *>(src + index * 16);
+    __m128i *out = reinterpret_cast<__m128i *>(dst + index * 16);
+    const __m128i a = _mm_loadu_si128(in);
+    const __m128i b = _mm_loadu_si128(in + 1);
+    const __m128i c = _mm_loadu_si128(in + 2);
+    const __m128i d = _mm_loadu_si128(in + 3);
+    _mm_storeu_si128(out,     swap_lanes<WIDTH>(a));
+    _mm_storeu_si128(out + 1, swap_lanes<WIDTH>(b));
+    _mm_storeu_si128(out + 2, swap_lanes<WIDTH>(c));
+    _mm_storeu_si128(out + 3, swap_lanes<WIDTH>(d));
+  }
+  for (; index < vectors; ++index) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + index * 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + index * 16), swap_lanes<WIDTH>(v));
+  }
+  return vectors * per_vector;
+}
+
+
+size_t swap_vectors(char *dst, const char *src, size_t count, size_t width)
+{
+  switch (width) {
+  case 2: return swap_vectors_sse2<2>(dst, src, count);
+  case 4: return swap_vectors_sse2<4>(dst, src, count);
+  case 8: return swap_vectors_sse2<8>(dst, src, count);
+  default: return 0;
+  }
+}
+
+#elif S_ARCH_ARM_NEON || defined(__ARM_NEON)
+
+size_t swap_vectors(char *dst, const char *src, size_t count, size_t width)
+{
+  const size_t per_vector = 16 / width;
+  const size_t vectors = count / per_vector;
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(src);
+  uint8_t *out = reinterpret_cast<uint8_t *>(dst);
+  for (size_t index = 0; index < vectors; ++index, in += 16, out += 16) {
+    const uint8x16_t v = vld1q_u8(in);
+    switch (width) {
+    case 2: vst1q_u8(out, vrev16q_u8(v)); break;
+    case 4: vst1q_u8(out, vrev32q_u8(v)); break;
+    case 8: vst1q_u8(out, vrev64q_u8(v)); break;
+    default: return 0;
+    }
+  }
+  return vectors * per_vector;
+}
+
+#else
+
+size_t swap_vectors(char *, const char *, size_t, size_t)
+{
+  return 0;
+}
+
+#endif
+
+
+} // namespace <anon>
+
+
+
+void byte_swap_array(void *dst, const void *src, size_t count, size_t width)
+{
+  char *out = static_cast<char *>(dst);
+  const char *in = static_cast<const char *>(src);
+
+  if (width == 1) {
+    if (out != in) {
+      std::memmove(out, in, count);
+    }
+    return;
+  }
+
+  const size_t swapped = swap_vectors(out, in, count, width);
+  out += swapped * width;
+  in += swapped * width;
+  count -= swapped;
+
+  switch (width) {
+  case 2: swap_scalars<uint16_t>(out, in, count); break;
+  case 4: swap_scalars<uint32_t>(out, in, count); break;
+  case 8: swap_scalars<uint64_t>(out, in, count); break;
+  default:
+    s_throw(std::invalid_argument, "Invalid scalar width for byte swap: %zu", width);
+    break;
+  }
+}
+
+
+} // namespace snow
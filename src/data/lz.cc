@@ -0,0 +1,626 @@
+// lz.cc -- Noel Cower -- Public Domain
+#include <snow/data/lz.hh>
+#include <algorithm>
+#include <cstring>
+
+
+namespace snow {
+
+
+namespace {
+
+
+const uint32_t FRAME_MAGIC = 0x465A4C53U; // 'SLZF'
+const uint8_t FRAME_VERSION = 1;
+const size_t FRAME_HEADER_SIZE = 8;
+const size_t BLOCK_HEADER_SIZE = 8;
+const uint32_t BLOCK_STORED = 0x80000000U;
+
+const unsigned HASH_LOG = 13;
+const size_t MIN_MATCH = 4;
+// The last match must start at least this many bytes before the end of the
+// input, and the last LAST_LITERALS bytes are always literals.
+const size_t MF_LIMIT = 12;
+const size_t LAST_LITERALS = 5;
+const size_t MAX_OFFSET = 65535;
+
+
+inline uint32_t read32(const char *ptr)
+{
+  uint32_t value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+
+inline uint32_t hash_sequence(uint32_t sequence)
+{
+  return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+
+inline size_t match_length(const char *ip, const char *ref, const char *limit)
+{
+  const char *const start = ip;
+  while (ip + 8 <= limit) {
+    uint64_t a, b;
+    std::memcpy(&a, ip, sizeof(a));
+    std::memcpy(&b, ref, sizeof(b));
+    const uint64_t diff = a ^ b;
+    if (diff) {
+#if S_LITTLE_ENDIAN
+      return static_cast<size_t>(ip - start) + (__builtin_ctzll(diff) >> 3);
+#else
+      return static_cast<size_t>(ip - start) + (__builtin_clzll(diff) >> 3);
+#endif
+    }
+    ip += 8;
+    ref += 8;
+  }
+  while (ip < limit && *ip == *ref) {
+    ++ip;
+    ++ref;
+  }
+  return static_cast<size_t>(ip - start);
+}
+
+
+// Writes a length continuation: runs of 255 followed by the remainder.
+inline char *write_length(char *op, size_t length)
+{
+  for (; length >= 255; length -= 255) {
+    *op++ = static_cast<char>(255);
+  }
+  *op++ = static_cast<char>(length);
+  return op;
+}
+
+
+unsigned block_log2(size_t block_size)
+{
+  block_size = std::min(std::max(block_size, LZ_MIN_BLOCK_SIZE), LZ_MAX_BLOCK_SIZE);
+  unsigned log2 = 0;
+  while ((size_t(1) << log2) < block_size) {
+    ++log2;
+  }
+  return log2;
+}
+
+
+} // namespace <anon>
+
+
+
+size_t lz_compress(const void *src, size_t length, void *dst, size_t capacity)
+{
+  const char *const base = static_cast<const char *>(src);
+  const char *const iend = base + length;
+  const char *ip = base;
+  const char *anchor = base;
+  char *op = static_cast<char *>(dst);
+  char *const oend = op + capacity;
+
+  if (length >= MF_LIMIT + 1) {
+    uint32_t table[1 << HASH_LOG];
+    std::memset(table, 0, sizeof(table));
+
+    const char *const mflimit = iend - MF_LIMIT;
+    const char *const matchlimit = iend - LAST_LITERALS;
+
+    ++ip;
+    for (;;) {
+      // Find a match, skipping ahead faster the longer nothing is found.
+      const char *ref;
+      unsigned searches = 1 << 6;
+      for (;;) {
+        const uint32_t sequence = read32(ip);
+        const uint32_t hash = hash_sequence(sequence);
+        ref = base + table[hash];
+        table[hash] = static_cast<uint32_t>(ip - base);
+        if (ip - ref <= static_cast<ptrdiff_t>(MAX_OFFSET) && ref < ip && read32(ref) == sequence) {
+          break;
+        }
+        ip += searches++ >> 6;
+        if (ip > mflimit) {
+          goto last_literals;
+        }
+      }
+
+      // Extend the match backwards over matching literals.
+      while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+
+      const size_t literals = static_cast<size_t>(ip - anchor);
+      const size_t matched = MIN_MATCH + match_length(ip + MIN_MATCH, ref + MIN_MATCH, matchlimit);
+
+      // token + literal length + literals + offset + match length
+      if (oend - op < static_cast<ptrdiff_t>(1 + literals / 255 + 1 + literals + 2 + matched / 255 + 1)) {
+        return 0;
+      }
+
+      char *token = op++;
+      if (literals >= 15) {
+        *token = static_cast<char>(15 << 4);
+        op = write_length(op, literals - 15);
+      } else {
+        *token = static_cast<char>(literals << 4);
+      }
+      std::memcpy(op, anchor, literals);
+      op += literals;
+
+      const size_t offset = static_cast<size_t>(ip - ref);
+      *op++ = static_cast<char>(offset & 0xFF);
+      *op++ = static_cast<char>(offset >> 8);
+
+      const size_t match_code = matched - MIN_MATCH;
+      if (match_code >= 15) {
+        *token |= 15;
+        op = write_length(op, match_code - 15);
+      } else {
+        *token |= static_cast<char>(match_code);
+      }
+
+      ip += matched;
+      anchor = ip;
+      if (ip > mflimit) {
+        break;
+      }
+      table[hash_sequence(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - base);
+    }
+  }
+
+last_literals:
+  const size_t literals = static_cast<size_t>(iend - anchor);
+  if (oend - op < static_cast<ptrdiff_t>(1 + literals / 255 + 1 + literals)) {
+    return 0;
+  }
+  if (literals >= 15) {
+    *op++ = static_cast<char>(15 << 4);
+    op = write_length(op, literals - 15);
+  } else {
+    *op++ = static_cast<char>(literals << 4);
+  }
+  std::memcpy(op, anchor, literals);
+  op += literals;
+  return static_cast<size_t>(op - static_cast<char *>(dst));
+}
+
+
+
+size_t lz_decompress(const void *src, size_t length, void *dst, size_t capacity)
+{
+  const unsigned char *ip = static_cast<const unsigned char *>(src);
+  const unsigned char *const iend = ip + length;
+  char *const obase = static_cast<char *>(dst);
+  char *op = obase;
+  char *const oend = op + capacity;
+
+  for (;;) {
+    // Every sequence needs a token, including the first, and input can only
+    // end after a sequence's literals.
+    if (ip == iend) {
+      return LZ_ERROR;
+    }
+    const unsigned token = *ip++;
+
+    size_t literals = token >> 4;
+    if (literals == 15) {
+      unsigned byte;
+      do {
+        if (ip == iend) {
+          return LZ_ERROR;
+        }
+        byte = *ip++;
+        literals += byte;
+      } while (byte == 255);
+    }
+    if (static_cast<size_t>(iend - ip) < literals || static_cast<size_t>(oend - op) < literals) {
+      return LZ_ERROR;
+    }
+    std::memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+
+    if (ip == iend) {
+      // The last sequence has no match.
+      break;
+    } else if (iend - ip < 2) {
+      return LZ_ERROR;
+    }
+
+    const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - obase)) {
+      return LZ_ERROR;
+    }
+
+    size_t matched = token & 15;
+    if (matched == 15) {
+      unsigned byte;
+      do {
+        if (ip == iend) {
+          return LZ_ERROR;
+        }
+        byte = *ip++;
+        matched += byte;
+      } while (byte == 255);
+    }
+    matched += MIN_MATCH;
+    if (static_cast<size_t>(oend - op) < matched) {
+      return LZ_ERROR;
+    }
+
+    const char *ref = op - offset;
+    if (offset >= matched) {
+      std::memcpy(op, ref, matched);
+      op += matched;
+    } else if (offset >= 8) {
+      // Overlapping, but each 8-byte chunk reads bytes already written.
+      char *const mend = op + matched;
+      for (; mend - op >= 8; op += 8, ref += 8) {
+        std::memcpy(op, ref, 8);
+      }
+      while (op < mend) {
+        *op++ = *ref++;
+      }
+    } else {
+      char *const mend = op + matched;
+      while (op < mend) {
+        *op++ = *ref++;
+      }
+    }
+  }
+
+  return static_cast<size_t>(op - obase);
+}
+
+
+
+bool lz_frame_blocks(const buffer_stream_t &frame, std::vector<lz_block_t> &blocks,
+                     size_t *raw_size)
+{
+  const char *const start = frame.pointer();
+  const size_t length = frame.remainder();
+  if (length < FRAME_HEADER_SIZE ||
+      load_le<uint32_t>(start) != FRAME_MAGIC ||
+      static_cast<uint8_t>(start[4]) != FRAME_VERSION) {
+    return false;
+  }
+  const unsigned log2 = static_cast<uint8_t>(start[5]);
+  if ((size_t(1) << log2) < LZ_MIN_BLOCK_SIZE || (size_t(1) << log2) > LZ_MAX_BLOCK_SIZE) {
+    return false;
+  }
+  const size_t block_size = size_t(1) << log2;
+
+  blocks.clear();
+  size_t offset = FRAME_HEADER_SIZE;
+  size_t raw_offset = 0;
+  for (;;) {
+    if (length - offset < 4) {
+      return false;
+    }
+    const uint32_t packed = load_le<uint32_t>(start + offset);
+    if (packed == 0) {
+      break;
+    } else if (length - offset < BLOCK_HEADER_SIZE) {
+      return false;
+    }
+
+    lz_block_t block;
+    block.stored = (packed & BLOCK_STORED) != 0;
+    block.packed_size = packed & ~BLOCK_STORED;
+    block.raw_size = load_le<uint32_t>(start + offset + 4);
+    block.offset = offset + BLOCK_HEADER_SIZE;
+    block.raw_offset = raw_offset;
+    if (block.raw_size == 0 || block.raw_size > block_size ||
+        (block.stored && block.packed_size != block.raw_size) ||
+        length - block.offset < block.packed_size) {
+      return false;
+    }
+    blocks.push_back(block);
+    offset = block.offset + block.packed_size;
+    raw_offset += block.raw_size;
+  }
+
+  if (raw_size) {
+    *raw_size = raw_offset;
+  }
+  return true;
+}
+
+
+
+bool lz_decompress_block(const char *frame, const lz_block_t &block, char *dst)
+{
+  if (block.stored) {
+    std::memcpy(dst, frame + block.offset, block.raw_size);
+    return true;
+  }
+  return lz_decompress(frame + block.offset, block.packed_size, dst, block.raw_size) == block.raw_size;
+}
+
+
+
+size_t lz_compress_frame(const void *src, size_t length, buffer_writer_t &out, size_t block_size)
+{
+  const size_t start = out.size();
+  lz_frame_writer_t writer(out, block_size);
+  writer.write(src, length);
+  writer.finish();
+  return out.size() - start;
+}
+
+
+
+size_t lz_decompress_frame(const buffer_stream_t &frame, buffer_writer_t &out)
+{
+  std::vector<lz_block_t> blocks;
+  size_t raw_size = 0;
+  if (!lz_frame_blocks(frame, blocks, &raw_size)) {
+    s_throw(std::runtime_error, "Malformed LZ frame");
+    return 0;
+  }
+
+  char *dst = out.append(raw_size);
+  for (const lz_block_t &block : blocks) {
+    if (!lz_decompress_block(frame.pointer(), block, dst + block.raw_offset)) {
+      s_throw(std::runtime_error, "Malformed LZ block at frame offset %zu", block.offset);
+      return 0;
+    }
+  }
+  return raw_size;
+}
+
+
+
+/*==============================================================================
+  lz_frame_writer_t
+==============================================================================*/
+
+lz_frame_writer_t::lz_frame_writer_t(sink_t sink, size_t block_size) :
+  sink_(std::move(sink)),
+  block_log2_(block_log2(block_size)),
+  block_used_(0),
+  raw_size_(0),
+  packed_size_(0),
+  finished_(false)
+{
+  block_size_ = size_t(1) << block_log2_;
+  block_.resize(block_size_);
+  packed_.resize(BLOCK_HEADER_SIZE + lz_compress_bound(block_size_));
+  write_header();
+}
+
+
+
+lz_frame_writer_t::lz_frame_writer_t(buffer_writer_t &out, size_t block_size) :
+  lz_frame_writer_t([&out](const char *data, size_t length) { out.write(data, length); },
+                    block_size)
+{
+  /* nop */
+}
+
+
+
+size_t lz_frame_writer_t::write(const void *data, size_t length)
+{
+  if (finished_) {
+    s_throw(std::logic_error, "Attempt to write to a finished LZ frame");
+    return 0;
+  }
+
+  const char *src = static_cast<const char *>(data);
+  size_t remaining = length;
+  while (remaining > 0) {
+    const size_t chunk = std::min(remaining, block_size_ - block_used_);
+    std::memcpy(block_.data() + block_used_, src, chunk);
+    block_used_ += chunk;
+    src += chunk;
+    remaining -= chunk;
+    if (block_used_ == block_size_) {
+      flush_block();
+    }
+  }
+  raw_size_ += length;
+  return length;
+}
+
+
+
+void lz_frame_writer_t::finish()
+{
+  if (finished_) {
+    return;
+  }
+  flush_block();
+  char end[4];
+  store_le<uint32_t>(end, 0);
+  emit(end, sizeof(end));
+  finished_ = true;
+}
+
+
+
+void lz_frame_writer_t::write_header()
+{
+  char header[FRAME_HEADER_SIZE];
+  store_le<uint32_t>(header, FRAME_MAGIC);
+  header[4] = static_cast<char>(FRAME_VERSION);
+  header[5] = static_cast<char>(block_log2_);
+  header[6] = header[7] = 0;
+  emit(header, sizeof(header));
+}
+
+
+
+void lz_frame_writer_t::flush_block()
+{
+  if (block_used_ == 0) {
+    return;
+  }
+
+  char *const header = packed_.data();
+  size_t packed = lz_compress(block_.data(), block_used_,
+                              header + BLOCK_HEADER_SIZE, packed_.size() - BLOCK_HEADER_SIZE);
+  if (packed == 0 || packed >= block_used_) {
+    // Incompressible -- store it as-is.
+    std::memcpy(header + BLOCK_HEADER_SIZE, block_.data(), block_used_);
+    packed = block_used_;
+    store_le<uint32_t>(header, static_cast<uint32_t>(packed) | BLOCK_STORED);
+  } else {
+    store_le<uint32_t>(header, static_cast<uint32_t>(packed));
+  }
+  store_le<uint32_t>(header + 4, static_cast<uint32_t>(block_used_));
+  emit(header, BLOCK_HEADER_SIZE + packed);
+  block_used_ = 0;
+}
+
+
+
+void lz_frame_writer_t::emit(const char *data, size_t length)
+{
+  sink_(data, length);
+  packed_size_ += length;
+}
+
+
+
+/*==============================================================================
+  lz_frame_reader_t
+==============================================================================*/
+
+lz_frame_reader_t::lz_frame_reader_t(const buffer_stream_t &frame) :
+  frame_(frame),
+  block_size_(0),
+  block_pos_(0),
+  block_len_(0),
+  consumed_(0),
+  at_end_(false)
+{
+  char header[FRAME_HEADER_SIZE];
+  if (frame_.remainder() < FRAME_HEADER_SIZE) {
+    s_throw(std::runtime_error, "Truncated LZ frame header");
+    return;
+  }
+  frame_.read(header, sizeof(header));
+  const unsigned log2 = static_cast<uint8_t>(header[5]);
+  if (load_le<uint32_t>(header) != FRAME_MAGIC ||
+      static_cast<uint8_t>(header[4]) != FRAME_VERSION ||
+      (size_t(1) << log2) < LZ_MIN_BLOCK_SIZE || (size_t(1) << log2) > LZ_MAX_BLOCK_SIZE) {
+    s_throw(std::runtime_error, "Invalid LZ frame header");
+    return;
+  }
+  block_size_ = size_t(1) << log2;
+  block_.resize(block_size_);
+}
+
+
+
+bool lz_frame_reader_t::next_block() const
+{
+  if (at_end_) {
+    return false;
+  }
+
+  consumed_ += block_len_;
+  block_pos_ = block_len_ = 0;
+
+  uint32_t packed = 0;
+  if (frame_.remainder() < 4) {
+    s_throw(std::runtime_error, "Truncated LZ frame");
+    return false;
+  }
+  frame_.read_le(packed);
+  if (packed == 0) {
+    at_end_ = true;
+    return false;
+  }
+
+  uint32_t raw = 0;
+  if (frame_.remainder() < 4) {
+    s_throw(std::runtime_error, "Truncated LZ frame");
+    return false;
+  }
+  frame_.read_le(raw);
+  const bool stored = (packed & BLOCK_STORED) != 0;
+  packed &= ~BLOCK_STORED;
+  if (raw == 0 || raw > block_size_ || packed > frame_.remainder() ||
+      (stored && packed != raw)) {
+    s_throw(std::runtime_error, "Malformed LZ block header at frame offset %td", frame_.tell());
+    return false;
+  }
+
+  const char *src = frame_.pointer();
+  if (stored) {
+    std::memcpy(block_.data(), src, raw);
+  } else if (lz_decompress(src, packed, block_.data(), raw) != raw) {
+    s_throw(std::runtime_error, "Malformed LZ block at frame offset %td", frame_.tell());
+    return false;
+  }
+  frame_.seek(frame_.tell() + packed);
+  block_len_ = raw;
+  return true;
+}
+
+
+
+size_t lz_frame_reader_t::read(void *data, size_t length) const
+{
+  char *dst = static_cast<char *>(data);
+  size_t remaining = length;
+  while (remaining > 0) {
+    if (block_pos_ == block_len_ && !next_block()) {
+      s_throw(std::out_of_range, "Attempt to read %zu bytes past end of LZ frame", remaining);
+      return length - remaining;
+    }
+    const size_t chunk = std::min(remaining, block_len_ - block_pos_);
+    if (dst) {
+      std::memcpy(dst, block_.data() + block_pos_, chunk);
+      dst += chunk;
+    }
+    block_pos_ += chunk;
+    remaining -= chunk;
+  }
+  return length;
+}
+
+
+
+size_t lz_frame_reader_t::read_varint(uint64_t &result) const
+{
+  char encoded[VARINT_MAX_BYTES];
+  size_t length = 0;
+  while (length < VARINT_MAX_BYTES) {
+    read(static_cast<void *>(encoded + length), 1);
+    if (!(encoded[length++] & 0x80)) {
+      break;
+    }
+  }
+  if (decode_varint(encoded, encoded + length, result) != length) {
+    s_throw(std::out_of_range, "Malformed varint in LZ frame");
+    return 0;
+  }
+  return length;
+}
+
+
+
+size_t lz_frame_reader_t::read_svarint(int64_t &result) const
+{
+  uint64_t encoded = 0;
+  const size_t length = read_varint(encoded);
+  result = zigzag_decode(encoded);
+  return length;
+}
+
+
+
+bool lz_frame_reader_t::more() const
+{
+  return block_pos_ < block_len_ || next_block();
+}
+
+
+} // namespace snow
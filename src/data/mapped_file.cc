@@ -0,0 +1,292 @@
+// mapped_file.cc -- Noel Cower -- Public Domain
+#include <snow/data/mapped_file.hh>
+
+#if !S_PLATFORM_WINDOWS
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace snow {
+
+
+namespace {
+
+
+size_t page_size()
+{
+  static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+
+} // namespace <anon>
+
+
+
+mapped_file_t::mapped_file_t() :
+  fd_(-1),
+  mode_(MAP_FILE_READ),
+  data_(nullptr),
+  size_(0)
+{
+  /* nop */
+}
+
+
+
+mapped_file_t::mapped_file_t(mapped_file_t &&other) :
+  fd_(other.fd_),
+  mode_(other.mode_),
+  data_(other.data_),
+  size_(other.size_)
+{
+  other.fd_ = -1;
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+
+
+mapped_file_t &mapped_file_t::operator = (mapped_file_t &&other)
+{
+  if (this != &other) {
+    close();
+    fd_ = other.fd_;
+    mode_ = other.mode_;
+    data_ = other.data_;
+    size_ = other.size_;
+    other.fd_ = -1;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+
+
+mapped_file_t::~mapped_file_t()
+{
+  close();
+}
+
+
+
+bool mapped_file_t::open(const string &path, unsigned mode)
+{
+  close();
+
+  int flags = O_RDONLY;
+  if (mode & MAP_FILE_WRITE) {
+    flags = O_RDWR;
+    if (mode & MAP_FILE_CREATE) {
+      flags |= O_CREAT;
+    }
+    if (mode & MAP_FILE_TRUNCATE) {
+      flags |= O_TRUNC;
+    }
+  }
+#ifdef O_CLOEXEC
+  flags |= O_CLOEXEC;
+#endif
+
+  const int fd = ::open(path.c_str(), flags, 0644);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) == -1) {
+    const int error = errno;
+    ::close(fd);
+    errno = error;
+    return false;
+  }
+
+  fd_ = fd;
+  mode_ = mode;
+  if (!map(static_cast<size_t>(info.st_size))) {
+    const int error = errno;
+    close();
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+
+
+void mapped_file_t::close()
+{
+  unmap();
+  if (fd_ != -1) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+
+
+buffer_stream_t mapped_file_t::stream()
+{
+  return buffer_stream_t(data_, size_);
+}
+
+
+
+const buffer_stream_t mapped_file_t::stream() const
+{
+  return buffer_stream_t(data_, size_);
+}
+
+
+
+bool mapped_file_t::resize(size_t new_size)
+{
+  if (!is_open() || !writable()) {
+    errno = EBADF;
+    return false;
+  } else if (new_size == size_) {
+    return true;
+  }
+
+  if (::ftruncate(fd_, static_cast<off_t>(new_size)) == -1) {
+    return false;
+  }
+
+#if S_PLATFORM_LINUX && defined(MREMAP_MAYMOVE)
+  if (data_ && new_size) {
+    void *remapped = ::mremap(data_, size_, new_size, MREMAP_MAYMOVE);
+    if (remapped == MAP_FAILED) {
+      const int error = errno;
+      // Restore the old size so the existing mapping stays valid.
+      if (::ftruncate(fd_, static_cast<off_t>(size_)) == -1) {
+        s_log("Unable to restore size of mapped file after failed remap\n");
+      }
+      errno = error;
+      return false;
+    }
+    data_ = static_cast<char *>(remapped);
+    size_ = new_size;
+    if (mode_ & MAP_FILE_HUGEPAGE) {
+      advise(MAP_ADVISE_HUGEPAGE);
+    }
+    return true;
+  }
+#endif
+
+  const size_t old_size = size_;
+  unmap();
+  if (!map(new_size)) {
+    const int error = errno;
+    if (::ftruncate(fd_, static_cast<off_t>(old_size)) == -1 || !map(old_size)) {
+      // Nothing is mapped anymore; leave the file open but empty.
+      size_ = 0;
+    }
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+
+
+bool mapped_file_t::flush(bool async, size_t offset, size_t length)
+{
+  if (!data_ || !writable()) {
+    return true;
+  } else if (!page_range(offset, length)) {
+    return true;
+  }
+  return ::msync(data_ + offset, length, async ? MS_ASYNC : MS_SYNC) == 0;
+}
+
+
+
+bool mapped_file_t::advise(mapped_file_advice_t advice, size_t offset, size_t length)
+{
+  int native = 0;
+  switch (advice) {
+  case MAP_ADVISE_NORMAL:     native = MADV_NORMAL; break;
+  case MAP_ADVISE_SEQUENTIAL: native = MADV_SEQUENTIAL; break;
+  case MAP_ADVISE_RANDOM:     native = MADV_RANDOM; break;
+  case MAP_ADVISE_WILLNEED:   native = MADV_WILLNEED; break;
+  case MAP_ADVISE_DONTNEED:   native = MADV_DONTNEED; break;
+  case MAP_ADVISE_HUGEPAGE:
+#ifdef MADV_HUGEPAGE
+    native = MADV_HUGEPAGE;
+    break;
+#else
+    errno = EINVAL;
+    return false;
+#endif
+  default:
+    errno = EINVAL;
+    return false;
+  }
+
+  if (!data_ || !page_range(offset, length)) {
+    return true;
+  }
+  return ::madvise(data_ + offset, length, native) == 0;
+}
+
+
+
+bool mapped_file_t::map(size_t length)
+{
+  size_ = length;
+  data_ = nullptr;
+  if (length == 0) {
+    // mmap can't map zero bytes; an empty file is simply unmapped.
+    return true;
+  }
+
+  const int prot = writable() ? (PROT_READ | PROT_WRITE) : PROT_READ;
+  void *mapped = ::mmap(nullptr, length, prot, MAP_SHARED, fd_, 0);
+  if (mapped == MAP_FAILED) {
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<char *>(mapped);
+  if (mode_ & MAP_FILE_HUGEPAGE) {
+    advise(MAP_ADVISE_HUGEPAGE);
+  }
+  return true;
+}
+
+
+
+void mapped_file_t::unmap()
+{
+  if (data_) {
+    ::munmap(data_, size_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+}
+
+
+
+// Clamps [offset, offset + length) to the mapping and rounds offset down to a
+// page boundary. Returns false if the range is empty.
+bool mapped_file_t::page_range(size_t &offset, size_t &length) const
+{
+  if (offset >= size_) {
+    return false;
+  }
+  length = std::min(length, size_ - offset);
+  const size_t aligned = offset & ~(page_size() - 1);
+  length += offset - aligned;
+  offset = aligned;
+  return length > 0;
+}
+
+
+} // namespace snow
+
+#endif /* !S_PLATFORM_WINDOWS */
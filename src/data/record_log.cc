@@ -0,0 +1,572 @@
+// record_log.cc -- Noel Cower -- Public Domain
+#include <snow/data/record_log.hh>
+
+#if !S_PLATFORM_WINDOWS
+
+#include <snow/data/crc32c.hh>
+#include <snow/data/endian.hh>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace snow {
+
+
+namespace {
+
+
+const uint32_t SEGMENT_MAGIC = 0x4C415753U; // 'SWAL'
+const uint16_t SEGMENT_VERSION = 1;
+const size_t SEGMENT_HEADER_SIZE = 16;
+const size_t FRAME_HEADER_SIZE = 8;
+// 16 hex digits + ".wal"
+const size_t SEGMENT_NAME_LENGTH = 20;
+
+
+string segment_path(const string &directory, uint64_t first_seq)
+{
+  return string::format("%s/%016llx.wal", directory.c_str(),
+                        static_cast<unsigned long long>(first_seq));
+}
+
+
+// Lists the first sequence numbers of the segments in directory, in order.
+bool list_segments(const string &directory, std::vector<uint64_t> &segments)
+{
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+
+  segments.clear();
+  while (const struct dirent *entry = readdir(dir)) {
+    const char *name = entry->d_name;
+    if (std::strlen(name) != SEGMENT_NAME_LENGTH ||
+        std::strcmp(name + SEGMENT_NAME_LENGTH - 4, ".wal") != 0) {
+      continue;
+    }
+    char *end = nullptr;
+    const unsigned long long first_seq = std::strtoull(name, &end, 16);
+    if (end == name + SEGMENT_NAME_LENGTH - 4) {
+      segments.push_back(static_cast<uint64_t>(first_seq));
+    }
+  }
+  closedir(dir);
+
+  std::sort(segments.begin(), segments.end());
+  return true;
+}
+
+
+void frame_header(char *header, const void *data, size_t length)
+{
+  store_le<uint32_t>(header, static_cast<uint32_t>(length));
+  store_le<uint32_t>(header + 4, crc32c(data, length, crc32c(header, 4)));
+}
+
+
+// Returns the length of the intact frame at offset, or -1 if the frame is
+// torn, corrupt, or runs past size.
+ptrdiff_t check_frame(const char *data, size_t size, size_t offset)
+{
+  if (size - offset < FRAME_HEADER_SIZE) {
+    return -1;
+  }
+  const char *header = data + offset;
+  const uint32_t length = load_le<uint32_t>(header);
+  if (length > size - offset - FRAME_HEADER_SIZE ||
+      crc32c(header + FRAME_HEADER_SIZE, length, crc32c(header, 4)) !=
+        load_le<uint32_t>(header + 4)) {
+    return -1;
+  }
+  return static_cast<ptrdiff_t>(length);
+}
+
+
+bool check_segment_header(const char *data, size_t size, uint64_t first_seq)
+{
+  return size >= SEGMENT_HEADER_SIZE &&
+         load_le<uint32_t>(data) == SEGMENT_MAGIC &&
+         load_le<uint16_t>(data + 4) == SEGMENT_VERSION &&
+         load_le<uint64_t>(data + 8) == first_seq;
+}
+
+
+bool write_all(int fd, const char *data, size_t length)
+{
+  while (length > 0) {
+    const ssize_t written = ::write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    length -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+
+bool sync_data(int fd)
+{
+#if S_PLATFORM_LINUX
+  return fdatasync(fd) == 0;
+#else
+  return fsync(fd) == 0;
+#endif
+}
+
+
+// Makes a newly created file's directory entry durable.
+bool sync_directory(const string &directory)
+{
+  const int fd = ::open(directory.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  const bool synced = fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+
+
+} // namespace <anon>
+
+
+
+/*==============================================================================
+  record_log_t
+==============================================================================*/
+
+record_log_t::record_log_t() :
+  segment_size_(RECORD_LOG_SEGMENT_SIZE),
+  batch_size_(RECORD_LOG_BATCH_SIZE),
+  sync_(true),
+  pending_first_(0),
+  next_seq_(0),
+  written_(0),
+  durable_(0),
+  open_(false),
+  writing_(false),
+  failed_(false),
+  error_(0),
+  fd_(-1),
+  segment_bytes_(0)
+{
+  /* nop */
+}
+
+
+
+record_log_t::~record_log_t()
+{
+  close();
+}
+
+
+
+bool record_log_t::open(const string &directory, size_t segment_size, size_t batch_size,
+                        bool sync)
+{
+  close();
+
+  directory_ = directory;
+  segment_size_ = std::max(segment_size, SEGMENT_HEADER_SIZE + 1);
+  batch_size_ = batch_size;
+  sync_ = sync;
+  failed_ = false;
+  error_ = 0;
+
+  std::vector<uint64_t> segments;
+  if (!list_segments(directory_, segments)) {
+    return false;
+  }
+
+  uint64_t next_seq = 0;
+  if (segments.empty()) {
+    if ((fd_ = open_segment(0)) == -1) {
+      return false;
+    }
+  } else {
+    // Find the end of the last intact frame in the last segment.
+    const uint64_t first_seq = segments.back();
+    const string path = segment_path(directory_, first_seq);
+    mapped_file_t file;
+    if (!file.open(path)) {
+      return false;
+    }
+
+    if (!check_segment_header(file.data(), file.size(), first_seq)) {
+      // Crashed while creating the segment -- start it over.
+      file.close();
+      if ((fd_ = open_segment(first_seq)) == -1) {
+        return false;
+      }
+      next_seq = first_seq;
+    } else {
+      size_t end = SEGMENT_HEADER_SIZE;
+      uint64_t count = 0;
+      for (ptrdiff_t length; (length = check_frame(file.data(), file.size(), end)) >= 0; ++count) {
+        end += FRAME_HEADER_SIZE + static_cast<size_t>(length);
+      }
+      const bool torn = end != file.size();
+      file.close();
+
+      int fd = ::open(path.c_str(), O_WRONLY
+#ifdef O_CLOEXEC
+                      | O_CLOEXEC
+#endif
+                      );
+      if (fd == -1) {
+        return false;
+      } else if ((torn && (ftruncate(fd, static_cast<off_t>(end)) != 0 || !sync_data(fd))) ||
+                 lseek(fd, static_cast<off_t>(end), SEEK_SET) == -1) {
+        const int error = errno;
+        ::close(fd);
+        errno = error;
+        return false;
+      }
+      fd_ = fd;
+      segment_bytes_ = end;
+      next_seq = first_seq + count;
+    }
+  }
+
+  segment_bytes_ = std::max(segment_bytes_, SEGMENT_HEADER_SIZE);
+  pending_first_ = next_seq_ = written_ = durable_ = next_seq;
+  open_ = true;
+  return true;
+}
+
+
+
+bool record_log_t::close()
+{
+  if (!open_) {
+    return true;
+  }
+  const bool committed = commit();
+  open_ = false;
+  ::close(fd_);
+  fd_ = -1;
+  segment_bytes_ = 0;
+  pending_.clear();
+  return committed;
+}
+
+
+
+uint64_t record_log_t::append(const void *data, size_t length)
+{
+  if (length > RECORD_LOG_MAX_RECORD) {
+    s_throw(std::length_error, "Record of %zu bytes exceeds RECORD_LOG_MAX_RECORD", length);
+    return 0;
+  }
+
+  char header[FRAME_HEADER_SIZE];
+  frame_header(header, data, length);
+
+  std::unique_lock<std::mutex> lock(lock_);
+  if (!open_) {
+    s_throw(std::logic_error, "Attempt to append to a closed record log");
+    return 0;
+  } else if (failed_) {
+    s_throw(std::runtime_error, "Attempt to append to a failed record log (%s)",
+            std::strerror(error_));
+    return 0;
+  }
+
+  pending_.write(header, sizeof(header));
+  if (length) {
+    pending_.write(data, length);
+  }
+  const uint64_t seq = next_seq_++;
+
+  if (pending_.size() >= batch_size_ && !writing_) {
+    write_batch(lock, false);
+  }
+  return seq;
+}
+
+
+
+bool record_log_t::commit(uint64_t seq)
+{
+  std::unique_lock<std::mutex> lock(lock_);
+  if (seq >= next_seq_) {
+    s_throw(std::out_of_range, "Attempt to commit record %llu, which hasn't been appended",
+            static_cast<unsigned long long>(seq));
+    return false;
+  }
+
+  for (;;) {
+    if ((sync_ ? durable_ : written_) > seq) {
+      return true;
+    } else if (failed_) {
+      errno = error_;
+      return false;
+    } else if (!writing_) {
+      // Become the writer for everything appended so far.
+      write_batch(lock, sync_);
+    } else {
+      cond_.wait(lock);
+    }
+  }
+}
+
+
+
+bool record_log_t::commit()
+{
+  uint64_t next_seq;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (failed_) {
+      errno = error_;
+      return false;
+    }
+    next_seq = next_seq_;
+  }
+  return next_seq == 0 || commit(next_seq - 1);
+}
+
+
+
+uint64_t record_log_t::next_seq() const
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  return next_seq_;
+}
+
+
+
+uint64_t record_log_t::committed() const
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  return sync_ ? durable_ : written_;
+}
+
+
+
+bool record_log_t::failed() const
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  return failed_;
+}
+
+
+
+// Writes (and optionally syncs) the pending batch with the lock released, so
+// other threads can keep appending to the next batch. Only one thread writes
+// at a time.
+bool record_log_t::write_batch(std::unique_lock<std::mutex> &lock, bool sync)
+{
+  writing_ = true;
+  batch_.swap(pending_);
+  const uint64_t first_seq = pending_first_;
+  const uint64_t end_seq = next_seq_;
+  pending_first_ = next_seq_;
+  lock.unlock();
+
+  bool ok = true;
+  if (batch_.size() > 0) {
+    if (segment_bytes_ >= segment_size_) {
+      ok = rotate(first_seq);
+    }
+    if (ok) {
+      ok = write_all(fd_, batch_.data(), batch_.size());
+      segment_bytes_ += batch_.size();
+    }
+  }
+  if (ok && sync) {
+    ok = sync_data(fd_);
+  }
+  const int error = ok ? 0 : errno;
+  batch_.clear();
+
+  lock.lock();
+  writing_ = false;
+  if (ok) {
+    written_ = end_seq;
+    if (sync) {
+      durable_ = end_seq;
+    }
+  } else {
+    failed_ = true;
+    error_ = error;
+  }
+  cond_.notify_all();
+  return ok;
+}
+
+
+
+bool record_log_t::rotate(uint64_t first_seq)
+{
+  // Earlier unsynced batches in the old segment must be durable before
+  // anything in the new one is reported durable.
+  if (sync_ && !sync_data(fd_)) {
+    return false;
+  }
+  const int fd = open_segment(first_seq);
+  if (fd == -1) {
+    return false;
+  }
+  ::close(fd_);
+  fd_ = fd;
+  segment_bytes_ = SEGMENT_HEADER_SIZE;
+  return true;
+}
+
+
+
+// Creates (or recreates) a segment and writes its header. Returns its
+// descriptor, or -1 on failure.
+int record_log_t::open_segment(uint64_t first_seq)
+{
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_CLOEXEC
+  flags |= O_CLOEXEC;
+#endif
+  const int fd = ::open(segment_path(directory_, first_seq).c_str(), flags, 0644);
+  if (fd == -1) {
+    return -1;
+  }
+
+  char header[SEGMENT_HEADER_SIZE];
+  store_le<uint32_t>(header, SEGMENT_MAGIC);
+  store_le<uint16_t>(header + 4, SEGMENT_VERSION);
+  store_le<uint16_t>(header + 6, 0);
+  store_le<uint64_t>(header + 8, first_seq);
+  if (!write_all(fd, header, sizeof(header)) ||
+      (sync_ && (!sync_data(fd) || !sync_directory(directory_)))) {
+    const int error = errno;
+    ::close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+
+
+/*==============================================================================
+  record_log_reader_t
+==============================================================================*/
+
+record_log_reader_t::record_log_reader_t() :
+  segment_index_(0),
+  offset_(0),
+  seq_(0),
+  from_seq_(0),
+  damaged_(false)
+{
+  /* nop */
+}
+
+
+
+bool record_log_reader_t::open(const string &directory, uint64_t from_seq)
+{
+  close();
+  directory_ = directory;
+  if (!list_segments(directory_, segments_)) {
+    return false;
+  }
+
+  // Start at the last segment beginning at or before from_seq.
+  size_t start = 0;
+  while (start + 1 < segments_.size() && segments_[start + 1] <= from_seq) {
+    ++start;
+  }
+  from_seq_ = from_seq;
+  open_segment(start);
+  return true;
+}
+
+
+
+void record_log_reader_t::close()
+{
+  file_.close();
+  segments_.clear();
+  segment_index_ = 0;
+  offset_ = 0;
+  seq_ = 0;
+  from_seq_ = 0;
+  damaged_ = false;
+}
+
+
+
+bool record_log_reader_t::next(string_ref_t &record, uint64_t *seq)
+{
+  while (segment_index_ < segments_.size()) {
+    if (file_.is_open()) {
+      const char *data = file_.data();
+      const size_t size = file_.size();
+      const ptrdiff_t length = check_frame(data, size, offset_);
+      if (length >= 0) {
+        const uint64_t record_seq = seq_++;
+        const char *payload = data + offset_ + FRAME_HEADER_SIZE;
+        offset_ += FRAME_HEADER_SIZE + static_cast<size_t>(length);
+        if (record_seq < from_seq_) {
+          continue;
+        }
+        record = string_ref_t(payload, static_cast<size_t>(length));
+        if (seq) {
+          *seq = record_seq;
+        }
+        return true;
+      }
+
+      // Anything left over in a segment that isn't the last is damage. In the
+      // last segment, it's a torn write.
+      if (offset_ != size && segment_index_ + 1 < segments_.size()) {
+        damaged_ = true;
+      }
+    }
+    open_segment(segment_index_ + 1);
+  }
+  return false;
+}
+
+
+
+bool record_log_reader_t::open_segment(size_t index)
+{
+  file_.close();
+  segment_index_ = index;
+  if (index >= segments_.size()) {
+    return false;
+  }
+
+  const uint64_t first_seq = segments_[index];
+  if (!file_.open(segment_path(directory_, first_seq))) {
+    damaged_ = true;
+    return false;
+  } else if (!check_segment_header(file_.data(), file_.size(), first_seq)) {
+    file_.close();
+    // An empty or headerless last segment is one that was being created.
+    if (index + 1 < segments_.size()) {
+      damaged_ = true;
+    }
+    return false;
+  }
+
+  file_.advise(MAP_ADVISE_SEQUENTIAL);
+  offset_ = SEGMENT_HEADER_SIZE;
+  seq_ = first_seq;
+  return true;
+}
+
+
+} // namespace snow
+
+#endif /* !S_PLATFORM_WINDOWS */
@@ -0,0 +1,292 @@
+// segment_list.cc -- Noel Cower -- Public Domain
+#include <snow/data/segment_list.hh>
+#include <algorithm>
+#include <cstring>
+
+#if !S_PLATFORM_WINDOWS
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#endif
+
+
+namespace snow {
+
+
+namespace {
+
+
+#if !S_PLATFORM_WINDOWS
+#ifdef IOV_MAX
+const size_t MAX_IOVECS = IOV_MAX;
+#else
+const size_t MAX_IOVECS = 1024;
+#endif
+#endif
+
+
+} // namespace <anon>
+
+
+
+segment_list_t::segment_list_t() :
+  first_(0),
+  size_(0),
+  block_ptr_(nullptr),
+  block_remaining_(0)
+{
+  /* nop */
+}
+
+
+
+void segment_list_t::append(const void *data, size_t length)
+{
+  if (length == 0) {
+    return;
+  }
+  assert(data != nullptr);
+  struct iovec segment;
+  segment.iov_base = const_cast<void *>(data);
+  segment.iov_len = length;
+  segments_.push_back(segment);
+  size_ += length;
+}
+
+
+
+void segment_list_t::append_copy(const void *data, size_t length)
+{
+  if (length == 0) {
+    return;
+  }
+
+  if (length > block_remaining_) {
+    const size_t block_size = std::max(length, COPY_BLOCK_SIZE);
+    blocks_.emplace_back(new char[block_size]);
+    block_ptr_ = blocks_.back().get();
+    block_remaining_ = block_size;
+  }
+
+  char *dst = block_ptr_;
+  std::memcpy(dst, data, length);
+  block_ptr_ += length;
+  block_remaining_ -= length;
+
+  // Merge with the previous segment if this copy directly follows it.
+  if (segment_count() > 0) {
+    struct iovec &last = segments_.back();
+    if (static_cast<char *>(last.iov_base) + last.iov_len == dst) {
+      last.iov_len += length;
+      size_ += length;
+      return;
+    }
+  }
+
+  append(dst, length);
+}
+
+
+
+void segment_list_t::append_varint(uint64_t value)
+{
+  char encoded[VARINT_MAX_BYTES];
+  append_copy(encoded, encode_varint(value, encoded));
+}
+
+
+
+void segment_list_t::consume(size_t length)
+{
+  if (length >= size_) {
+    clear();
+    return;
+  }
+
+  size_ -= length;
+  while (length > 0) {
+    struct iovec &segment = segments_[first_];
+    if (length < segment.iov_len) {
+      segment.iov_base = static_cast<char *>(segment.iov_base) + length;
+      segment.iov_len -= length;
+      break;
+    }
+    length -= segment.iov_len;
+    ++first_;
+  }
+}
+
+
+
+void segment_list_t::clear()
+{
+  segments_.clear();
+  first_ = 0;
+  size_ = 0;
+  blocks_.clear();
+  block_ptr_ = nullptr;
+  block_remaining_ = 0;
+}
+
+
+
+size_t segment_list_t::gather(void *out) const
+{
+  char *dst = static_cast<char *>(out);
+  for (size_t index = first_; index < segments_.size(); ++index) {
+    std::memcpy(dst, segments_[index].iov_base, segments_[index].iov_len);
+    dst += segments_[index].iov_len;
+  }
+  return size_;
+}
+
+
+
+#if !S_PLATFORM_WINDOWS
+ssize_t segment_list_t::write_to(int fd)
+{
+  ssize_t total = 0;
+  while (!empty()) {
+    const int count = static_cast<int>(std::min(segment_count(), MAX_IOVECS));
+    const ssize_t written = ::writev(fd, segments(), count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return total > 0 ? total : -1;
+    } else if (written == 0) {
+      break;
+    }
+    consume(static_cast<size_t>(written));
+    total += written;
+  }
+  return total;
+}
+#endif
+
+
+
+segment_reader_t::segment_reader_t(const struct iovec *segments, size_t count) :
+  segment_(segments),
+  segment_end_(segments + count),
+  offset_(0),
+  remaining_(0),
+  total_(0)
+{
+  for (size_t index = 0; index < count; ++index) {
+    total_ += segments[index].iov_len;
+  }
+  remaining_ = total_;
+  advance_empty();
+}
+
+
+
+segment_reader_t::segment_reader_t(const segment_list_t &list) :
+  segment_reader_t(list.segments(), list.segment_count())
+{
+  /* nop */
+}
+
+
+
+void segment_reader_t::advance_empty() const
+{
+  while (segment_ < segment_end_ && offset_ == segment_->iov_len) {
+    ++segment_;
+    offset_ = 0;
+  }
+}
+
+
+
+size_t segment_reader_t::read(void *data, size_t length) const
+{
+  if (length > remaining_) {
+    s_throw(std::out_of_range, "Attempt to read %zu bytes with only %zu remaining",
+      length, remaining_);
+    return 0;
+  }
+
+  char *dst = static_cast<char *>(data);
+  size_t needed = length;
+  while (needed > 0) {
+    const size_t available = segment_->iov_len - offset_;
+    const size_t chunk = std::min(available, needed);
+    if (dst) {
+      std::memcpy(dst, static_cast<const char *>(segment_->iov_base) + offset_, chunk);
+      dst += chunk;
+    }
+    offset_ += chunk;
+    needed -= chunk;
+    advance_empty();
+  }
+  remaining_ -= length;
+  return length;
+}
+
+
+
+size_t segment_reader_t::read_varint(uint64_t &result) const
+{
+  // Fast path: the whole varint is in the current segment.
+  if (segment_ < segment_end_) {
+    const char *start = static_cast<const char *>(segment_->iov_base) + offset_;
+    const char *end = static_cast<const char *>(segment_->iov_base) + segment_->iov_len;
+    const size_t length = decode_varint(start, end, result);
+    if (length > 0) {
+      return skip(length);
+    }
+  }
+
+  // Slow path: copy the varint out byte by byte, restoring the position if
+  // it turns out to be malformed.
+  const struct iovec *const segment = segment_;
+  const size_t offset = offset_;
+  const size_t remaining = remaining_;
+
+  char encoded[VARINT_MAX_BYTES];
+  const size_t available = std::min(remaining_, VARINT_MAX_BYTES);
+  size_t length = 0;
+  for (; length < available; ++length) {
+    read(static_cast<void *>(encoded + length), 1);
+    if (!(encoded[length] & 0x80)) {
+      ++length;
+      break;
+    }
+  }
+
+  if (length == 0 || decode_varint(encoded, encoded + length, result) != length) {
+    segment_ = segment;
+    offset_ = offset;
+    remaining_ = remaining;
+    s_throw(std::out_of_range, "Truncated or malformed varint at offset %zu", tell());
+    return 0;
+  }
+  return length;
+}
+
+
+
+size_t segment_reader_t::read_svarint(int64_t &result) const
+{
+  uint64_t encoded = 0;
+  const size_t length = read_varint(encoded);
+  result = zigzag_decode(encoded);
+  return length;
+}
+
+
+
+const char *segment_reader_t::contiguous(size_t length) const
+{
+  if (segment_ == segment_end_ || length > segment_->iov_len - offset_) {
+    return nullptr;
+  }
+  const char *result = static_cast<const char *>(segment_->iov_base) + offset_;
+  skip(length);
+  return result;
+}
+
+
+} // namespace snow
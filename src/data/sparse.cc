@@ -100,12 +100,15 @@ parser_t::parser_t(int options, parse_func_t callback)
     state_.error = "Invalid parser function";
   } else {
     state_.buffer.reserve(SP_INIT_BUFFER_CAPACITY);
+    s_memory_usage_update(buffer_usage_, state_.buffer.capacity());
   }
 }
 
 parser_t::parser_t(const parser_t &other)
   : options_(other.options_), state_(other.state_)
-{}
+{
+  s_memory_usage_update(buffer_usage_, state_.buffer.capacity());
+}
 
 parser_t::~parser_t()
 {
@@ -222,6 +225,8 @@ void parser_t::add_source(const string &source)
 
     state_.last_char = current;
   }
+
+  s_memory_usage_update(buffer_usage_, state_.buffer.capacity());
 }
 
 void parser_t::close()
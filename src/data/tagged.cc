@@ -0,0 +1,604 @@
+// tagged.cc -- Noel Cower -- Public Domain
+#include <snow/data/tagged.hh>
+#include <snow/data/hash.hh>
+#include <snow/data/varint.hh>
+#include <algorithm>
+#include <cstring>
+
+
+namespace snow {
+
+
+namespace {
+
+
+const uint32_t DOCUMENT_MAGIC = 0x47415453U; // 'STAG'
+const uint8_t DOCUMENT_VERSION = 1;
+const size_t DOCUMENT_HEADER_SIZE = 8;
+// u32 size + u32 count
+const size_t CONTAINER_HEADER_SIZE = 8;
+
+
+const tagged_type_t g_tag_types[TAG_COUNT] = {
+  TAGGED_NIL,     // TAG_NIL
+  TAGGED_BOOL,    // TAG_FALSE
+  TAGGED_BOOL,    // TAG_TRUE
+  TAGGED_INT,     // TAG_INT
+  TAGGED_UINT,    // TAG_UINT
+  TAGGED_FLOAT,   // TAG_F32
+  TAGGED_FLOAT,   // TAG_F64
+  TAGGED_STRING,  // TAG_STRING
+  TAGGED_BLOB,    // TAG_BLOB
+  TAGGED_VEC3,    // TAG_VEC3_F32
+  TAGGED_VEC3,    // TAG_VEC3_F64
+  TAGGED_QUAT,    // TAG_QUAT_F32
+  TAGGED_QUAT,    // TAG_QUAT_F64
+  TAGGED_MAT4,    // TAG_MAT4_F32
+  TAGGED_MAT4,    // TAG_MAT4_F64
+  TAGGED_ARRAY,   // TAG_ARRAY
+  TAGGED_MAP,     // TAG_MAP
+};
+
+
+inline uint32_t key_hash(const char *key, size_t length)
+{
+  return hash32(key, length);
+}
+
+
+inline tagged_tag_t tag_of(const char *data)
+{
+  return static_cast<tagged_tag_t>(static_cast<uint8_t>(*data));
+}
+
+
+// Decodes a varint length followed by that many bytes from [ptr, end).
+// Returns false if either runs past end.
+bool decode_bytes(const char *ptr, const char *end, string_ref_t &result)
+{
+  uint64_t length = 0;
+  const size_t header = decode_varint(ptr, end, length);
+  if (header == 0 || length > static_cast<uint64_t>(end - ptr) - header) {
+    return false;
+  }
+  result = string_ref_t(ptr + header, static_cast<size_t>(length));
+  return true;
+}
+
+
+void malformed(const char *what)
+{
+  s_throw(std::runtime_error, "Malformed tagged document: %s", what);
+}
+
+
+} // namespace <anon>
+
+
+
+/*==============================================================================
+  tagged_writer_t
+==============================================================================*/
+
+tagged_writer_t::tagged_writer_t(buffer_writer_t &out) :
+  out_(out),
+  expect_value_(false),
+  root_written_(false)
+{
+  char header[DOCUMENT_HEADER_SIZE];
+  store_le<uint32_t>(header, DOCUMENT_MAGIC);
+  header[4] = static_cast<char>(DOCUMENT_VERSION);
+  header[5] = header[6] = header[7] = 0;
+  out_.write(header, sizeof(header));
+}
+
+
+
+void tagged_writer_t::write_nil()
+{
+  begin_value();
+  out_.write<uint8_t>(TAG_NIL);
+}
+
+
+
+void tagged_writer_t::write_bool(bool value)
+{
+  begin_value();
+  out_.write<uint8_t>(value ? TAG_TRUE : TAG_FALSE);
+}
+
+
+
+void tagged_writer_t::write_int(int64_t value)
+{
+  begin_value();
+  out_.write<uint8_t>(TAG_INT);
+  out_.write_svarint(value);
+}
+
+
+
+void tagged_writer_t::write_uint(uint64_t value)
+{
+  begin_value();
+  out_.write<uint8_t>(TAG_UINT);
+  out_.write_varint(value);
+}
+
+
+
+void tagged_writer_t::write_float(float value)
+{
+  begin_value();
+  out_.write<uint8_t>(TAG_F32);
+  out_.write_le(value);
+}
+
+
+
+void tagged_writer_t::write_double(double value)
+{
+  begin_value();
+  out_.write<uint8_t>(TAG_F64);
+  out_.write_le(value);
+}
+
+
+
+void tagged_writer_t::write_string(const string_ref_t &value)
+{
+  begin_value();
+  out_.write<uint8_t>(TAG_STRING);
+  out_.write_varint(value.size());
+  out_.write(value.data(), value.size());
+}
+
+
+
+void tagged_writer_t::write_blob(const void *data, size_t length)
+{
+  begin_value();
+  out_.write<uint8_t>(TAG_BLOB);
+  out_.write_varint(length);
+  out_.write(data, length);
+}
+
+
+
+void tagged_writer_t::begin_array()
+{
+  begin_container(TAG_ARRAY);
+}
+
+
+
+void tagged_writer_t::end_array()
+{
+  end_container(false);
+}
+
+
+
+void tagged_writer_t::begin_map()
+{
+  begin_container(TAG_MAP);
+}
+
+
+
+void tagged_writer_t::end_map()
+{
+  end_container(true);
+}
+
+
+
+void tagged_writer_t::key(const string_ref_t &name)
+{
+  if (frames_.empty() || !frames_.back().is_map) {
+    s_throw(std::logic_error, "tagged_writer_t: key written outside of a map");
+    return;
+  } else if (expect_value_) {
+    s_throw(std::logic_error, "tagged_writer_t: key written without a value for the previous key");
+    return;
+  }
+
+  index_entry_t entry = { key_hash(name.data(), name.size()), body_offset(frames_.back()) };
+  index_.push_back(entry);
+  out_.write_varint(name.size());
+  out_.write(name.data(), name.size());
+  expect_value_ = true;
+}
+
+
+
+void tagged_writer_t::begin_value()
+{
+  if (frames_.empty()) {
+    if (root_written_) {
+      s_throw(std::logic_error, "tagged_writer_t: a document has only one root value");
+      return;
+    }
+    root_written_ = true;
+  } else if (frames_.back().is_map) {
+    if (!expect_value_) {
+      s_throw(std::logic_error, "tagged_writer_t: map value written without a key");
+      return;
+    }
+    expect_value_ = false;
+  } else {
+    index_entry_t entry = { 0, body_offset(frames_.back()) };
+    index_.push_back(entry);
+  }
+}
+
+
+
+void tagged_writer_t::begin_container(tagged_tag_t tag)
+{
+  begin_value();
+  out_.write<uint8_t>(tag);
+  // Size and count are patched by end_container.
+  std::memset(out_.append(CONTAINER_HEADER_SIZE), 0, CONTAINER_HEADER_SIZE);
+  frame_t frame = { out_.size() - sizeof(uint32_t), index_.size(), tag == TAG_MAP };
+  frames_.push_back(frame);
+}
+
+
+
+void tagged_writer_t::end_container(bool is_map)
+{
+  if (frames_.empty() || frames_.back().is_map != is_map) {
+    s_throw(std::logic_error, "tagged_writer_t: end_%s without a matching begin_%s",
+            is_map ? "map" : "array", is_map ? "map" : "array");
+    return;
+  } else if (expect_value_) {
+    s_throw(std::logic_error, "tagged_writer_t: map closed without a value for its last key");
+    return;
+  }
+
+  const frame_t frame = frames_.back();
+  frames_.pop_back();
+
+  const auto first = index_.begin() + frame.first;
+  const size_t count = index_.size() - frame.first;
+  if (is_map) {
+    std::stable_sort(first, index_.end(),
+      [](const index_entry_t &lhs, const index_entry_t &rhs) {
+        return lhs.hash < rhs.hash;
+      });
+    char *dst = out_.append(count * 8);
+    for (auto iter = first; iter != index_.end(); ++iter, dst += 8) {
+      store_le<uint32_t>(dst, iter->hash);
+      store_le<uint32_t>(dst + 4, iter->offset);
+    }
+  } else {
+    char *dst = out_.append(count * 4);
+    for (auto iter = first; iter != index_.end(); ++iter, dst += 4) {
+      store_le<uint32_t>(dst, iter->offset);
+    }
+  }
+  index_.erase(first, index_.end());
+
+  const uint32_t size = body_offset(frame);
+  out_.patch_le<uint32_t>(frame.body - sizeof(uint32_t), size);
+  out_.patch_le<uint32_t>(frame.body, static_cast<uint32_t>(count));
+}
+
+
+
+uint32_t tagged_writer_t::body_offset(const frame_t &frame) const
+{
+  const size_t offset = out_.size() - frame.body;
+  if (offset > UINT32_MAX) {
+    s_throw(std::length_error, "tagged_writer_t: container exceeds 4GB");
+    return 0;
+  }
+  return static_cast<uint32_t>(offset);
+}
+
+
+
+/*==============================================================================
+  tagged_value_t
+==============================================================================*/
+
+tagged_type_t tagged_value_t::type() const
+{
+  if (!data_) {
+    return TAGGED_INVALID;
+  }
+  const tagged_tag_t tag = tag_of(data_);
+  if (tag >= TAG_COUNT) {
+    malformed("unknown tag");
+    return TAGGED_INVALID;
+  }
+  return g_tag_types[tag];
+}
+
+
+
+bool tagged_value_t::as_bool() const
+{
+  const tagged_type_t kind = type();
+  if (kind != TAGGED_BOOL) {
+    s_throw(std::invalid_argument, "Tagged value of type %d is not a bool", kind);
+    return false;
+  }
+  return tag_of(data_) == TAG_TRUE;
+}
+
+
+
+int64_t tagged_value_t::as_int() const
+{
+  const tagged_type_t kind = type();
+  if (kind == TAGGED_INT) {
+    return zigzag_decode(read_varint_payload());
+  } else if (kind == TAGGED_UINT) {
+    const uint64_t value = read_varint_payload();
+    if (value > static_cast<uint64_t>(INT64_MAX)) {
+      s_throw(std::out_of_range, "Tagged uint %llu does not fit in an int64_t",
+              static_cast<unsigned long long>(value));
+      return 0;
+    }
+    return static_cast<int64_t>(value);
+  }
+  s_throw(std::invalid_argument, "Tagged value of type %d is not an integer", kind);
+  return 0;
+}
+
+
+
+uint64_t tagged_value_t::as_uint() const
+{
+  const tagged_type_t kind = type();
+  if (kind == TAGGED_UINT) {
+    return read_varint_payload();
+  } else if (kind == TAGGED_INT) {
+    const int64_t value = zigzag_decode(read_varint_payload());
+    if (value < 0) {
+      s_throw(std::out_of_range, "Tagged int %lld is negative",
+              static_cast<long long>(value));
+      return 0;
+    }
+    return static_cast<uint64_t>(value);
+  }
+  s_throw(std::invalid_argument, "Tagged value of type %d is not an integer", kind);
+  return 0;
+}
+
+
+
+double tagged_value_t::as_double() const
+{
+  switch (type()) {
+  case TAGGED_FLOAT:
+    if (tag_of(data_) == TAG_F32) {
+      if (end_ - data_ < 5) {
+        malformed("truncated float");
+        return 0;
+      }
+      return load_le<float>(data_ + 1);
+    } else {
+      if (end_ - data_ < 9) {
+        malformed("truncated double");
+        return 0;
+      }
+      return load_le<double>(data_ + 1);
+    }
+  case TAGGED_INT:
+    return static_cast<double>(as_int());
+  case TAGGED_UINT:
+    return static_cast<double>(as_uint());
+  default:
+    s_throw(std::invalid_argument, "Tagged value of type %d is not a number", type());
+    return 0;
+  }
+}
+
+
+
+string_ref_t tagged_value_t::as_string() const
+{
+  return read_bytes(TAG_STRING);
+}
+
+
+
+string_ref_t tagged_value_t::as_blob() const
+{
+  return read_bytes(TAG_BLOB);
+}
+
+
+
+size_t tagged_value_t::size() const
+{
+  const tagged_type_t kind = type();
+  if (kind != TAGGED_ARRAY && kind != TAGGED_MAP) {
+    return 0;
+  }
+  uint32_t count = 0;
+  const char *index = nullptr;
+  container(tag_of(data_), count, index);
+  return count;
+}
+
+
+
+tagged_value_t tagged_value_t::at(size_t index) const
+{
+  uint32_t count = 0;
+  const char *table = nullptr;
+  const char *body = container(TAG_ARRAY, count, table);
+  if (index >= count) {
+    return tagged_value_t();
+  }
+  const uint32_t offset = load_le<uint32_t>(table + index * 4);
+  if (offset < sizeof(uint32_t) || offset >= static_cast<size_t>(table - body)) {
+    malformed("array offset out of range");
+    return tagged_value_t();
+  }
+  return tagged_value_t(body + offset, table);
+}
+
+
+
+tagged_value_t tagged_value_t::find(const string_ref_t &key) const
+{
+  uint32_t count = 0;
+  const char *table = nullptr;
+  container(TAG_MAP, count, table);
+  const uint32_t hash = key_hash(key.data(), key.size());
+
+  // Binary search for the first entry with the key's hash.
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (load_le<uint32_t>(table + mid * 8) < hash) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  for (; low < count && load_le<uint32_t>(table + low * 8) == hash; ++low) {
+    if (key_at(low) == key) {
+      return value_at(low);
+    }
+  }
+  return tagged_value_t();
+}
+
+
+
+string_ref_t tagged_value_t::key_at(size_t index) const
+{
+  uint32_t count = 0;
+  const char *table = nullptr;
+  const char *body = container(TAG_MAP, count, table);
+  if (index >= count) {
+    s_throw(std::out_of_range, "Map entry %zu out of range (size %u)", index, count);
+    return string_ref_t();
+  }
+  const uint32_t offset = load_le<uint32_t>(table + index * 8 + 4);
+  string_ref_t key;
+  if (offset < sizeof(uint32_t) || offset >= static_cast<size_t>(table - body) ||
+      !decode_bytes(body + offset, table, key)) {
+    malformed("map key out of range");
+    return string_ref_t();
+  }
+  return key;
+}
+
+
+
+tagged_value_t tagged_value_t::value_at(size_t index) const
+{
+  uint32_t count = 0;
+  const char *table = nullptr;
+  container(TAG_MAP, count, table);
+  const string_ref_t key = key_at(index);
+  const char *value = key.data() + key.size();
+  if (value >= table) {
+    malformed("map value out of range");
+    return tagged_value_t();
+  }
+  return tagged_value_t(value, table);
+}
+
+
+
+const char *tagged_value_t::native_data(tagged_tag_t f32_tag, size_t components,
+                                        bool &is_double) const
+{
+  if (!data_ || (tag_of(data_) != f32_tag && tag_of(data_) != f32_tag + 1)) {
+    s_throw(std::invalid_argument, "Tagged value of type %d is not a %s", type(),
+            f32_tag == TAG_VEC3_F32 ? "vec3" : f32_tag == TAG_QUAT_F32 ? "quat" : "mat4");
+    return nullptr;
+  }
+  is_double = tag_of(data_) != f32_tag;
+  const size_t length = components * (is_double ? sizeof(double) : sizeof(float));
+  if (static_cast<size_t>(end_ - data_) - 1 < length) {
+    malformed("truncated native value");
+    return nullptr;
+  }
+  return data_ + 1;
+}
+
+
+
+// Validates the container header and returns a pointer to its count field
+// (the base for its offsets). table is set to the start of its index.
+const char *tagged_value_t::container(tagged_tag_t tag, uint32_t &count,
+                                      const char *&table) const
+{
+  if (!data_ || tag_of(data_) != tag) {
+    s_throw(std::invalid_argument, "Tagged value of type %d is not %s", type(),
+            tag == TAG_MAP ? "a map" : "an array");
+    return nullptr;
+  }
+  const size_t available = static_cast<size_t>(end_ - data_) - 1;
+  if (available < CONTAINER_HEADER_SIZE) {
+    malformed("truncated container header");
+    return nullptr;
+  }
+  const uint32_t size = load_le<uint32_t>(data_ + 1);
+  const char *body = data_ + 1 + sizeof(uint32_t);
+  count = load_le<uint32_t>(body);
+  const size_t entry_size = tag == TAG_MAP ? 8 : 4;
+  if (size > available - sizeof(uint32_t) || size < sizeof(uint32_t) ||
+      count > (size - sizeof(uint32_t)) / entry_size) {
+    malformed("container size out of range");
+    return nullptr;
+  }
+  table = body + size - count * entry_size;
+  return body;
+}
+
+
+
+string_ref_t tagged_value_t::read_bytes(tagged_tag_t tag) const
+{
+  if (!data_ || tag_of(data_) != tag) {
+    s_throw(std::invalid_argument, "Tagged value of type %d is not a %s", type(),
+            tag == TAG_STRING ? "string" : "blob");
+    return string_ref_t();
+  }
+  string_ref_t result;
+  if (!decode_bytes(data_ + 1, end_, result)) {
+    malformed("truncated string or blob");
+  }
+  return result;
+}
+
+
+
+uint64_t tagged_value_t::read_varint_payload() const
+{
+  uint64_t value = 0;
+  if (decode_varint(data_ + 1, end_, value) == 0) {
+    malformed("truncated varint");
+  }
+  return value;
+}
+
+
+
+tagged_value_t tagged_root(const buffer_stream_t &document)
+{
+  const char *start = document.pointer();
+  const size_t length = document.remainder();
+  if (length <= DOCUMENT_HEADER_SIZE ||
+      load_le<uint32_t>(start) != DOCUMENT_MAGIC ||
+      static_cast<uint8_t>(start[4]) != DOCUMENT_VERSION) {
+    return tagged_value_t();
+  }
+  return tagged_value_t(start + DOCUMENT_HEADER_SIZE, start + length);
+}
+
+
+} // namespace snow
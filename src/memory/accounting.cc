@@ -0,0 +1,387 @@
+// accounting.cc -- Noel Cower -- Public Domain
+
+#include <snow/memory/accounting.hh>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#if USE_MEMORY_ACCOUNTING && (S_PLATFORM_LINUX || S_PLATFORM_APPLE)
+#include <execinfo.h>
+#define S_HAS_BACKTRACE 1
+#endif
+
+
+namespace snow {
+
+
+namespace {
+
+
+const char *const BUILTIN_CATEGORY_NAMES[MEMORY_FIRST_USER_CATEGORY] = {
+  "other",
+  "string",
+  "object_pool",
+  "sparse",
+  "binpack",
+  "arena",
+  "slab",
+};
+
+
+struct registry_t
+{
+  std::mutex                lock;
+  const char               *names[MEMORY_MAX_CATEGORIES];
+  std::atomic<unsigned>     num_categories { unsigned(MEMORY_FIRST_USER_CATEGORY) };
+
+  registry_t()
+  {
+    std::copy(BUILTIN_CATEGORY_NAMES, BUILTIN_CATEGORY_NAMES + MEMORY_FIRST_USER_CATEGORY, names);
+  }
+};
+
+
+// Never destroyed, so memory can be accounted during static destruction.
+registry_t &registry()
+{
+  static registry_t *const instance = new registry_t;
+  return *instance;
+}
+
+
+
+#if USE_MEMORY_ACCOUNTING
+
+const size_t DEFAULT_SAMPLE_INTERVAL = 512 * 1024;
+const int MAX_FRAMES = 16;
+
+
+// Padded so threads allocating in different categories don't share a cache
+// line.
+struct counters_t
+{
+  std::atomic<size_t>   live_bytes { 0 };
+  std::atomic<size_t>   peak_bytes { 0 };
+  std::atomic<size_t>   live_count { 0 };
+  std::atomic<uint64_t> total_count { 0 };
+  std::atomic<uint64_t> total_bytes { 0 };
+  char                  padding[64 - 3 * sizeof(std::atomic<size_t>) - 2 * sizeof(std::atomic<uint64_t>)];
+};
+
+
+struct site_key_t
+{
+  memory_category_t category;
+  const char       *file;
+  int               line;
+  void             *frames[MAX_FRAMES];
+  int               num_frames;
+
+  bool operator == (const site_key_t &other) const
+  {
+    return category == other.category && file == other.file && line == other.line &&
+           num_frames == other.num_frames &&
+           std::equal(frames, frames + num_frames, other.frames);
+  }
+};
+
+
+struct site_key_hash_t
+{
+  size_t operator () (const site_key_t &key) const
+  {
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&hash](uint64_t value) {
+      hash = (hash ^ value) * 1099511628211ull;
+    };
+    mix(key.category);
+    mix(uintptr_t(key.file));
+    mix(uint64_t(key.line));
+    for (int frame = 0; frame < key.num_frames; ++frame) {
+      mix(uintptr_t(key.frames[frame]));
+    }
+    return size_t(hash);
+  }
+};
+
+
+struct site_stats_t
+{
+  size_t    samples = 0;
+  uint64_t  estimated_bytes = 0;
+};
+
+
+struct accounts_t
+{
+  counters_t              counters[MEMORY_MAX_CATEGORIES];
+  std::atomic<size_t>     sample_interval { DEFAULT_SAMPLE_INTERVAL };
+
+  std::mutex              sites_lock;
+  std::unordered_map<site_key_t, site_stats_t, site_key_hash_t> sites;
+};
+
+
+accounts_t &accounts()
+{
+  static accounts_t *const instance = new accounts_t;
+  return *instance;
+}
+
+
+
+// Bytes the calling thread may allocate before its next sample. Zero until
+// the thread first allocates.
+thread_local int64_t bytes_until_sample = 0;
+thread_local uint64_t sample_rng = 0;
+
+
+
+/*==============================================================================
+  next_sample_distance
+
+    Returns the bytes to allocate before the next sample: exponentially
+    distributed with a mean of interval, so samples don't line up with
+    periodic allocation patterns.
+==============================================================================*/
+int64_t next_sample_distance(size_t interval)
+{
+  if (sample_rng == 0) {
+    sample_rng = uint64_t(uintptr_t(&sample_rng)) * 0x9E3779B97F4A7C15ull | 1;
+  }
+  // xorshift64*
+  sample_rng ^= sample_rng >> 12;
+  sample_rng ^= sample_rng << 25;
+  sample_rng ^= sample_rng >> 27;
+  const uint64_t bits = (sample_rng * 0x2545F4914F6CDD1Dull) >> 11;
+  // Uniform in (0, 1].
+  const double uniform = double(bits + 1) / double(uint64_t(1) << 53);
+  const double distance = -std::log(uniform) * double(interval);
+  return int64_t(distance) + 1;
+}
+
+
+
+/*==============================================================================
+  record_sample
+
+    Adds a sample of size bytes to its site. Each sample stands for
+    size / (1 - e^(-size / interval)) bytes: the expected bytes allocated per
+    sample of an allocation of that size.
+
+    caller is the return address of the public accounting function; frames
+    inside the accounting functions are dropped from the stack.
+==============================================================================*/
+void record_sample(memory_category_t category, size_t size, const char *file, int line, size_t interval, void *caller)
+{
+  site_key_t key;
+  key.category = category;
+  key.file = file;
+  key.line = line;
+  key.num_frames = 0;
+#if S_HAS_BACKTRACE
+  // Room for the accounting functions' own frames, which are skipped.
+  void *frames[MAX_FRAMES + 8];
+  const int captured = ::backtrace(frames, MAX_FRAMES + 8);
+  int first = 0;
+  while (first < captured && frames[first] != caller) {
+    ++first;
+  }
+  if (first == captured) {
+    first = 0;
+  }
+  key.num_frames = std::min(captured - first, MAX_FRAMES);
+  std::copy(frames + first, frames + first + key.num_frames, key.frames);
+#else
+  key.frames[0] = caller;
+  key.num_frames = 1;
+#endif
+
+  const double ratio = double(size) / double(interval);
+  const double weight = double(size) / -std::expm1(-ratio);
+
+  accounts_t &acc = accounts();
+  std::lock_guard<std::mutex> guard(acc.sites_lock);
+  site_stats_t &site = acc.sites[key];
+  site.samples += 1;
+  site.estimated_bytes += uint64_t(weight);
+}
+
+
+
+void add_bytes(memory_category_t category, size_t size, const char *file, int line, void *caller)
+{
+  counters_t &counters = accounts().counters[category];
+  const size_t live = counters.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  size_t peak = counters.peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !counters.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    /* retry */
+  }
+  counters.total_bytes.fetch_add(size, std::memory_order_relaxed);
+
+  bytes_until_sample -= int64_t(size);
+  if (bytes_until_sample <= 0) {
+    const size_t interval = accounts().sample_interval.load(std::memory_order_relaxed);
+    if (interval == 0) {
+      // Check back later in case sampling is turned on.
+      bytes_until_sample = int64_t(DEFAULT_SAMPLE_INTERVAL);
+      return;
+    }
+    // A thread's first allocation only starts its countdown.
+    const bool started = sample_rng != 0;
+    bytes_until_sample = next_sample_distance(interval);
+    if (started) {
+      record_sample(category, size, file, line, interval, caller);
+    }
+  }
+}
+
+
+
+void account_allocate(memory_category_t category, size_t size, const char *file, int line, void *caller)
+{
+  counters_t &counters = accounts().counters[category];
+  counters.live_count.fetch_add(1, std::memory_order_relaxed);
+  counters.total_count.fetch_add(1, std::memory_order_relaxed);
+  add_bytes(category, size, file, line, caller);
+}
+
+
+
+void account_free(memory_category_t category, size_t size)
+{
+  counters_t &counters = accounts().counters[category];
+  counters.live_count.fetch_sub(1, std::memory_order_relaxed);
+  counters.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+#endif // USE_MEMORY_ACCOUNTING
+
+
+} // namespace <anon>
+
+
+
+memory_category_t memory_register_category(const char *name)
+{
+  registry_t &reg = registry();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  const unsigned category = reg.num_categories.load(std::memory_order_relaxed);
+  if (category == MEMORY_MAX_CATEGORIES) {
+    s_throw(std::length_error, "Too many memory categories registered");
+  }
+  reg.names[category] = name;
+  reg.num_categories.store(category + 1, std::memory_order_release);
+  return memory_category_t(category);
+}
+
+
+
+void memory_set_sample_interval(size_t bytes)
+{
+#if USE_MEMORY_ACCOUNTING
+  accounts().sample_interval.store(bytes, std::memory_order_relaxed);
+#else
+  (void)bytes;
+#endif
+}
+
+
+
+memory_snapshot_t memory_snapshot()
+{
+  memory_snapshot_t snapshot;
+#if USE_MEMORY_ACCOUNTING
+  registry_t &reg = registry();
+  accounts_t &acc = accounts();
+  const unsigned num_categories = reg.num_categories.load(std::memory_order_acquire);
+  snapshot.categories.reserve(num_categories);
+  for (unsigned category = 0; category < num_categories; ++category) {
+    const counters_t &counters = acc.counters[category];
+    memory_category_stats_t stats;
+    stats.category = memory_category_t(category);
+    stats.name = reg.names[category];
+    stats.live_bytes = counters.live_bytes.load(std::memory_order_relaxed);
+    stats.peak_bytes = counters.peak_bytes.load(std::memory_order_relaxed);
+    stats.live_count = counters.live_count.load(std::memory_order_relaxed);
+    stats.total_count = counters.total_count.load(std::memory_order_relaxed);
+    stats.total_bytes = counters.total_bytes.load(std::memory_order_relaxed);
+    snapshot.categories.push_back(stats);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(acc.sites_lock);
+    snapshot.sites.reserve(acc.sites.size());
+    for (const auto &pair : acc.sites) {
+      const site_key_t &key = pair.first;
+      memory_site_t site;
+      site.category = key.category;
+      site.file = key.file;
+      site.line = key.line;
+      site.frames.assign(key.frames, key.frames + key.num_frames);
+      site.samples = pair.second.samples;
+      site.estimated_bytes = pair.second.estimated_bytes;
+      snapshot.sites.push_back(std::move(site));
+    }
+  }
+  std::sort(snapshot.sites.begin(), snapshot.sites.end(),
+    [](const memory_site_t &lhs, const memory_site_t &rhs) {
+      return lhs.estimated_bytes > rhs.estimated_bytes;
+    });
+#endif
+  return snapshot;
+}
+
+
+
+void memory_reset_peaks()
+{
+#if USE_MEMORY_ACCOUNTING
+  for (counters_t &counters : accounts().counters) {
+    counters.peak_bytes.store(counters.live_bytes.load(std::memory_order_relaxed),
+                              std::memory_order_relaxed);
+  }
+#endif
+}
+
+
+
+#if USE_MEMORY_ACCOUNTING
+
+void memory_account_allocate(memory_category_t category, size_t size, const char *file, int line)
+{
+  account_allocate(category, size, file, line, __builtin_return_address(0));
+}
+
+
+
+void memory_account_free(memory_category_t category, size_t size)
+{
+  account_free(category, size);
+}
+
+
+
+void memory_account_resize(memory_category_t category, size_t old_size, size_t new_size, const char *file, int line)
+{
+  if (old_size == 0) {
+    if (new_size != 0) {
+      account_allocate(category, new_size, file, line, __builtin_return_address(0));
+    }
+  } else if (new_size == 0) {
+    account_free(category, old_size);
+  } else if (new_size > old_size) {
+    add_bytes(category, new_size - old_size, file, line, __builtin_return_address(0));
+  } else {
+    accounts().counters[category].live_bytes.fetch_sub(old_size - new_size, std::memory_order_relaxed);
+  }
+}
+
+#endif // USE_MEMORY_ACCOUNTING
+
+
+} // namespace snow
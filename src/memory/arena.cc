@@ -0,0 +1,209 @@
+// arena.cc -- Noel Cower -- Public Domain
+
+#include <snow/memory/arena.hh>
+#include <snow/memory/accounting.hh>
+#include <cstdlib>
+
+
+namespace snow {
+
+
+arena_t::arena_t(size_t chunk_size) :
+  chunk_size_(chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE),
+  chunk_(0),
+  cur_(0),
+  end_(0)
+{
+  /* nop */
+}
+
+
+
+arena_t::~arena_t()
+{
+  release();
+}
+
+
+
+void *arena_t::allocate_slow(size_t size, size_t alignment)
+{
+  // Move on to a chunk kept from before the last reset or rewind if the
+  // allocation fits in it; otherwise put a new chunk after the current one.
+  if (size > SIZE_MAX - alignment - chunk_size_) {
+#if USE_EXCEPTIONS
+    throw std::bad_alloc();
+#else
+    s_fatal_error("arena_t allocation size overflow: %zu bytes", size);
+#endif
+  }
+  const size_t next = chunks_.empty() ? 0 : chunk_ + 1;
+  if (next < chunks_.size() && size + alignment - 1 <= chunks_[next].size) {
+    use_chunk(next, 0);
+  } else {
+    const size_t chunk_size = size + alignment - 1 > chunk_size_ ? size + alignment - 1 : chunk_size_;
+    char *data = static_cast<char *>(std::malloc(chunk_size));
+    if (data == nullptr) {
+#if USE_EXCEPTIONS
+      throw std::bad_alloc();
+#else
+      s_fatal_error("arena_t failed to allocate a %zu byte chunk", chunk_size);
+#endif
+    }
+    s_memory_allocated(MEMORY_ARENA, chunk_size);
+    chunks_.insert(chunks_.begin() + next, chunk_t { data, chunk_size });
+    use_chunk(next, 0);
+  }
+
+  const uintptr_t aligned = (cur_ + alignment - 1) & ~uintptr_t(alignment - 1);
+  cur_ = aligned + size;
+  return reinterpret_cast<void *>(aligned);
+}
+
+
+
+void arena_t::use_chunk(size_t index, size_t offset)
+{
+  const chunk_t &chunk = chunks_[index];
+  chunk_ = index;
+  cur_ = reinterpret_cast<uintptr_t>(chunk.data) + offset;
+  end_ = reinterpret_cast<uintptr_t>(chunk.data) + chunk.size;
+}
+
+
+
+char *arena_t::copy_string(const string_ref_t &str)
+{
+  char *copy = static_cast<char *>(allocate(str.size() + 1, 1));
+  if (str.size()) {
+    std::memcpy(copy, str.data(), str.size());
+  }
+  copy[str.size()] = '\0';
+  return copy;
+}
+
+
+
+auto arena_t::mark() const -> marker_t
+{
+  if (chunks_.empty()) {
+    return marker_t { 0, 0 };
+  }
+  return marker_t { chunk_, size_t(cur_ - reinterpret_cast<uintptr_t>(chunks_[chunk_].data)) };
+}
+
+
+
+void arena_t::rewind(const marker_t &marker)
+{
+  if (chunks_.empty()) {
+    return;
+  }
+  if (marker.chunk > chunk_ ||
+      (marker.chunk == chunk_ && marker.offset > mark().offset)) {
+    s_throw(std::invalid_argument, "Arena marker is past the current position");
+  }
+  use_chunk(marker.chunk, marker.offset);
+}
+
+
+
+void arena_t::reset()
+{
+  rewind(marker_t { 0, 0 });
+}
+
+
+
+void arena_t::release()
+{
+  for (const chunk_t &chunk : chunks_) {
+    s_memory_freed(MEMORY_ARENA, chunk.size);
+    std::free(chunk.data);
+  }
+  chunks_.clear();
+  chunk_ = 0;
+  cur_ = 0;
+  end_ = 0;
+}
+
+
+
+size_t arena_t::bytes_used() const
+{
+  if (chunks_.empty()) {
+    return 0;
+  }
+  size_t used = mark().offset;
+  for (size_t index = 0; index < chunk_; ++index) {
+    used += chunks_[index].size;
+  }
+  return used;
+}
+
+
+
+size_t arena_t::bytes_reserved() const
+{
+  size_t reserved = 0;
+  for (const chunk_t &chunk : chunks_) {
+    reserved += chunk.size;
+  }
+  return reserved;
+}
+
+
+
+std::atomic<uint64_t> frame_allocator_t::global_frame_ { 0 };
+
+
+
+frame_allocator_t::frame_allocator_t(size_t chunk_size) :
+  even_(chunk_size),
+  odd_(chunk_size),
+  frame_(global_frame_.load(std::memory_order_relaxed))
+{
+  /* nop */
+}
+
+
+
+frame_allocator_t &frame_allocator_t::local()
+{
+  static thread_local frame_allocator_t allocator;
+  return allocator;
+}
+
+
+
+void frame_allocator_t::advance_frame()
+{
+  global_frame_.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+uint64_t frame_allocator_t::frame()
+{
+  return global_frame_.load(std::memory_order_relaxed);
+}
+
+
+
+void frame_allocator_t::sync_frame()
+{
+  const uint64_t current = global_frame_.load(std::memory_order_relaxed);
+  // The arena for the new frame last held frame current - 2, which is now
+  // done with. If more than one frame passed, the other arena's frame is done
+  // with too.
+  arena_t &next = (current & 1) ? odd_ : even_;
+  arena_t &previous = (current & 1) ? even_ : odd_;
+  next.reset();
+  if (current - frame_ > 1) {
+    previous.reset();
+  }
+  frame_ = current;
+}
+
+
+} // namespace snow
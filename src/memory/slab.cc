@@ -0,0 +1,418 @@
+// slab.cc -- Noel Cower -- Public Domain
+
+#include <snow/memory/slab.hh>
+#include <snow/memory/accounting.hh>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+#if S_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+namespace snow {
+
+
+namespace {
+
+
+const size_t SLAB_SIZE = 64 * 1024;
+const size_t REGION_SIZE = 2 * 1024 * 1024;
+// Blocks a magazine holds at most; half are moved to or from the shared free
+// list at a time.
+const size_t MAGAZINE_SIZE = 32;
+
+
+struct free_block_t
+{
+  free_block_t *next;
+};
+
+
+struct size_class_t
+{
+  std::mutex      lock;
+  free_block_t   *free = nullptr;
+  size_t          free_count = 0;
+  // Uncarved remainder of the class's newest slab.
+  char           *bump = nullptr;
+  char           *bump_end = nullptr;
+  size_t          slabs = 0;
+};
+
+
+struct heap_t
+{
+  size_class_t          classes[SLAB_NUM_CLASSES];
+
+  std::mutex            region_lock;
+  char                 *region = nullptr;
+  char                 *region_end = nullptr;
+  size_t                bytes_mapped = 0;
+  size_t                huge_page_regions = 0;
+
+  std::atomic<bool>     huge_pages { false };
+  std::atomic<size_t>   large_allocations { 0 };
+  std::atomic<size_t>   large_bytes { 0 };
+};
+
+
+struct magazine_t
+{
+  void   *blocks[MAGAZINE_SIZE];
+  size_t  count = 0;
+};
+
+
+struct thread_cache_t
+{
+  magazine_t magazines[SLAB_NUM_CLASSES];
+
+  ~thread_cache_t();
+
+  void flush();
+};
+
+
+
+// Never destroyed, so blocks can be freed during static destruction.
+heap_t &heap()
+{
+  static heap_t *const instance = new heap_t;
+  return *instance;
+}
+
+
+
+// Set once the thread's cache is destroyed at thread exit. Trivially
+// destructible, so it can still be read by destructors that run afterward
+// (e.g., static destructors freeing blocks on the main thread).
+thread_local bool cache_destroyed = false;
+
+
+
+thread_cache_t &thread_cache()
+{
+  static thread_local thread_cache_t cache;
+  return cache;
+}
+
+
+
+/*==============================================================================
+  map_region
+
+    Maps a REGION_SIZE-aligned region of REGION_SIZE bytes. Sets huge if it's
+    backed by explicit huge pages. Returns null on failure.
+==============================================================================*/
+char *map_region(bool want_huge, bool &huge)
+{
+  huge = false;
+#if S_PLATFORM_WINDOWS
+  (void)want_huge;
+  // VirtualAlloc's 64KB allocation granularity keeps slabs aligned; regions
+  // don't need to be.
+  return static_cast<char *>(::VirtualAlloc(nullptr, REGION_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+#ifdef MAP_HUGETLB
+  if (want_huge) {
+    void *mapped = ::mmap(nullptr, REGION_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapped != MAP_FAILED) {
+      huge = true;
+      return static_cast<char *>(mapped);
+    }
+  }
+#endif
+
+  // Over-map so the region can be aligned, then unmap the slack on both ends.
+  const size_t length = REGION_SIZE * 2;
+  void *mapped = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    return nullptr;
+  }
+  char *const base = static_cast<char *>(mapped);
+  char *const aligned = reinterpret_cast<char *>(
+    (reinterpret_cast<uintptr_t>(base) + REGION_SIZE - 1) & ~uintptr_t(REGION_SIZE - 1));
+  if (aligned != base) {
+    ::munmap(base, size_t(aligned - base));
+  }
+  const size_t tail = size_t(base + length - (aligned + REGION_SIZE));
+  if (tail) {
+    ::munmap(aligned + REGION_SIZE, tail);
+  }
+#ifdef MADV_HUGEPAGE
+  if (want_huge) {
+    ::madvise(aligned, REGION_SIZE, MADV_HUGEPAGE);
+  }
+#endif
+  return aligned;
+#endif
+}
+
+
+
+/*==============================================================================
+  new_slab
+
+    Cuts a slab from the current region, mapping a new region if it's used up.
+==============================================================================*/
+char *new_slab()
+{
+  heap_t &h = heap();
+  std::lock_guard<std::mutex> guard(h.region_lock);
+  if (h.region == h.region_end) {
+    bool huge = false;
+    char *region = map_region(h.huge_pages.load(std::memory_order_relaxed), huge);
+    if (region == nullptr) {
+#if USE_EXCEPTIONS
+      throw std::bad_alloc();
+#else
+      s_fatal_error("slab allocator failed to map a %zu byte region", REGION_SIZE);
+#endif
+    }
+    h.region = region;
+    h.region_end = region + REGION_SIZE;
+    h.bytes_mapped += REGION_SIZE;
+    h.huge_page_regions += huge ? 1 : 0;
+    s_memory_allocated(MEMORY_SLAB, REGION_SIZE);
+  }
+  char *slab = h.region;
+  h.region += SLAB_SIZE;
+  return slab;
+}
+
+
+
+/*==============================================================================
+  refill
+
+    Fills an empty magazine with up to half its capacity from the class's
+    shared free list, carving new blocks from a slab if the list is empty.
+==============================================================================*/
+void refill(size_t index, magazine_t &magazine)
+{
+  size_class_t &sc = heap().classes[index];
+  const size_t block_size = slab_class_size(index);
+  std::lock_guard<std::mutex> guard(sc.lock);
+
+  while (magazine.count < MAGAZINE_SIZE / 2 && sc.free != nullptr) {
+    free_block_t *block = sc.free;
+    sc.free = block->next;
+    --sc.free_count;
+    magazine.blocks[magazine.count++] = block;
+  }
+
+  while (magazine.count < MAGAZINE_SIZE / 2) {
+    if (size_t(sc.bump_end - sc.bump) < block_size) {
+      if (magazine.count > 0) {
+        break;
+      }
+      sc.bump = new_slab();
+      sc.bump_end = sc.bump + SLAB_SIZE;
+      ++sc.slabs;
+    }
+    magazine.blocks[magazine.count++] = sc.bump;
+    sc.bump += block_size;
+  }
+}
+
+
+
+/*==============================================================================
+  release
+
+    Moves the first count blocks of a magazine to the class's shared free list
+    and shifts the rest down.
+==============================================================================*/
+void release(size_t index, magazine_t &magazine, size_t count)
+{
+  if (count == 0) {
+    return;
+  }
+  free_block_t *first = static_cast<free_block_t *>(magazine.blocks[0]);
+  free_block_t *last = first;
+  for (size_t block = 1; block < count; ++block) {
+    last->next = static_cast<free_block_t *>(magazine.blocks[block]);
+    last = last->next;
+  }
+
+  {
+    size_class_t &sc = heap().classes[index];
+    std::lock_guard<std::mutex> guard(sc.lock);
+    last->next = sc.free;
+    sc.free = first;
+    sc.free_count += count;
+  }
+
+  for (size_t block = count; block < magazine.count; ++block) {
+    magazine.blocks[block - count] = magazine.blocks[block];
+  }
+  magazine.count -= count;
+}
+
+
+
+thread_cache_t::~thread_cache_t()
+{
+  flush();
+  cache_destroyed = true;
+}
+
+
+
+void thread_cache_t::flush()
+{
+  for (size_t index = 0; index < SLAB_NUM_CLASSES; ++index) {
+    release(index, magazines[index], magazines[index].count);
+  }
+}
+
+
+} // namespace <anon>
+
+
+
+size_t slab_size_class(size_t size)
+{
+  if (size <= 32) {
+    return size == 0 ? 0 : (size - 1) >> 3;
+  } else if (size > SLAB_MAX_SIZE) {
+    return SLAB_NUM_CLASSES;
+  }
+  // size is in (2^k, 2^(k+1)]; the quarter steps of that range are classes.
+  const size_t k = 63 - size_t(__builtin_clzll(uint64_t(size - 1)));
+  const size_t quarter = ((size - 1) >> (k - 2)) & 3;
+  return 4 + (k - 5) * 4 + quarter;
+}
+
+
+
+size_t slab_class_size(size_t size_class)
+{
+  if (size_class < 4) {
+    return (size_class + 1) * 8;
+  }
+  const size_t k = 5 + (size_class - 4) / 4;
+  const size_t quarter = (size_class - 4) % 4;
+  return (size_t(1) << k) + (quarter + 1) * (size_t(1) << (k - 2));
+}
+
+
+
+void slab_configure(const slab_options_t &options)
+{
+  heap().huge_pages.store(options.huge_pages, std::memory_order_relaxed);
+}
+
+
+
+void *slab_allocate(size_t size)
+{
+  const size_t index = slab_size_class(size);
+  if (index == SLAB_NUM_CLASSES) {
+    void *block = std::malloc(size);
+    if (block == nullptr) {
+#if USE_EXCEPTIONS
+      throw std::bad_alloc();
+#else
+      s_fatal_error("slab allocator failed to allocate %zu bytes", size);
+#endif
+    }
+    heap_t &h = heap();
+    h.large_allocations.fetch_add(1, std::memory_order_relaxed);
+    h.large_bytes.fetch_add(size, std::memory_order_relaxed);
+    s_memory_allocated(MEMORY_SLAB, size);
+    return block;
+  }
+
+  if (cache_destroyed) {
+    // Take a batch into a temporary magazine and give back what isn't used.
+    magazine_t magazine;
+    refill(index, magazine);
+    void *block = magazine.blocks[--magazine.count];
+    release(index, magazine, magazine.count);
+    return block;
+  }
+
+  magazine_t &magazine = thread_cache().magazines[index];
+  if (magazine.count == 0) {
+    refill(index, magazine);
+  }
+  return magazine.blocks[--magazine.count];
+}
+
+
+
+void slab_free(void *block, size_t size)
+{
+  if (block == nullptr) {
+    return;
+  }
+  const size_t index = slab_size_class(size);
+  if (index == SLAB_NUM_CLASSES) {
+    std::free(block);
+    heap_t &h = heap();
+    h.large_allocations.fetch_sub(1, std::memory_order_relaxed);
+    h.large_bytes.fetch_sub(size, std::memory_order_relaxed);
+    s_memory_freed(MEMORY_SLAB, size);
+    return;
+  }
+
+  if (cache_destroyed) {
+    magazine_t magazine;
+    magazine.blocks[magazine.count++] = block;
+    release(index, magazine, 1);
+    return;
+  }
+
+  magazine_t &magazine = thread_cache().magazines[index];
+  if (magazine.count == MAGAZINE_SIZE) {
+    release(index, magazine, MAGAZINE_SIZE / 2);
+  }
+  magazine.blocks[magazine.count++] = block;
+}
+
+
+
+void slab_flush_thread_cache()
+{
+  if (!cache_destroyed) {
+    thread_cache().flush();
+  }
+}
+
+
+
+slab_stats_t slab_stats()
+{
+  heap_t &h = heap();
+  slab_stats_t stats;
+  stats.classes.resize(SLAB_NUM_CLASSES);
+  for (size_t index = 0; index < SLAB_NUM_CLASSES; ++index) {
+    size_class_t &sc = h.classes[index];
+    slab_class_stats_t &out = stats.classes[index];
+    out.block_size = slab_class_size(index);
+    std::lock_guard<std::mutex> guard(sc.lock);
+    const size_t per_slab = SLAB_SIZE / out.block_size;
+    const size_t uncarved = size_t(sc.bump_end - sc.bump) / out.block_size;
+    out.slabs = sc.slabs;
+    out.blocks_free = sc.free_count + uncarved;
+    out.blocks_allocated = sc.slabs * per_slab - out.blocks_free;
+  }
+  {
+    std::lock_guard<std::mutex> guard(h.region_lock);
+    stats.bytes_mapped = h.bytes_mapped;
+    stats.huge_page_regions = h.huge_page_regions;
+  }
+  stats.large_allocations = h.large_allocations.load(std::memory_order_relaxed);
+  stats.large_bytes = h.large_bytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+
+} // namespace snow
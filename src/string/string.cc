@@ -1,6 +1,7 @@
 // string.cc -- Noel Cower -- Public Domain
 
 #include <snow/string/string.hh>
+#include <snow/memory/accounting.hh>
 
 #include <cassert>
 #include <cstring>
@@ -183,6 +184,7 @@ string_t::string_t(char value) :
 string_t::~string_t()
 {
   if (can_free()) {
+    s_memory_freed(MEMORY_STRING, capacity());
     free(data_);
   }
 }
@@ -215,6 +217,7 @@ string_t &string_t::operator = (string_t &&other)
   }
 
   if (can_free()) {
+    s_memory_freed(MEMORY_STRING, capacity());
     delete [] data_;
   }
 
@@ -627,6 +630,7 @@ string_t &string_t::shrink_to_fit()
     std::memcpy(rep_.short_.short_data_, data_, len);
 
     if (old_cap) {
+      s_memory_freed(MEMORY_STRING, old_cap);
       delete [] data_;
     }
 
@@ -634,6 +638,8 @@ string_t &string_t::shrink_to_fit()
     data_ = rep_.short_.short_data_;
     data_[len] = '\0';
   } else {
+    // reserve accounts for the change from short_data_len_.
+    s_memory_resized(MEMORY_STRING, rep_.long_.capacity_, short_data_len_);
     rep_.long_.capacity_ = short_data_len_;
     reserve(len);
   }
@@ -697,7 +703,9 @@ string_t &string_t::reserve(size_type cap)
     if (!new_buffer) {
       return *this;
     }
+    s_memory_resized(MEMORY_STRING, old_capacity, cap);
     data_ = new_buffer;
+    rep_.long_.capacity_ = cap;
   } else {
     char *new_buffer = static_cast<char *>(malloc(cap));
     // How the hell should you handle this, anyway?
@@ -706,7 +714,9 @@ string_t &string_t::reserve(size_type cap)
       return *this;
     }
 
-    std::memcpy(new_buffer, data_, old_capacity);
+    // A non-owned buffer's capacity is zero, so copy up to its length.
+    std::memcpy(new_buffer, data_, is_short_cache ? old_capacity : old_len);
+    s_memory_allocated(MEMORY_STRING, cap);
 
     data_ = new_buffer;
     rep_.long_.length_ = old_len;
@@ -0,0 +1,142 @@
+// thread.cc -- Noel Cower -- Public Domain
+
+#include <snow/thread.hh>
+
+
+namespace snow {
+
+
+worker_threads_t::worker_threads_t(unsigned num_threads) :
+  job_(nullptr),
+  context_(nullptr),
+  job_threads_(0),
+  pending_(0),
+  generation_(0),
+  busy_(false),
+  stopping_(false)
+{
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  if (num_threads > 1) {
+    threads_.reserve(num_threads - 1);
+  }
+#if USE_EXCEPTIONS
+  try {
+#endif
+    for (unsigned thread = 1; thread < num_threads; ++thread) {
+      threads_.emplace_back(&worker_threads_t::worker_main, this, thread);
+    }
+#if USE_EXCEPTIONS
+  } catch (...) {
+    stop();
+    throw;
+  }
+#endif
+}
+
+
+
+worker_threads_t::~worker_threads_t()
+{
+  stop();
+}
+
+
+
+worker_threads_t &worker_threads_t::shared()
+{
+  // Never destroyed, so parallel loops may run during static destruction.
+  static worker_threads_t *const instance = new worker_threads_t;
+  return *instance;
+}
+
+
+
+bool worker_threads_t::try_run(unsigned num_threads, job_fn_t job, void *context)
+{
+  if (num_threads > size()) {
+    num_threads = size();
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (busy_) {
+      return false;
+    }
+    busy_ = true;
+    job_ = job;
+    context_ = context;
+    job_threads_ = num_threads;
+    pending_ = num_threads > 0 ? num_threads - 1 : 0;
+    generation_ += 1;
+  }
+
+  if (num_threads > 1) {
+    wake_.notify_all();
+  }
+  if (num_threads > 0) {
+    job(context, 0);
+  }
+
+  std::unique_lock<std::mutex> lock(lock_);
+  done_.wait(lock, [this] { return pending_ == 0; });
+  busy_ = false;
+  job_ = nullptr;
+  context_ = nullptr;
+  return true;
+}
+
+
+
+/*==============================================================================
+  worker_main
+
+    Runs on each of the set's threads: waits for a new job, runs it if the job
+    includes this thread, and reports back once it's done.
+==============================================================================*/
+void worker_threads_t::worker_main(unsigned thread)
+{
+  // Jobs are counted from zero rather than from whatever generation_ holds
+  // once this thread gets the lock, so a job posted before the thread got
+  // going isn't mistaken for one it already ran.
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(lock_);
+  for (;;) {
+    wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+    if (stopping_) {
+      return;
+    }
+    seen = generation_;
+    if (thread >= job_threads_) {
+      continue;
+    }
+
+    const job_fn_t job = job_;
+    void *const context = context_;
+    lock.unlock();
+    job(context, thread);
+    lock.lock();
+    if (--pending_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+
+
+void worker_threads_t::stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+}
+
+
+} // namespace snow
@@ -1,21 +1,28 @@
 // binpack.cc -- Noel Cower -- Public Domain
 
 #include <snow/types/binpack.hh>
+#include <snow/memory/accounting.hh>
 
 namespace snow
 {
 
 binpack_t::binpack_t(const recti_t &frame, binpack_t *right, binpack_t *bottom) :
   pack_right_(right), pack_bottom_(bottom), frame_(frame), loaded_(false)
-{}
+{
+  s_memory_allocated(MEMORY_BINPACK, sizeof(binpack_t));
+}
 
 binpack_t::binpack_t(const recti_t &frame) :
   pack_right_(nullptr), pack_bottom_(nullptr), frame_(frame), loaded_(false)
-{}
+{
+  s_memory_allocated(MEMORY_BINPACK, sizeof(binpack_t));
+}
 
 binpack_t::binpack_t(const binpack_t &other) :
   pack_right_(nullptr), pack_bottom_(nullptr), frame_(other.frame()), loaded_(other.loaded())
 {
+  s_memory_allocated(MEMORY_BINPACK, sizeof(binpack_t));
+
   if (other.pack_right_)
     pack_right_ = new binpack_t(*other.pack_right_);
 
@@ -25,6 +32,7 @@ binpack_t::binpack_t(const binpack_t &other) :
 
 binpack_t::~binpack_t()
 {
+  s_memory_freed(MEMORY_BINPACK, sizeof(binpack_t));
   if (pack_right_) delete pack_right_;
   if (pack_bottom_) delete pack_bottom_;
 }
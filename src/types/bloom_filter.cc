@@ -0,0 +1,730 @@
+// bloom_filter.cc -- Noel Cower -- Public Domain
+
+#include <snow/types/bloom_filter.hh>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+namespace snow {
+
+
+namespace {
+
+
+const unsigned MAX_HASHES = 16;
+const unsigned MAX_BLOCK_HASHES = 7;   // 7 * 9 bits fits in one 64-bit hash
+const unsigned BLOCK_INDEX_BITS = 9;   // log2(BLOCK_BITS)
+// Blocking skews the bit distribution, so give blocked filters some slack.
+const double BLOCKED_BITS_FACTOR = 1.25;
+const double LN2 = 0.69314718055994530942;
+// Cuckoo filters can't be filled much past this.
+const double CUCKOO_MAX_LOAD = 0.95;
+const unsigned CUCKOO_MAX_KICKS = 500;
+const unsigned FINGERPRINT_BITS = 16;
+
+
+/*==============================================================================
+  filter_header_t
+
+    Serialized header shared by all filter types. `padding` is the number of
+    bytes between the header and the filter bits, used to align the bits.
+==============================================================================*/
+struct filter_header_t
+{
+  uint32_t magic;
+  uint16_t hashes;
+  uint16_t padding;
+  uint64_t count;
+};
+
+static_assert(sizeof(filter_header_t) == 16, "filter_header_t must be 16 bytes");
+
+
+
+// Maps a 64-bit hash onto [0, range) without a division: the high 64 bits of
+// hash * range.
+inline uint64_t reduce_range(uint64_t hash, uint64_t range)
+{
+#if defined(__SIZEOF_INT128__)
+  return static_cast<uint64_t>((static_cast<__uint128_t>(hash) * range) >> 64);
+#else
+  // 32-bit targets have no 128-bit integers, so multiply in 32-bit halves.
+  const uint64_t hash_lo = hash & 0xFFFFFFFFU;
+  const uint64_t hash_hi = hash >> 32;
+  const uint64_t range_lo = range & 0xFFFFFFFFU;
+  const uint64_t range_hi = range >> 32;
+  const uint64_t lo_lo = hash_lo * range_lo;
+  const uint64_t hi_lo = hash_hi * range_lo;
+  const uint64_t lo_hi = hash_lo * range_hi;
+  const uint64_t hi_hi = hash_hi * range_hi;
+  const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFU) + lo_hi;
+  return hi_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+
+
+inline size_t optimal_bits(size_t keys, double rate)
+{
+  keys = std::max(keys, size_t(1));
+  rate = std::min(std::max(rate, 1e-12), 0.5);
+  return static_cast<size_t>(std::ceil(-double(keys) * std::log(rate) / (LN2 * LN2)));
+}
+
+
+
+inline unsigned optimal_hashes(size_t bits, size_t keys, unsigned max_hashes)
+{
+  keys = std::max(keys, size_t(1));
+  const long hashes = std::lround(double(bits) / double(keys) * LN2);
+  return static_cast<unsigned>(std::max(1L, std::min(long(max_hashes), hashes)));
+}
+
+
+
+inline size_t padding_for(uintptr_t offset, size_t alignment)
+{
+  return static_cast<size_t>((alignment - (offset % alignment)) % alignment);
+}
+
+
+
+inline size_t padding_for(const char *ptr, size_t alignment)
+{
+  return padding_for(reinterpret_cast<uintptr_t>(ptr), alignment);
+}
+
+
+
+/*==============================================================================
+  write_filter
+
+    Writes a header, alignment padding, and the filter words. Writes nothing
+    and returns zero if the stream is too small.
+
+    The words are aligned relative to the start of the stream rather than in
+    memory, so the layout doesn't depend on where the writer's buffer is.
+    Attaching requires the reader's buffer to be at least as aligned (as a
+    mapped file is).
+==============================================================================*/
+size_t write_filter(buffer_stream_t &stream, uint32_t magic, unsigned hashes,
+                    uint64_t count, const uint64_t *words, size_t num_words,
+                    size_t alignment)
+{
+  const size_t padding = padding_for(uintptr_t(stream.tell()) + sizeof(filter_header_t), alignment);
+  const size_t data_size = num_words * sizeof(uint64_t);
+  const size_t total = sizeof(filter_header_t) + padding + data_size;
+  if (stream.remainder() < total) {
+    return 0;
+  }
+  const filter_header_t header = {
+    magic, static_cast<uint16_t>(hashes), static_cast<uint16_t>(padding), count
+  };
+  stream.write(&header, sizeof(header));
+  if (padding) {
+    std::memset(stream.pointer(), 0, padding);
+    stream.skip(padding);
+  }
+  if (data_size) {
+    stream.write(words, data_size);
+  }
+  return total;
+}
+
+
+
+/*==============================================================================
+  read_filter_header
+
+    Reads and validates a header without consuming anything. On success,
+    returns a pointer to the filter data.
+==============================================================================*/
+const char *read_filter_header(const buffer_stream_t &stream, uint32_t magic,
+                               size_t words_per_count, size_t extra_words,
+                               filter_header_t &header)
+{
+  if (stream.remainder() < sizeof(header)) {
+    return nullptr;
+  }
+  std::memcpy(&header, stream.pointer(), sizeof(header));
+  if (header.magic != magic || header.hashes == 0 || header.count == 0) {
+    return nullptr;
+  }
+  const size_t available = stream.remainder() - sizeof(header);
+  if (available < header.padding) {
+    return nullptr;
+  }
+  const size_t data_words = (available - header.padding) / sizeof(uint64_t);
+  if (data_words < extra_words ||
+      header.count > (data_words - extra_words) / words_per_count) {
+    return nullptr;
+  }
+  return stream.pointer() + sizeof(header) + header.padding;
+}
+
+
+} // anonymous namespace
+
+
+
+/*==============================================================================
+
+  bloom_filter_t
+
+==============================================================================*/
+bloom_filter_t::bloom_filter_t(size_t expected_keys, double false_positive_rate) :
+  num_words_((optimal_bits(expected_keys, false_positive_rate) + 63) / 64),
+  num_bits_(num_words_ * 64),
+  num_hashes_(optimal_hashes(num_bits_, expected_keys, MAX_HASHES)),
+  bits_(nullptr),
+  owned_(num_words_, 0)
+{
+  bits_ = owned_.data();
+}
+
+
+
+bloom_filter_t::bloom_filter_t(const bloom_filter_t &other) :
+  num_words_(other.num_words_),
+  num_bits_(other.num_bits_),
+  num_hashes_(other.num_hashes_),
+  bits_(nullptr),
+  owned_(other.bits_, other.bits_ + other.num_words_)
+{
+  bits_ = owned_.data();
+}
+
+
+
+bloom_filter_t &bloom_filter_t::operator = (const bloom_filter_t &other)
+{
+  if (&other != this) {
+    num_words_ = other.num_words_;
+    num_bits_ = other.num_bits_;
+    num_hashes_ = other.num_hashes_;
+    owned_.assign(other.bits_, other.bits_ + other.num_words_);
+    bits_ = owned_.data();
+  }
+  return *this;
+}
+
+
+
+void bloom_filter_t::insert_hash(uint64_t hash)
+{
+  const uint64_t step = hash_mix64(hash) | 0x1;
+  for (unsigned index = 0; index < num_hashes_; ++index, hash += step) {
+    const uint64_t bit = reduce_range(hash, num_bits_);
+    bits_[bit >> 6] |= uint64_t(1) << (bit & 0x3F);
+  }
+}
+
+
+
+bool bloom_filter_t::contains_hash(uint64_t hash) const
+{
+  const uint64_t step = hash_mix64(hash) | 0x1;
+  for (unsigned index = 0; index < num_hashes_; ++index, hash += step) {
+    const uint64_t bit = reduce_range(hash, num_bits_);
+    if (!(bits_[bit >> 6] & (uint64_t(1) << (bit & 0x3F)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+
+void bloom_filter_t::clear()
+{
+  std::fill(bits_, bits_ + num_words_, uint64_t(0));
+}
+
+
+
+size_t bloom_filter_t::serialized_size() const
+{
+  return sizeof(filter_header_t) + alignof(uint64_t) + num_words_ * sizeof(uint64_t);
+}
+
+
+
+size_t bloom_filter_t::write(buffer_stream_t &stream) const
+{
+  return write_filter(stream, MAGIC, num_hashes_, num_words_, bits_, num_words_,
+                      alignof(uint64_t));
+}
+
+
+
+bool bloom_filter_t::read(const buffer_stream_t &stream)
+{
+  filter_header_t header;
+  const char *data = read_filter_header(stream, MAGIC, 1, 0, header);
+  if (!data) {
+    return false;
+  }
+  num_words_ = header.count;
+  num_bits_ = num_words_ * 64;
+  num_hashes_ = header.hashes;
+  owned_.resize(num_words_);
+  std::memcpy(owned_.data(), data, num_words_ * sizeof(uint64_t));
+  bits_ = owned_.data();
+  stream.seek((data - stream.base()) + num_words_ * sizeof(uint64_t));
+  return true;
+}
+
+
+
+bool bloom_filter_t::attach(buffer_stream_t &stream)
+{
+  filter_header_t header;
+  char *data = const_cast<char *>(read_filter_header(stream, MAGIC, 1, 0, header));
+  if (!data || padding_for(data, alignof(uint64_t))) {
+    return false;
+  }
+  num_words_ = header.count;
+  num_bits_ = num_words_ * 64;
+  num_hashes_ = header.hashes;
+  owned_.clear();
+  owned_.shrink_to_fit();
+  bits_ = reinterpret_cast<uint64_t *>(data);
+  stream.seek((data - stream.base()) + num_words_ * sizeof(uint64_t));
+  return true;
+}
+
+
+
+/*==============================================================================
+
+  blocked_bloom_filter_t
+
+==============================================================================*/
+blocked_bloom_filter_t::blocked_bloom_filter_t(size_t expected_keys, double false_positive_rate) :
+  num_blocks_(0),
+  num_hashes_(0),
+  blocks_(nullptr)
+{
+  const size_t bits = static_cast<size_t>(
+    optimal_bits(expected_keys, false_positive_rate) * BLOCKED_BITS_FACTOR);
+  allocate_blocks((bits + BLOCK_BITS - 1) / BLOCK_BITS);
+  num_hashes_ = optimal_hashes(num_blocks_ * BLOCK_BITS, expected_keys, MAX_BLOCK_HASHES);
+}
+
+
+
+blocked_bloom_filter_t::blocked_bloom_filter_t(const blocked_bloom_filter_t &other) :
+  num_blocks_(0),
+  num_hashes_(other.num_hashes_),
+  blocks_(nullptr)
+{
+  allocate_blocks(other.num_blocks_);
+  std::copy(other.blocks_, other.blocks_ + num_blocks_ * BLOCK_WORDS, blocks_);
+}
+
+
+
+blocked_bloom_filter_t &blocked_bloom_filter_t::operator = (const blocked_bloom_filter_t &other)
+{
+  if (&other != this) {
+    num_hashes_ = other.num_hashes_;
+    allocate_blocks(other.num_blocks_);
+    std::copy(other.blocks_, other.blocks_ + num_blocks_ * BLOCK_WORDS, blocks_);
+  }
+  return *this;
+}
+
+
+
+void blocked_bloom_filter_t::allocate_blocks(size_t num_blocks)
+{
+  num_blocks_ = std::max(num_blocks, size_t(1));
+  owned_.assign((num_blocks_ + 1) * BLOCK_WORDS, 0);
+  blocks_ = aligned_owned();
+}
+
+
+
+uint64_t *blocked_bloom_filter_t::aligned_owned() const
+{
+  if (owned_.empty()) {
+    return nullptr;
+  }
+  const char *base = reinterpret_cast<const char *>(owned_.data());
+  const size_t padding = padding_for(base, BLOCK_BITS / 8);
+  return reinterpret_cast<uint64_t *>(const_cast<char *>(base) + padding);
+}
+
+
+
+void blocked_bloom_filter_t::insert_hash(uint64_t hash)
+{
+  uint64_t *block = blocks_ + reduce_range(hash, num_blocks_) * BLOCK_WORDS;
+  uint64_t bits = hash_mix64(hash);
+  for (unsigned index = 0; index < num_hashes_; ++index, bits >>= BLOCK_INDEX_BITS) {
+    const unsigned bit = unsigned(bits & (BLOCK_BITS - 1));
+    block[bit >> 6] |= uint64_t(1) << (bit & 0x3F);
+  }
+}
+
+
+
+bool blocked_bloom_filter_t::contains_hash(uint64_t hash) const
+{
+  const uint64_t *block = blocks_ + reduce_range(hash, num_blocks_) * BLOCK_WORDS;
+  uint64_t bits = hash_mix64(hash);
+  // Build the block's mask first and test all words at once -- cheaper than
+  // branching per bit once the line is in cache.
+  uint64_t mask[BLOCK_WORDS] = { 0 };
+  for (unsigned index = 0; index < num_hashes_; ++index, bits >>= BLOCK_INDEX_BITS) {
+    const unsigned bit = unsigned(bits & (BLOCK_BITS - 1));
+    mask[bit >> 6] |= uint64_t(1) << (bit & 0x3F);
+  }
+  uint64_t missing = 0;
+  for (size_t word = 0; word < BLOCK_WORDS; ++word) {
+    missing |= mask[word] & ~block[word];
+  }
+  return missing == 0;
+}
+
+
+
+void blocked_bloom_filter_t::clear()
+{
+  std::fill(blocks_, blocks_ + num_blocks_ * BLOCK_WORDS, uint64_t(0));
+}
+
+
+
+size_t blocked_bloom_filter_t::serialized_size() const
+{
+  return sizeof(filter_header_t) + BLOCK_BITS / 8 + num_blocks_ * BLOCK_WORDS * sizeof(uint64_t);
+}
+
+
+
+size_t blocked_bloom_filter_t::write(buffer_stream_t &stream) const
+{
+  return write_filter(stream, MAGIC, num_hashes_, num_blocks_, blocks_,
+                      num_blocks_ * BLOCK_WORDS, BLOCK_BITS / 8);
+}
+
+
+
+bool blocked_bloom_filter_t::read(const buffer_stream_t &stream)
+{
+  filter_header_t header;
+  const char *data = read_filter_header(stream, MAGIC, BLOCK_WORDS, 0, header);
+  if (!data || header.hashes > MAX_BLOCK_HASHES) {
+    return false;
+  }
+  num_hashes_ = header.hashes;
+  allocate_blocks(header.count);
+  std::memcpy(blocks_, data, num_blocks_ * BLOCK_WORDS * sizeof(uint64_t));
+  stream.seek((data - stream.base()) + num_blocks_ * BLOCK_WORDS * sizeof(uint64_t));
+  return true;
+}
+
+
+
+bool blocked_bloom_filter_t::attach(buffer_stream_t &stream)
+{
+  filter_header_t header;
+  char *data = const_cast<char *>(read_filter_header(stream, MAGIC, BLOCK_WORDS, 0, header));
+  if (!data || header.hashes > MAX_BLOCK_HASHES || padding_for(data, BLOCK_BITS / 8)) {
+    return false;
+  }
+  num_blocks_ = header.count;
+  num_hashes_ = header.hashes;
+  owned_.clear();
+  owned_.shrink_to_fit();
+  blocks_ = reinterpret_cast<uint64_t *>(data);
+  stream.seek((data - stream.base()) + num_blocks_ * BLOCK_WORDS * sizeof(uint64_t));
+  return true;
+}
+
+
+/*==============================================================================
+
+  cuckoo_filter_t
+
+==============================================================================*/
+namespace {
+
+
+inline uint16_t fingerprint_lane(uint64_t bucket, size_t slot)
+{
+  return static_cast<uint16_t>(bucket >> (slot * FINGERPRINT_BITS));
+}
+
+
+
+inline uint16_t fingerprint_of(uint64_t hash)
+{
+  const uint16_t fingerprint = static_cast<uint16_t>(hash >> (64 - FINGERPRINT_BITS));
+  // Zero marks an empty slot.
+  return fingerprint ? fingerprint : 1;
+}
+
+
+} // anonymous namespace
+
+
+
+cuckoo_filter_t::cuckoo_filter_t(size_t expected_keys) :
+  num_buckets_(1),
+  rng_state_(0x9E3779B97F4A7C15ULL),
+  words_(nullptr)
+{
+  const size_t min_buckets = static_cast<size_t>(
+    std::ceil(double(std::max(expected_keys, size_t(1))) / (BUCKET_SLOTS * CUCKOO_MAX_LOAD)));
+  while (num_buckets_ < min_buckets) {
+    num_buckets_ <<= 1;
+  }
+  owned_.assign(HEADER_WORDS + num_buckets_, 0);
+  words_ = owned_.data();
+}
+
+
+
+cuckoo_filter_t::cuckoo_filter_t(const cuckoo_filter_t &other) :
+  num_buckets_(other.num_buckets_),
+  rng_state_(other.rng_state_),
+  words_(nullptr),
+  owned_(other.words_, other.words_ + HEADER_WORDS + other.num_buckets_)
+{
+  words_ = owned_.data();
+}
+
+
+
+cuckoo_filter_t &cuckoo_filter_t::operator = (const cuckoo_filter_t &other)
+{
+  if (&other != this) {
+    num_buckets_ = other.num_buckets_;
+    rng_state_ = other.rng_state_;
+    owned_.assign(other.words_, other.words_ + HEADER_WORDS + other.num_buckets_);
+    words_ = owned_.data();
+  }
+  return *this;
+}
+
+
+
+/*==============================================================================
+  alt_index
+
+    Returns the other candidate bucket for a fingerprint. Applying it twice
+    returns the original bucket, so either bucket can find its partner from the
+    fingerprint alone.
+==============================================================================*/
+size_t cuckoo_filter_t::alt_index(size_t index, uint16_t fingerprint) const
+{
+  return (index ^ static_cast<size_t>(hash_mix64(fingerprint))) & (num_buckets_ - 1);
+}
+
+
+
+bool cuckoo_filter_t::place(size_t index, uint16_t fingerprint)
+{
+  uint64_t &bucket = buckets()[index];
+  for (size_t slot = 0; slot < BUCKET_SLOTS; ++slot) {
+    if (!fingerprint_lane(bucket, slot)) {
+      bucket |= uint64_t(fingerprint) << (slot * FINGERPRINT_BITS);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+bool cuckoo_filter_t::remove(size_t index, uint16_t fingerprint)
+{
+  uint64_t &bucket = buckets()[index];
+  for (size_t slot = 0; slot < BUCKET_SLOTS; ++slot) {
+    if (fingerprint_lane(bucket, slot) == fingerprint) {
+      bucket &= ~(uint64_t(0xFFFF) << (slot * FINGERPRINT_BITS));
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+bool cuckoo_filter_t::bucket_contains(size_t index, uint16_t fingerprint) const
+{
+  const uint64_t bucket = buckets()[index];
+  for (size_t slot = 0; slot < BUCKET_SLOTS; ++slot) {
+    if (fingerprint_lane(bucket, slot) == fingerprint) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+/*==============================================================================
+  insert_hash
+
+    Places the fingerprint in either candidate bucket. If both are full, evicts
+    a random fingerprint and moves it to its alternate bucket, repeating up to
+    CUCKOO_MAX_KICKS times. If that fails, the last evicted fingerprint is kept
+    as the victim (so nothing is lost) and later inserts fail until an erase
+    makes room.
+==============================================================================*/
+bool cuckoo_filter_t::insert_hash(uint64_t hash)
+{
+  if (words_[VICTIM_WORD] & VICTIM_VALID) {
+    return false;
+  }
+
+  uint16_t fingerprint = fingerprint_of(hash);
+  size_t index = static_cast<size_t>(hash) & (num_buckets_ - 1);
+  const size_t alt = alt_index(index, fingerprint);
+  if (place(index, fingerprint) || place(alt, fingerprint)) {
+    words_[COUNT_WORD] += 1;
+    return true;
+  }
+
+  for (unsigned kick = 0; kick < CUCKOO_MAX_KICKS; ++kick) {
+    // xorshift64 -- only needs to be cheap and not cycle between two buckets.
+    rng_state_ ^= rng_state_ << 13;
+    rng_state_ ^= rng_state_ >> 7;
+    rng_state_ ^= rng_state_ << 17;
+    if (kick == 0 && (rng_state_ & 0x100)) {
+      index = alt;
+    }
+    const size_t slot = static_cast<size_t>(rng_state_ & (BUCKET_SLOTS - 1));
+    const unsigned shift = unsigned(slot * FINGERPRINT_BITS);
+    uint64_t &bucket = buckets()[index];
+    const uint16_t evicted = fingerprint_lane(bucket, slot);
+    bucket = (bucket & ~(uint64_t(0xFFFF) << shift)) | (uint64_t(fingerprint) << shift);
+    fingerprint = evicted;
+    index = alt_index(index, fingerprint);
+    if (place(index, fingerprint)) {
+      words_[COUNT_WORD] += 1;
+      return true;
+    }
+  }
+
+  words_[VICTIM_WORD] = VICTIM_VALID | (uint64_t(index) << FINGERPRINT_BITS) | fingerprint;
+  words_[COUNT_WORD] += 1;
+  return true;
+}
+
+
+
+bool cuckoo_filter_t::contains_hash(uint64_t hash) const
+{
+  const uint16_t fingerprint = fingerprint_of(hash);
+  const size_t index = static_cast<size_t>(hash) & (num_buckets_ - 1);
+  const size_t alt = alt_index(index, fingerprint);
+  if (bucket_contains(index, fingerprint) || bucket_contains(alt, fingerprint)) {
+    return true;
+  }
+  const uint64_t victim = words_[VICTIM_WORD];
+  if (victim & VICTIM_VALID) {
+    const size_t victim_index = static_cast<size_t>((victim & ~VICTIM_VALID) >> FINGERPRINT_BITS);
+    return uint16_t(victim) == fingerprint && (victim_index == index || victim_index == alt);
+  }
+  return false;
+}
+
+
+
+bool cuckoo_filter_t::erase_hash(uint64_t hash)
+{
+  const uint16_t fingerprint = fingerprint_of(hash);
+  const size_t index = static_cast<size_t>(hash) & (num_buckets_ - 1);
+  const size_t alt = alt_index(index, fingerprint);
+  const uint64_t victim = words_[VICTIM_WORD];
+  const bool has_victim = (victim & VICTIM_VALID) != 0;
+  const uint16_t victim_fingerprint = uint16_t(victim);
+  const size_t victim_index = static_cast<size_t>((victim & ~VICTIM_VALID) >> FINGERPRINT_BITS);
+
+  if (remove(index, fingerprint) || remove(alt, fingerprint)) {
+    words_[COUNT_WORD] -= 1;
+    // There's room now, so try to move the victim back into the table.
+    if (has_victim) {
+      words_[VICTIM_WORD] = 0;
+      if (place(victim_index, victim_fingerprint) ||
+          place(alt_index(victim_index, victim_fingerprint), victim_fingerprint)) {
+        return true;
+      }
+      words_[VICTIM_WORD] = victim;
+    }
+    return true;
+  } else if (has_victim && victim_fingerprint == fingerprint &&
+             (victim_index == index || victim_index == alt)) {
+    words_[VICTIM_WORD] = 0;
+    words_[COUNT_WORD] -= 1;
+    return true;
+  }
+  return false;
+}
+
+
+
+void cuckoo_filter_t::clear()
+{
+  std::fill(words_, words_ + HEADER_WORDS + num_buckets_, uint64_t(0));
+}
+
+
+
+size_t cuckoo_filter_t::serialized_size() const
+{
+  return sizeof(filter_header_t) + alignof(uint64_t) +
+    (HEADER_WORDS + num_buckets_) * sizeof(uint64_t);
+}
+
+
+
+size_t cuckoo_filter_t::write(buffer_stream_t &stream) const
+{
+  return write_filter(stream, MAGIC, BUCKET_SLOTS, num_buckets_, words_,
+                      HEADER_WORDS + num_buckets_, alignof(uint64_t));
+}
+
+
+
+bool cuckoo_filter_t::read(const buffer_stream_t &stream)
+{
+  filter_header_t header;
+  const char *data = read_filter_header(stream, MAGIC, 1, HEADER_WORDS, header);
+  // Bucket count must be a power of two for alt_index to be its own inverse.
+  if (!data || header.hashes != BUCKET_SLOTS || (header.count & (header.count - 1))) {
+    return false;
+  }
+  num_buckets_ = header.count;
+  owned_.resize(HEADER_WORDS + num_buckets_);
+  std::memcpy(owned_.data(), data, owned_.size() * sizeof(uint64_t));
+  words_ = owned_.data();
+  stream.seek((data - stream.base()) + owned_.size() * sizeof(uint64_t));
+  return true;
+}
+
+
+
+bool cuckoo_filter_t::attach(buffer_stream_t &stream)
+{
+  filter_header_t header;
+  char *data = const_cast<char *>(read_filter_header(stream, MAGIC, 1, HEADER_WORDS, header));
+  if (!data || header.hashes != BUCKET_SLOTS || (header.count & (header.count - 1)) ||
+      padding_for(data, alignof(uint64_t))) {
+    return false;
+  }
+  num_buckets_ = header.count;
+  owned_.clear();
+  owned_.shrink_to_fit();
+  words_ = reinterpret_cast<uint64_t *>(data);
+  stream.seek((data - stream.base()) + (HEADER_WORDS + num_buckets_) * sizeof(uint64_t));
+  return true;
+}
+
+
+} // namespace snow
@@ -0,0 +1,206 @@
+// main.cc -- Noel Cower -- Public Domain
+//
+// buffer-stream-bench: measures the per-field cost of each buffer stream
+// bounds policy (checked, unchecked, and assert) by reading and writing
+// records of a u32, u16, and u8 field in host order, in little endian order,
+// and as varints. Prints the mean time per field in nanoseconds.
+//
+// The assert policy only checks bounds when NDEBUG isn't defined, so it
+// should match unchecked in release builds.
+//
+//   $ bin/buffer-stream-bench
+
+#include <snow/data/buffer_stream.hh>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+
+namespace {
+
+
+const size_t RECORDS      = 1 << 16;
+const size_t FIELDS       = 3;
+const size_t ROUNDS       = 200;
+const size_t RECORD_BYTES = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t);
+
+
+// Values read or written are folded into this so the work can't be dropped.
+volatile uint64_t g_sink = 0;
+
+
+template <typename FN>
+double ns_per_field(FN &&func)
+{
+  // Warm up.
+  func();
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < ROUNDS; ++round) {
+    func();
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) /
+         double(ROUNDS * RECORDS * FIELDS);
+}
+
+
+
+template <typename Bounds>
+double read_host(std::vector<char> &buffer)
+{
+  return ns_per_field([&] {
+    snow::basic_buffer_stream_t<Bounds> stream(buffer.data(), buffer.size());
+    uint64_t sum = 0;
+    uint32_t a;
+    uint16_t b;
+    uint8_t c;
+    for (size_t index = 0; index < RECORDS; ++index) {
+      stream.read(a);
+      stream.read(b);
+      stream.read(c);
+      sum += a + b + c;
+    }
+    g_sink = g_sink + sum;
+  });
+}
+
+
+
+template <typename Bounds>
+double read_le(std::vector<char> &buffer)
+{
+  return ns_per_field([&] {
+    snow::basic_buffer_stream_t<Bounds> stream(buffer.data(), buffer.size());
+    uint64_t sum = 0;
+    uint32_t a;
+    uint16_t b;
+    uint8_t c;
+    for (size_t index = 0; index < RECORDS; ++index) {
+      stream.read_le(a);
+      stream.read_le(b);
+      stream.read_le(c);
+      sum += a + b + c;
+    }
+    g_sink = g_sink + sum;
+  });
+}
+
+
+
+template <typename Bounds>
+double read_varints(std::vector<char> &buffer)
+{
+  return ns_per_field([&] {
+    snow::basic_buffer_stream_t<Bounds> stream(buffer.data(), buffer.size());
+    uint64_t sum = 0;
+    uint64_t value;
+    for (size_t index = 0; index < RECORDS * FIELDS; ++index) {
+      stream.read_varint(value);
+      sum += value;
+    }
+    g_sink = g_sink + sum;
+  });
+}
+
+
+
+template <typename Bounds>
+double write_host(std::vector<char> &buffer)
+{
+  return ns_per_field([&] {
+    snow::basic_buffer_stream_t<Bounds> stream(buffer.data(), buffer.size());
+    for (size_t index = 0; index < RECORDS; ++index) {
+      stream.write(uint32_t(index));
+      stream.write(uint16_t(index));
+      stream.write(uint8_t(index));
+    }
+    g_sink = g_sink + uint8_t(buffer[RECORDS * RECORD_BYTES - 1]);
+  });
+}
+
+
+
+template <typename Bounds>
+double write_le(std::vector<char> &buffer)
+{
+  return ns_per_field([&] {
+    snow::basic_buffer_stream_t<Bounds> stream(buffer.data(), buffer.size());
+    for (size_t index = 0; index < RECORDS; ++index) {
+      stream.write_le(uint32_t(index));
+      stream.write_le(uint16_t(index));
+      stream.write_le(uint8_t(index));
+    }
+    g_sink = g_sink + uint8_t(buffer[RECORDS * RECORD_BYTES - 1]);
+  });
+}
+
+
+
+using bench_fn_t = double (*)(std::vector<char> &buffer);
+
+
+struct bench_t
+{
+  const char         *name;
+  std::vector<char>  *buffer;
+  bench_fn_t          checked;
+  bench_fn_t          unchecked;
+  bench_fn_t          asserted;
+};
+
+
+} // namespace <anon>
+
+
+
+int main()
+{
+  std::vector<char> fields(RECORDS * RECORD_BYTES);
+  {
+    snow::buffer_stream_t stream(fields.data(), fields.size());
+    for (size_t index = 0; index < RECORDS; ++index) {
+      stream.write_le(uint32_t(index * 2654435761u));
+      stream.write_le(uint16_t(index));
+      stream.write_le(uint8_t(index));
+    }
+  }
+
+  // Varints of one to three bytes.
+  std::vector<char> varints(RECORDS * FIELDS * snow::VARINT_MAX_BYTES);
+  {
+    snow::buffer_stream_t stream(varints.data(), varints.size());
+    for (size_t index = 0; index < RECORDS * FIELDS; ++index) {
+      stream.write_varint(uint64_t(index * 2654435761u) >> (index % 3 * 7 + 43));
+    }
+  }
+
+  std::vector<char> output(RECORDS * RECORD_BYTES);
+
+  const bench_t benches[] = {
+    { "read",         &fields,  &read_host<snow::checked_bounds_t>,
+                                &read_host<snow::unchecked_bounds_t>,
+                                &read_host<snow::assert_bounds_t> },
+    { "read_le",      &fields,  &read_le<snow::checked_bounds_t>,
+                                &read_le<snow::unchecked_bounds_t>,
+                                &read_le<snow::assert_bounds_t> },
+    { "read_varint",  &varints, &read_varints<snow::checked_bounds_t>,
+                                &read_varints<snow::unchecked_bounds_t>,
+                                &read_varints<snow::assert_bounds_t> },
+    { "write",        &output,  &write_host<snow::checked_bounds_t>,
+                                &write_host<snow::unchecked_bounds_t>,
+                                &write_host<snow::assert_bounds_t> },
+    { "write_le",     &output,  &write_le<snow::checked_bounds_t>,
+                                &write_le<snow::unchecked_bounds_t>,
+                                &write_le<snow::assert_bounds_t> },
+  };
+
+  std::printf("%zu records of 3 fields (ns/field)\n", RECORDS);
+  std::printf("  %-12s %10s %10s %10s\n", "", "checked", "unchecked", "assert");
+  for (const bench_t &bench : benches) {
+    std::printf("  %-12s %10.2f %10.2f %10.2f\n", bench.name,
+                bench.checked(*bench.buffer),
+                bench.unchecked(*bench.buffer),
+                bench.asserted(*bench.buffer));
+  }
+  return 0;
+}
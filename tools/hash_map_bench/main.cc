@@ -0,0 +1,191 @@
+// main.cc -- Noel Cower -- Public Domain
+//
+// hash-map-bench: compares hash_map_t against std::unordered_map and std::map
+// for inserts, successful and failed lookups, and erases, with integer and
+// string keys. Prints the mean time per operation in nanoseconds. The number
+// of elements may be given as the only argument (default 1000000).
+//
+//   $ bin/hash-map-bench 100000
+
+#include <snow/types/hash_map.hh>
+#include <snow/string/string.hh>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+
+struct timings_t
+{
+  double insert;
+  double hit;
+  double miss;
+  double erase;
+};
+
+
+
+template <typename FN>
+double time_per_op(size_t count, FN &&func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  func();
+  const auto stop = std::chrono::steady_clock::now();
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) /
+         double(count);
+}
+
+
+
+/*==============================================================================
+  run_map
+
+    Inserts every key in keys, looks each one up in a different order, looks
+    up every key in misses, then erases keys in yet another order. Each map
+    type uses its own key type, converted from the same strings or integers
+    beforehand so conversions aren't timed.
+==============================================================================*/
+template <typename MAP, typename KEY>
+timings_t run_map(const std::vector<KEY> &keys, const std::vector<KEY> &misses,
+                  const std::vector<size_t> &lookup_order,
+                  const std::vector<size_t> &erase_order)
+{
+  timings_t result;
+  MAP map;
+  size_t found = 0;
+
+  result.insert = time_per_op(keys.size(), [&] {
+    for (size_t index = 0; index < keys.size(); ++index) {
+      map.emplace(keys[index], index);
+    }
+  });
+
+  result.hit = time_per_op(keys.size(), [&] {
+    for (const size_t index : lookup_order) {
+      found += map.find(keys[index]) != map.end();
+    }
+  });
+
+  result.miss = time_per_op(misses.size(), [&] {
+    for (const KEY &key : misses) {
+      found += map.find(key) != map.end();
+    }
+  });
+
+  result.erase = time_per_op(keys.size(), [&] {
+    for (const size_t index : erase_order) {
+      found += map.erase(keys[index]);
+    }
+  });
+
+  if (found != keys.size() * 2 || !map.empty()) {
+    std::fprintf(stderr, "Benchmark sanity check failed\n");
+    std::exit(1);
+  }
+  return result;
+}
+
+
+
+void print_row(const char *name, const timings_t &timings)
+{
+  std::printf("  %-20s %8.1f %8.1f %8.1f %8.1f\n", name,
+              timings.insert, timings.hit, timings.miss, timings.erase);
+}
+
+
+
+void print_header(const char *title, size_t count)
+{
+  std::printf("%s, %zu elements (ns/op)\n", title, count);
+  std::printf("  %-20s %8s %8s %8s %8s\n", "", "insert", "hit", "miss", "erase");
+}
+
+
+
+std::vector<size_t> shuffled_indices(size_t count, std::mt19937_64 &rng)
+{
+  std::vector<size_t> indices(count);
+  for (size_t index = 0; index < count; ++index) {
+    indices[index] = index;
+  }
+  std::shuffle(indices.begin(), indices.end(), rng);
+  return indices;
+}
+
+
+
+void bench_integers(size_t count, std::mt19937_64 &rng)
+{
+  // Odd keys are inserted and even keys miss.
+  std::vector<uint64_t> keys(count);
+  std::vector<uint64_t> misses(count);
+  for (size_t index = 0; index < count; ++index) {
+    const uint64_t key = rng() << 1;
+    keys[index] = key | 1;
+    misses[index] = key;
+  }
+  const std::vector<size_t> lookup_order = shuffled_indices(count, rng);
+  const std::vector<size_t> erase_order = shuffled_indices(count, rng);
+
+  print_header("uint64_t keys", count);
+  print_row("hash_map_t", run_map<snow::hash_map_t<uint64_t, size_t>>(
+    keys, misses, lookup_order, erase_order));
+  print_row("std::unordered_map", run_map<std::unordered_map<uint64_t, size_t>>(
+    keys, misses, lookup_order, erase_order));
+  print_row("std::map", run_map<std::map<uint64_t, size_t>>(
+    keys, misses, lookup_order, erase_order));
+}
+
+
+
+void bench_strings(size_t count, std::mt19937_64 &rng)
+{
+  // Keys that share a prefix and differ at the end, like generated names.
+  std::vector<std::string> keys(count);
+  std::vector<std::string> misses(count);
+  for (size_t index = 0; index < count; ++index) {
+    keys[index] = "entity_" + std::to_string(index);
+    misses[index] = "missing_" + std::to_string(index);
+  }
+  std::vector<snow::string_t> snow_keys(keys.begin(), keys.end());
+  std::vector<snow::string_t> snow_misses(misses.begin(), misses.end());
+  const std::vector<size_t> lookup_order = shuffled_indices(count, rng);
+  const std::vector<size_t> erase_order = shuffled_indices(count, rng);
+
+  print_header("string keys", count);
+  print_row("hash_map_t", run_map<snow::hash_map_t<snow::string_t, size_t>>(
+    snow_keys, snow_misses, lookup_order, erase_order));
+  print_row("std::unordered_map", run_map<std::unordered_map<std::string, size_t>>(
+    keys, misses, lookup_order, erase_order));
+  print_row("std::map", run_map<std::map<std::string, size_t>>(
+    keys, misses, lookup_order, erase_order));
+}
+
+
+} // namespace <anon>
+
+
+
+int main(int argc, const char *argv[])
+{
+  size_t count = 1000000;
+  if (argc > 2 || (argc == 2 && (count = std::strtoul(argv[1], nullptr, 10)) == 0)) {
+    std::fprintf(stderr, "Usage: %s [elements]\n", argv[0]);
+    return 1;
+  }
+
+  std::mt19937_64 rng(1);
+  bench_integers(count, rng);
+  std::printf("\n");
+  bench_strings(count, rng);
+  return 0;
+}
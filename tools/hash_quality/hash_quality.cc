@@ -0,0 +1,392 @@
+// hash_quality.cc -- Noel Cower -- Public Domain
+
+#include "hash_quality.hh"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#if S_ARCH_x86_64 || S_ARCH_x86
+#include <x86intrin.h>
+#endif
+
+
+namespace snow {
+
+
+namespace {
+
+
+const size_t PATH_KEYS          = 200000;
+const size_t AVALANCHE_SAMPLES  = 2000;
+const size_t BIC_SAMPLES        = 500;
+const size_t CYCLIC_KEYS        = 100000;
+
+
+inline uint64_t output_mask(unsigned output_bits)
+{
+  return output_bits >= 64 ? ~uint64_t(0) : ((uint64_t(1) << output_bits) - 1);
+}
+
+
+
+inline void fill_random(std::vector<char> &key, std::mt19937_64 &rng)
+{
+  for (char &ch : key) {
+    ch = static_cast<char>(rng());
+  }
+}
+
+
+
+inline void flip_bit(std::vector<char> &key, size_t bit)
+{
+  key[bit >> 3] ^= static_cast<char>(1 << (bit & 0x7));
+}
+
+
+
+inline uint64_t read_cycles()
+{
+#if S_ARCH_x86_64 || S_ARCH_x86
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+
+/*==============================================================================
+  count_collisions
+
+    Sorts the hashes and counts entries equal to their predecessor.
+==============================================================================*/
+hash_collisions_t count_collisions(std::vector<uint64_t> &hashes, unsigned output_bits)
+{
+  std::sort(hashes.begin(), hashes.end());
+  size_t collisions = 0;
+  for (size_t index = 1; index < hashes.size(); ++index) {
+    if (hashes[index] == hashes[index - 1]) {
+      ++collisions;
+    }
+  }
+  const double count = static_cast<double>(hashes.size());
+  const double expected = (count * (count - 1.0) / 2.0) / std::ldexp(1.0, int(output_bits));
+  return { hashes.size(), collisions, expected };
+}
+
+
+
+/*==============================================================================
+  summarize_bias
+
+    Converts flip counts to biases and finds the worst and mean. Counters are
+    laid out as [input bit][output index].
+==============================================================================*/
+hash_bias_t summarize_bias(const std::vector<uint32_t> &counts, size_t outputs,
+                           size_t samples)
+{
+  hash_bias_t result = { 0.0, 0.0, 0, 0 };
+  for (size_t index = 0; index < counts.size(); ++index) {
+    const double bias = std::fabs(2.0 * counts[index] / double(samples) - 1.0);
+    result.mean += bias;
+    if (bias > result.worst) {
+      result.worst = bias;
+      result.worst_input_bit = unsigned(index / outputs);
+      result.worst_output_bit = unsigned(index % outputs);
+    }
+  }
+  if (!counts.empty()) {
+    result.mean /= double(counts.size());
+  }
+  return result;
+}
+
+
+
+void sparse_keys_recursive(hash_test_fn_t fn, std::vector<char> &key,
+                           size_t first_bit, unsigned bits_left, uint64_t mask,
+                           std::vector<uint64_t> &hashes)
+{
+  const size_t key_bits = key.size() * 8;
+  for (size_t bit = first_bit; bit < key_bits; ++bit) {
+    flip_bit(key, bit);
+    hashes.push_back(fn(key.data(), key.size(), DEFAULT_HASH_SEED_64) & mask);
+    if (bits_left > 1) {
+      sparse_keys_recursive(fn, key, bit + 1, bits_left - 1, mask, hashes);
+    }
+    flip_bit(key, bit);
+  }
+}
+
+
+
+void report_collisions(std::ostream &out, const char *label, const hash_collisions_t &result)
+{
+  out << "  " << label << ": " << result.collisions << " collisions in "
+      << result.keys << " keys (expected " << result.expected << ")\n";
+}
+
+
+
+void report_bias(std::ostream &out, const char *label, size_t key_bytes, const hash_bias_t &result)
+{
+  out << "  " << label << " (" << key_bytes << "-byte keys): worst bias "
+      << result.worst * 100.0 << "% (input bit " << result.worst_input_bit
+      << ", output bit " << result.worst_output_bit << "), mean "
+      << result.mean * 100.0 << "%\n";
+}
+
+
+} // anonymous namespace
+
+
+
+uint64_t hash32_quality_adapter(const char *data, size_t length, uint64_t seed)
+{
+  return hash32(data, length, static_cast<uint32_t>(seed));
+}
+
+
+
+uint64_t hash64_quality_adapter(const char *data, size_t length, uint64_t seed)
+{
+  return hash64(data, length, seed);
+}
+
+
+
+hash_bias_t hash_avalanche(hash_test_fn_t fn, size_t key_bytes,
+                           unsigned output_bits, size_t samples, uint64_t rng_seed)
+{
+  const size_t input_bits = key_bytes * 8;
+  const uint64_t mask = output_mask(output_bits);
+  std::vector<uint32_t> counts(input_bits * output_bits, 0);
+  std::vector<char> key(key_bytes);
+  std::mt19937_64 rng(rng_seed);
+
+  for (size_t sample = 0; sample < samples; ++sample) {
+    fill_random(key, rng);
+    const uint64_t base = fn(key.data(), key_bytes, DEFAULT_HASH_SEED_64) & mask;
+    for (size_t in_bit = 0; in_bit < input_bits; ++in_bit) {
+      flip_bit(key, in_bit);
+      const uint64_t diff = base ^ (fn(key.data(), key_bytes, DEFAULT_HASH_SEED_64) & mask);
+      flip_bit(key, in_bit);
+      uint32_t *row = &counts[in_bit * output_bits];
+      for (unsigned out_bit = 0; out_bit < output_bits; ++out_bit) {
+        row[out_bit] += uint32_t((diff >> out_bit) & 0x1);
+      }
+    }
+  }
+
+  return summarize_bias(counts, output_bits, samples);
+}
+
+
+
+hash_bias_t hash_bit_independence(hash_test_fn_t fn, size_t key_bytes,
+                                  unsigned output_bits, size_t samples, uint64_t rng_seed)
+{
+  const size_t input_bits = key_bytes * 8;
+  const size_t pairs = size_t(output_bits) * (output_bits - 1) / 2;
+  const uint64_t mask = output_mask(output_bits);
+  std::vector<uint32_t> counts(input_bits * pairs, 0);
+  std::vector<char> key(key_bytes);
+  std::mt19937_64 rng(rng_seed);
+
+  for (size_t sample = 0; sample < samples; ++sample) {
+    fill_random(key, rng);
+    const uint64_t base = fn(key.data(), key_bytes, DEFAULT_HASH_SEED_64) & mask;
+    for (size_t in_bit = 0; in_bit < input_bits; ++in_bit) {
+      flip_bit(key, in_bit);
+      const uint64_t diff = base ^ (fn(key.data(), key_bytes, DEFAULT_HASH_SEED_64) & mask);
+      flip_bit(key, in_bit);
+      uint32_t *row = &counts[in_bit * pairs];
+      // Output bits j and k are independent if their flips agree half the time.
+      for (unsigned j = 0; j < output_bits; ++j) {
+        const uint64_t flipped = (diff >> j) & 0x1;
+        for (unsigned k = j + 1; k < output_bits; ++k) {
+          *(row++) += uint32_t(flipped ^ ((diff >> k) & 0x1));
+        }
+      }
+    }
+  }
+
+  hash_bias_t result = summarize_bias(counts, pairs, samples);
+  // Map the worst pair index back to its first output bit.
+  size_t pair = result.worst_output_bit;
+  unsigned first = 0;
+  while (pair >= output_bits - 1 - first) {
+    pair -= output_bits - 1 - first;
+    ++first;
+  }
+  result.worst_output_bit = first;
+  return result;
+}
+
+
+
+hash_collisions_t hash_collisions(hash_test_fn_t fn, const std::vector<string> &keys,
+                                  unsigned output_bits)
+{
+  const uint64_t mask = output_mask(output_bits);
+  std::vector<string> unique_keys(keys);
+  std::sort(unique_keys.begin(), unique_keys.end());
+  unique_keys.erase(std::unique(unique_keys.begin(), unique_keys.end()), unique_keys.end());
+
+  std::vector<uint64_t> hashes;
+  hashes.reserve(unique_keys.size());
+  for (const string &key : unique_keys) {
+    hashes.push_back(fn(key.data(), key.size(), DEFAULT_HASH_SEED_64) & mask);
+  }
+  return count_collisions(hashes, output_bits);
+}
+
+
+
+hash_collisions_t hash_sparse_keys(hash_test_fn_t fn, size_t key_bytes,
+                                   unsigned max_bits, unsigned output_bits)
+{
+  const uint64_t mask = output_mask(output_bits);
+  std::vector<char> key(key_bytes, 0);
+  std::vector<uint64_t> hashes;
+  hashes.push_back(fn(key.data(), key_bytes, DEFAULT_HASH_SEED_64) & mask);
+  if (max_bits > 0) {
+    sparse_keys_recursive(fn, key, 0, max_bits, mask, hashes);
+  }
+  return count_collisions(hashes, output_bits);
+}
+
+
+
+hash_collisions_t hash_cyclic_keys(hash_test_fn_t fn, size_t cycle_bytes,
+                                   size_t cycles, size_t count,
+                                   unsigned output_bits, uint64_t rng_seed)
+{
+  const uint64_t mask = output_mask(output_bits);
+  std::vector<char> cycle(cycle_bytes);
+  std::vector<char> key(cycle_bytes * cycles);
+  std::vector<uint64_t> hashes;
+  hashes.reserve(count);
+  std::mt19937_64 rng(rng_seed);
+
+  for (size_t index = 0; index < count; ++index) {
+    fill_random(cycle, rng);
+    for (size_t rep = 0; rep < cycles; ++rep) {
+      std::copy(cycle.begin(), cycle.end(), key.begin() + rep * cycle_bytes);
+    }
+    hashes.push_back(fn(key.data(), key.size(), DEFAULT_HASH_SEED_64) & mask);
+  }
+  return count_collisions(hashes, output_bits);
+}
+
+
+
+std::vector<string> hash_path_keys(size_t count, uint64_t rng_seed)
+{
+  static const char *const roots[] = {
+    "assets", "data", "content", "build/cache",
+  };
+  static const char *const dirs[] = {
+    "textures", "meshes", "sounds", "shaders", "materials", "levels",
+    "characters", "props", "ui", "fonts", "animations", "particles",
+  };
+  static const char *const names[] = {
+    "hero", "enemy", "door", "wall", "floor", "crate", "tree", "rock",
+    "button", "icon", "sky", "water", "light", "spark", "step", "hit",
+  };
+  static const char *const exts[] = {
+    "png", "dds", "obj", "wav", "ogg", "glsl", "mat", "json",
+  };
+  const size_t num_roots = sizeof(roots) / sizeof(*roots);
+  const size_t num_dirs = sizeof(dirs) / sizeof(*dirs);
+  const size_t num_names = sizeof(names) / sizeof(*names);
+  const size_t num_exts = sizeof(exts) / sizeof(*exts);
+
+  std::vector<string> keys;
+  keys.reserve(count);
+  std::mt19937_64 rng(rng_seed);
+  for (size_t index = 0; index < count; ++index) {
+    // The index keeps every key distinct.
+    keys.push_back(string::format("%s/%s/%s/%s_%zu.%s",
+      roots[rng() % num_roots], dirs[rng() % num_dirs], dirs[rng() % num_dirs],
+      names[rng() % num_names], index, exts[rng() % num_exts]));
+  }
+  return keys;
+}
+
+
+
+hash_speed_t hash_speed(hash_test_fn_t fn, size_t key_bytes, size_t iterations)
+{
+  if (key_bytes > 16) {
+    iterations = std::max(size_t(100), iterations * 16 / key_bytes);
+  }
+  std::vector<char> key(key_bytes);
+  std::mt19937_64 rng(1);
+  fill_random(key, rng);
+
+  // Feed each hash into the next seed so the calls can't be hoisted or
+  // overlapped.
+  uint64_t seed = DEFAULT_HASH_SEED_64;
+  for (size_t index = 0; index < iterations / 16 + 1; ++index) {
+    seed = fn(key.data(), key_bytes, seed);
+  }
+  const uint64_t start = read_cycles();
+  for (size_t index = 0; index < iterations; ++index) {
+    seed = fn(key.data(), key_bytes, seed);
+  }
+  const uint64_t stop = read_cycles();
+  volatile uint64_t sink = seed;
+  (void)sink;
+
+  const double per_hash = double(stop - start) / double(iterations);
+  return { key_bytes, per_hash, key_bytes ? per_hash / double(key_bytes) : 0.0 };
+}
+
+
+
+void hash_quality_report(std::ostream &out, const char *name,
+                         hash_test_fn_t fn, unsigned output_bits)
+{
+  out << name << " (" << output_bits << "-bit)\n";
+
+  const size_t avalanche_sizes[] = { 4, 8, 16, 64 };
+  for (size_t key_bytes : avalanche_sizes) {
+    report_bias(out, "avalanche", key_bytes,
+      hash_avalanche(fn, key_bytes, output_bits, AVALANCHE_SAMPLES));
+  }
+
+  const size_t bic_sizes[] = { 4, 16 };
+  for (size_t key_bytes : bic_sizes) {
+    report_bias(out, "bit independence", key_bytes,
+      hash_bit_independence(fn, key_bytes, output_bits, BIC_SAMPLES));
+  }
+
+  report_collisions(out, "sparse 4-byte keys, <= 6 bits set",
+    hash_sparse_keys(fn, 4, 6, output_bits));
+  report_collisions(out, "sparse 8-byte keys, <= 4 bits set",
+    hash_sparse_keys(fn, 8, 4, output_bits));
+  report_collisions(out, "cyclic 4-byte x 8 keys",
+    hash_cyclic_keys(fn, 4, 8, CYCLIC_KEYS, output_bits));
+  report_collisions(out, "cyclic 8-byte x 8 keys",
+    hash_cyclic_keys(fn, 8, 8, CYCLIC_KEYS, output_bits));
+  report_collisions(out, "file paths",
+    hash_collisions(fn, hash_path_keys(PATH_KEYS), output_bits));
+  // Bucket index collisions, as seen by a hash table with 2^16 slots.
+  report_collisions(out, "file paths, low 16 bits",
+    hash_collisions(fn, hash_path_keys(size_t(1) << 12), 16));
+
+  const size_t speed_sizes[] = { 4, 16, 64, 1024, 65536 };
+  for (size_t key_bytes : speed_sizes) {
+    const hash_speed_t speed = hash_speed(fn, key_bytes);
+    out << "  speed (" << key_bytes << "-byte keys): " << speed.cycles_per_hash
+        << " cycles/hash, " << speed.cycles_per_byte << " cycles/byte\n";
+  }
+}
+
+
+} // namespace snow
@@ -0,0 +1,153 @@
+// hash_quality.hh -- Noel Cower -- Public Domain
+
+#ifndef __SNOW_COMMON__HASH_QUALITY_HH__
+#define __SNOW_COMMON__HASH_QUALITY_HH__
+
+#include <snow/config.hh>
+#include <snow/data/hash.hh>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+
+/*==============================================================================
+
+  SMHasher-style quality and speed checks for snow's hash functions. Built as
+  part of the hash-quality tool (see tools/hash_quality/main.cc), not the
+  library.
+
+==============================================================================*/
+
+namespace snow {
+
+
+/**
+  Hash function signature accepted by the hash quality checks. 32-bit hashes
+  are checked by passing output_bits = 32 and returning the hash zero-extended.
+  @see snow::hash32_quality_adapter
+*/
+using hash_test_fn_t = uint64_t (*)(const char *data, size_t length, uint64_t seed);
+
+
+/** Adapts snow::hash32 to hash_test_fn_t. The seed is truncated to 32 bits. */
+uint64_t hash32_quality_adapter(const char *data, size_t length, uint64_t seed);
+
+/** Adapts snow::hash64 to hash_test_fn_t. */
+uint64_t hash64_quality_adapter(const char *data, size_t length, uint64_t seed);
+
+
+/**
+  Result of the avalanche and bit independence checks. Biases are in [0, 1],
+  where 0 is ideal (an output bit flips exactly half the time) and 1 means the
+  output bit never or always flips.
+*/
+struct hash_bias_t
+{
+  /** Worst bias over all input/output bit pairs. */
+  double worst;
+  /** Mean bias over all input/output bit pairs. */
+  double mean;
+  /** Input bit at which the worst bias was found. */
+  unsigned worst_input_bit;
+  /** Output bit (or the first of two output bits) with the worst bias. */
+  unsigned worst_output_bit;
+};
+
+
+/**
+  Result of a collision census. `expected` is the number of collisions an ideal
+  hash of the given width would produce for the same number of distinct keys.
+*/
+struct hash_collisions_t
+{
+  size_t keys;
+  size_t collisions;
+  double expected;
+};
+
+
+/**
+  Result of a throughput measurement. Cycles are measured with the time stamp
+  counter on x86 and estimated from wall-clock nanoseconds elsewhere (one cycle
+  per nanosecond).
+*/
+struct hash_speed_t
+{
+  size_t key_bytes;
+  double cycles_per_hash;
+  double cycles_per_byte;
+};
+
+
+/**
+  Strict avalanche check: for random keys of key_bytes bytes, flips each input
+  bit and measures how often each output bit flips.
+  @param fn          The hash function.
+  @param key_bytes   Length of the keys to hash.
+  @param output_bits Number of significant bits in the hash (32 or 64).
+  @param samples     Number of random keys to test.
+  @param rng_seed    Seed for the key generator.
+*/
+hash_bias_t hash_avalanche(hash_test_fn_t fn, size_t key_bytes,
+                           unsigned output_bits, size_t samples,
+                           uint64_t rng_seed = 1);
+
+/**
+  Bit independence check: for each flipped input bit, measures the correlation
+  between every pair of output bit flips. A bias of 0 means the pair of output
+  bits flip independently.
+  @see snow::hash_avalanche
+*/
+hash_bias_t hash_bit_independence(hash_test_fn_t fn, size_t key_bytes,
+                                  unsigned output_bits, size_t samples,
+                                  uint64_t rng_seed = 1);
+
+/**
+  Counts colliding hashes over the given keys. Duplicate keys are not counted
+  as collisions.
+*/
+hash_collisions_t hash_collisions(hash_test_fn_t fn,
+                                  const std::vector<string> &keys,
+                                  unsigned output_bits);
+
+/**
+  Collision census over all keys of key_bytes bytes that have at most max_bits
+  bits set (e.g., 8-byte keys with up to 3 bits set). Catches hashes that mix
+  zero bytes poorly.
+*/
+hash_collisions_t hash_sparse_keys(hash_test_fn_t fn, size_t key_bytes,
+                                   unsigned max_bits, unsigned output_bits);
+
+/**
+  Collision census over keys made of a random block of cycle_bytes repeated
+  cycles times. Catches hashes whose state repeats on periodic input.
+*/
+hash_collisions_t hash_cyclic_keys(hash_test_fn_t fn, size_t cycle_bytes,
+                                   size_t cycles, size_t count,
+                                   unsigned output_bits,
+                                   uint64_t rng_seed = 1);
+
+/**
+  Generates count distinct keys that look like asset file paths (shared
+  directory prefixes, numbered names, a handful of extensions).
+*/
+std::vector<string> hash_path_keys(size_t count, uint64_t rng_seed = 1);
+
+/**
+  Measures the cost of hashing keys of key_bytes bytes.
+  @param iterations Number of hashes to time. Scaled down internally for large
+  keys so each measurement covers a similar number of bytes.
+*/
+hash_speed_t hash_speed(hash_test_fn_t fn, size_t key_bytes,
+                        size_t iterations = 1000000);
+
+/**
+  Runs all of the above with default parameters and writes a summary to out.
+*/
+void hash_quality_report(std::ostream &out, const char *name,
+                         hash_test_fn_t fn, unsigned output_bits);
+
+
+} // namespace snow
+
+#endif /* end __SNOW_COMMON__HASH_QUALITY_HH__ include guard */
@@ -0,0 +1,71 @@
+// main.cc -- Noel Cower -- Public Domain
+//
+// hash-quality: runs the hash quality and speed checks against snow's hash
+// functions and prints a report for each. With no arguments, every hash is
+// checked; otherwise, only the named hashes are.
+//
+//   $ bin/hash-quality hash64 crc32c
+
+#include "hash_quality.hh"
+#include <snow/data/crc32c.hh>
+#include <cstring>
+#include <iostream>
+
+
+namespace {
+
+
+uint64_t crc32c_quality_adapter(const char *data, size_t length, uint64_t seed)
+{
+  return snow::crc32c(data, length, static_cast<uint32_t>(seed));
+}
+
+
+struct named_hash_t
+{
+  const char            *name;
+  snow::hash_test_fn_t   fn;
+  unsigned               output_bits;
+};
+
+
+const named_hash_t HASHES[] = {
+  { "hash32", &snow::hash32_quality_adapter, 32 },
+  { "hash64", &snow::hash64_quality_adapter, 64 },
+  { "crc32c", &crc32c_quality_adapter, 32 },
+};
+
+
+} // namespace <anon>
+
+
+
+int main(int argc, const char *argv[])
+{
+  int status = 0;
+  for (int arg = 1; arg < argc; ++arg) {
+    bool known = false;
+    for (const named_hash_t &hash : HASHES) {
+      known = known || std::strcmp(argv[arg], hash.name) == 0;
+    }
+    if (!known) {
+      std::cerr << "Unknown hash: " << argv[arg] << "\n";
+      status = 1;
+    }
+  }
+  if (status) {
+    return status;
+  }
+
+  for (const named_hash_t &hash : HASHES) {
+    bool selected = argc == 1;
+    for (int arg = 1; arg < argc; ++arg) {
+      selected = selected || std::strcmp(argv[arg], hash.name) == 0;
+    }
+    if (selected) {
+      snow::hash_quality_report(std::cout, hash.name, hash.fn, hash.output_bits);
+      std::cout << std::endl;
+    }
+  }
+  return 0;
+}